@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// std::allocator for containers whose storage must start on an Alignment
+// boundary (a power of two, at least sizeof(void*)), e.g. for aligned SIMD loads.
+template<typename T, size_t Alignment = 32>
+class AlignedAllocator {
+public:
+  typedef T value_type;
+
+  template<typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T *allocate(size_t count) {
+    if (count == 0) {
+      return nullptr;
+    }
+    if (count > static_cast<size_t>(-1) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+#if defined(_MSC_VER)
+    void *p = _aligned_malloc(count * sizeof(T), Alignment);
+#else
+    void *p = nullptr;
+    if (posix_memalign(&p, Alignment, count * sizeof(T)) != 0) {
+      p = nullptr;
+    }
+#endif
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T *p, size_t) {
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+  }
+
+  template<typename U>
+  bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+  template<typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
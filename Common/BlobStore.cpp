@@ -0,0 +1,97 @@
+#include "BlobStore.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+  const uint32_t FileMagic = 0x31424c42; // "BLB1"
+
+  unsigned long ProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+  }
+
+  // Renames from to to, replacing a file already there. std::rename does
+  // that on POSIX but fails on Windows.
+  bool MoveIntoPlace(const std::string &from, const std::string &to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+  }
+
+  struct FileHeader {
+    uint32_t Magic;
+    uint32_t Reserved;
+    uint64_t Key;
+    uint64_t Size;
+  };
+}
+
+bool BlobStore::Read(uint64_t key, std::vector<uint8_t> &blob) const {
+  std::ifstream file(PathFor(key), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (contents.size() < sizeof(FileHeader)) {
+    return false;
+  }
+  FileHeader header;
+  memcpy(&header, contents.data(), sizeof(header));
+  if (header.Magic != FileMagic || header.Key != key || header.Size != contents.size() - sizeof(header)) {
+    return false;
+  }
+  blob.assign(contents.begin() + sizeof(header), contents.end());
+  return true;
+}
+
+void BlobStore::Write(uint64_t key, const void *data, size_t size) {
+  // Every copy is complete, so if another thread or process writes the same
+  // key, whichever renames last wins.
+  std::string path = PathFor(key);
+  // The process id keeps other processes' temporary copies apart, the
+  // counter this process's threads'.
+  std::string temp = path + "." + std::to_string(ProcessId()) + "." + std::to_string(mTempFiles++) + ".tmp";
+  {
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return;
+    }
+    FileHeader header = { FileMagic, 0, key, size };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(static_cast<const char*>(data), size);
+    if (!file) {
+      file.close();
+      std::remove(temp.c_str());
+      return;
+    }
+  }
+  if (!MoveIntoPlace(temp, path)) {
+    std::remove(temp.c_str());
+  }
+}
+
+void BlobStore::Remove(uint64_t key) const {
+  std::remove(PathFor(key).c_str());
+}
+
+std::string BlobStore::PathFor(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+  std::string path = mDirectory;
+  if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+    path += '/';
+  }
+  return path + name + mExtension;
+}
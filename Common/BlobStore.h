@@ -0,0 +1,26 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A directory of binary blobs named by a 64-bit key. Each file starts with a
+// header carrying the key and size, so truncated or foreign files read as
+// missing, and is written under a temporary name and renamed into place,
+// replacing any older file, so concurrent readers never see a partial file.
+class BlobStore {
+public:
+  // The directory must exist; an empty one means the working directory.
+  BlobStore(const std::string &directory, const std::string &extension) : mDirectory(directory), mExtension(extension) {}
+
+  bool Read(uint64_t key, std::vector<uint8_t> &blob) const;
+  // Failing to write is silent; the blob is just missing next time.
+  void Write(uint64_t key, const void *data, size_t size);
+  void Remove(uint64_t key) const;
+  std::string PathFor(uint64_t key) const;
+
+private:
+  std::string mDirectory;
+  std::string mExtension;
+  std::atomic<uint32_t> mTempFiles{ 0 };
+};
@@ -0,0 +1,62 @@
+#include "CommandRecorder.h"
+#include <cstring>
+
+namespace {
+  uint32_t Bits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+  }
+}
+
+bool MemoryCommandRecorder::Command::operator==(const Command &rhs) const {
+  return Kind == rhs.Kind && Value == rhs.Value && memcmp(Args, rhs.Args, sizeof(Args)) == 0;
+}
+
+void MemoryCommandRecorder::SetRootSignature(uint64_t rootSignature) {
+  Push(Type::SetRootSignature, rootSignature);
+}
+
+void MemoryCommandRecorder::SetPipelineState(uint64_t pipeline) {
+  Push(Type::SetPipelineState, pipeline);
+}
+
+void MemoryCommandRecorder::SetPrimitiveTopology(uint32_t topology) {
+  Push(Type::SetPrimitiveTopology, 0, topology);
+}
+
+void MemoryCommandRecorder::SetViewport(const Viewport &viewport) {
+  Push(Type::SetViewport, 0, Bits(viewport.X), Bits(viewport.Y), Bits(viewport.Width), Bits(viewport.Height),
+    Bits(viewport.MinDepth), Bits(viewport.MaxDepth));
+}
+
+void MemoryCommandRecorder::SetScissorRect(const ScissorRect &rect) {
+  Push(Type::SetScissorRect, 0, static_cast<uint32_t>(rect.Left), static_cast<uint32_t>(rect.Top),
+    static_cast<uint32_t>(rect.Right), static_cast<uint32_t>(rect.Bottom));
+}
+
+void MemoryCommandRecorder::SetVertexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t stride) {
+  Push(Type::SetVertexBuffer, address, sizeInBytes, stride);
+}
+
+void MemoryCommandRecorder::SetIndexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t indexSize) {
+  Push(Type::SetIndexBuffer, address, sizeInBytes, indexSize);
+}
+
+void MemoryCommandRecorder::SetConstantBuffer(uint32_t slot, uint64_t address) {
+  Push(Type::SetConstantBuffer, address, slot);
+}
+
+void MemoryCommandRecorder::SetShaderResource(uint32_t slot, uint64_t address) {
+  Push(Type::SetShaderResource, address, slot);
+}
+
+void MemoryCommandRecorder::DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                                        int32_t baseVertex, uint32_t startInstance) {
+  Push(Type::DrawIndexed, 0, indexCount, instanceCount, startIndex, static_cast<uint32_t>(baseVertex), startInstance);
+}
+
+void MemoryCommandRecorder::Push(Type kind, uint64_t value, uint32_t a, uint32_t b, uint32_t c,
+                                 uint32_t d, uint32_t e, uint32_t f) {
+  mCommands.push_back({ kind, value, { a, b, c, d, e, f } });
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// API-neutral recording commands. Addresses, pipelines and root signatures
+// are opaque 64-bit values; D3D12CommandRecorder reads them as GPU virtual
+// addresses, ID3D12PipelineState and ID3D12RootSignature pointers. Render
+// targets stay with the owner of the command list.
+class CommandRecorder {
+public:
+  enum class Type {
+    SetRootSignature, SetPipelineState, SetPrimitiveTopology, SetViewport, SetScissorRect,
+    SetVertexBuffer, SetIndexBuffer, SetConstantBuffer, SetShaderResource, DrawIndexed, Count
+  };
+
+  struct Viewport {
+    float X, Y, Width, Height, MinDepth, MaxDepth;
+  };
+  struct ScissorRect {
+    int32_t Left, Top, Right, Bottom;
+  };
+
+  virtual ~CommandRecorder() {}
+
+  virtual void SetRootSignature(uint64_t rootSignature) = 0;
+  virtual void SetPipelineState(uint64_t pipeline) = 0;
+  // A D3D_PRIMITIVE_TOPOLOGY value.
+  virtual void SetPrimitiveTopology(uint32_t topology) = 0;
+  virtual void SetViewport(const Viewport &viewport) = 0;
+  virtual void SetScissorRect(const ScissorRect &rect) = 0;
+  virtual void SetVertexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t stride) = 0;
+  // indexSize is 2 or 4 bytes.
+  virtual void SetIndexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t indexSize) = 0;
+  virtual void SetConstantBuffer(uint32_t slot, uint64_t address) = 0;
+  virtual void SetShaderResource(uint32_t slot, uint64_t address) = 0;
+  virtual void DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                           int32_t baseVertex, uint32_t startInstance) = 0;
+};
+
+// Keeps every command in memory, so recording can be checked and timed
+// without a device.
+class MemoryCommandRecorder : public CommandRecorder {
+public:
+  struct Command {
+    Type Kind;
+    uint64_t Value;   // root signature, pipeline or address
+    uint32_t Args[6]; // the remaining arguments; floats keep their bits
+
+    bool operator==(const Command &rhs) const;
+    bool operator!=(const Command &rhs) const { return !(*this == rhs); }
+  };
+
+  void SetRootSignature(uint64_t rootSignature) override;
+  void SetPipelineState(uint64_t pipeline) override;
+  void SetPrimitiveTopology(uint32_t topology) override;
+  void SetViewport(const Viewport &viewport) override;
+  void SetScissorRect(const ScissorRect &rect) override;
+  void SetVertexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t stride) override;
+  void SetIndexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t indexSize) override;
+  void SetConstantBuffer(uint32_t slot, uint64_t address) override;
+  void SetShaderResource(uint32_t slot, uint64_t address) override;
+  void DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                   int32_t baseVertex, uint32_t startInstance) override;
+
+  const std::vector<Command> &Commands() const { return mCommands; }
+  void Clear() { mCommands.clear(); }
+
+private:
+  void Push(Type kind, uint64_t value, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0,
+            uint32_t d = 0, uint32_t e = 0, uint32_t f = 0);
+
+  std::vector<Command> mCommands;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+// 64-bit draw key. Sorting by it groups draws by the costliest state change
+// first: root signature, then pipeline state, mesh (vertex/index buffers) and
+// material, with front-to-back depth last so that draws sharing all state
+// still help early depth rejection.
+namespace DrawSortKey {
+  const int DepthBits = 24;
+  const int MaterialBits = 10;
+  const int MeshBits = 16;
+  const int PipelineBits = 10;
+  const int RootSignatureBits = 4;
+
+  const int DepthShift = 0;
+  const int MaterialShift = DepthShift + DepthBits;
+  const int MeshShift = MaterialShift + MaterialBits;
+  const int PipelineShift = MeshShift + MeshBits;
+  const int RootSignatureShift = PipelineShift + PipelineBits;
+  static_assert(RootSignatureShift + RootSignatureBits == 64, "Sort key fields must fill 64 bits.");
+
+  // Values wider than their field would alias other keys, so they are a bug
+  // in the caller (e.g. more than 65536 meshes).
+  inline uint64_t Field(uint64_t value, int bits, int shift) {
+    assert((value >> bits) == 0 && "Sort key field out of range.");
+    return (value & ((1ull << bits) - 1)) << shift;
+  }
+
+  // depth is view depth divided by the far plane; it is clamped to [0, 1].
+  inline uint64_t Make(uint32_t rootSignature, uint32_t pipeline, uint32_t mesh, uint32_t material, float depth) {
+    float clamped = std::min(std::max(depth, 0.0f), 1.0f);
+    uint64_t quantized = static_cast<uint64_t>(clamped * ((1u << DepthBits) - 1));
+    return Field(rootSignature, RootSignatureBits, RootSignatureShift) | Field(pipeline, PipelineBits, PipelineShift) |
+      Field(mesh, MeshBits, MeshShift) | Field(material, MaterialBits, MaterialShift) | Field(quantized, DepthBits, DepthShift);
+  }
+
+  inline uint32_t Get(uint64_t key, int bits, int shift) {
+    return static_cast<uint32_t>((key >> shift) & ((1ull << bits) - 1));
+  }
+  inline uint32_t RootSignature(uint64_t key) { return Get(key, RootSignatureBits, RootSignatureShift); }
+  inline uint32_t Pipeline(uint64_t key) { return Get(key, PipelineBits, PipelineShift); }
+  inline uint32_t Mesh(uint64_t key) { return Get(key, MeshBits, MeshShift); }
+  inline uint32_t Material(uint64_t key) { return Get(key, MaterialBits, MaterialShift); }
+}
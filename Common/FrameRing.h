@@ -0,0 +1,111 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Minimal view of a GPU queue and its fence: enough to pace a ring of frame
+// resources without depending on a device, so the pacing can run against the
+// in-process FakeFenceQueue below.
+class IFenceQueue {
+public:
+  virtual ~IFenceQueue() = default;
+  // Enqueues a signal behind all work submitted so far and returns its value.
+  virtual uint64_t Signal() = 0;
+  // Highest signal value the queue has executed.
+  virtual uint64_t CompletedValue() const = 0;
+  // Blocks the CPU until CompletedValue() >= value.
+  virtual void WaitFor(uint64_t value) = 0;
+};
+
+// Deterministic stand-in for a GPU that runs Latency frames behind the CPU:
+// each Signal() completes the oldest pending signals until at most Latency
+// remain. WaitFor() completes everything up to the requested value at once and
+// counts the call as a stall.
+class FakeFenceQueue : public IFenceQueue {
+public:
+  explicit FakeFenceQueue(unsigned int latency = 0) : mLatency(latency) {}
+
+  uint64_t Signal() override {
+    mPending.push_back(++mLastSignaled);
+    while (mPending.size() > mLatency) {
+      Retire();
+    }
+    return mLastSignaled;
+  }
+
+  uint64_t CompletedValue() const override { return mCompleted; }
+
+  void WaitFor(uint64_t value) override {
+    assert(value <= mLastSignaled && "Waiting on a value that was never signaled.");
+    if (mCompleted >= value) {
+      return;
+    }
+    mStalls++;
+    while (mCompleted < value) {
+      Retire();
+    }
+  }
+
+  // Completes the oldest pending signal, e.g. to model the GPU catching up.
+  void Retire() {
+    if (!mPending.empty()) {
+      mCompleted = mPending.front();
+      mPending.pop_front();
+    }
+  }
+
+  void SetLatency(unsigned int latency) { mLatency = latency; }
+  uint64_t Stalls() const { return mStalls; }
+
+private:
+  unsigned int mLatency;
+  uint64_t mLastSignaled = 0;
+  uint64_t mCompleted = 0;
+  uint64_t mStalls = 0;
+  std::deque<uint64_t> mPending;
+};
+
+// Round-robin ring of per-frame resources. BeginFrame() moves to the next
+// slot and waits only for the frame that last used it, so the CPU can record
+// up to FrameCount() frames ahead of the GPU; EndFrame() fences the slot.
+class FrameRing {
+public:
+  struct Stats {
+    uint64_t Frames = 0;
+    uint64_t Waits = 0;  // BeginFrame calls that found their slot still in flight
+  };
+
+  FrameRing(IFenceQueue &queue, unsigned int frameCount)
+    : mQueue(queue), mFences(frameCount, 0) {
+    assert(frameCount > 0);
+  }
+
+  // Returns the slot whose resources the caller may now reset and overwrite.
+  unsigned int BeginFrame() {
+    mCurrent = (mCurrent + 1) % static_cast<unsigned int>(mFences.size());
+    uint64_t fence = mFences[mCurrent];
+    if (fence != 0 && mQueue.CompletedValue() < fence) {
+      mStats.Waits++;
+      mQueue.WaitFor(fence);
+    }
+    return mCurrent;
+  }
+
+  // Call after the frame's command lists were submitted.
+  void EndFrame() {
+    mFences[mCurrent] = mQueue.Signal();
+    mStats.Frames++;
+  }
+
+  unsigned int Current() const { return mCurrent; }
+  unsigned int FrameCount() const { return static_cast<unsigned int>(mFences.size()); }
+  uint64_t Fence(unsigned int slot) const { return mFences[slot]; }
+  const Stats &GetStats() const { return mStats; }
+
+private:
+  IFenceQueue &mQueue;
+  std::vector<uint64_t> mFences;
+  unsigned int mCurrent = 0;
+  Stats mStats;
+};
@@ -3,7 +3,10 @@
 //***************************************************************************************
 
 #include "GeometryGenerator.h"
+#include "JobSystem.h"
+#include "VertexCache.h"
 #include <algorithm>
+#include <cassert>
 
 using namespace DirectX;
 
@@ -208,18 +211,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 		meshData.Indices32.push_back(baseIndex+i+1);
 	}
 
+	OptimizeVertexCache(meshData);
+
     return meshData;
 }
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
-
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
-
 	//       v1
 	//       *
 	//      / \
@@ -230,48 +228,71 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
-	for(uint32 i = 0; i < numTris; ++i)
+	// Each edge's midpoint is made once and shared by the two triangles on
+	// it, so the result stays watertight and a closed mesh grows by one
+	// vertex per edge (3/2 per triangle) instead of 6 per triangle.
+	uint32 numTris = (uint32)meshData.Indices32.size()/3;
+	meshData.Vertices.reserve(meshData.Vertices.size() + numTris*3/2);
+	EdgeMidpoints midpoints(numTris*3);
+
+	// Triangle i becomes indices [12i, 12i+12), which only overlap triangles
+	// at or after i, so walking backwards subdivides in place.
+	meshData.Indices32.resize(numTris*12);
+	for(uint32 i = numTris; i-- > 0; )
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
-
-		//
-		// Generate the midpoints.
-		//
-
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
-
-		//
-		// Add new geometry.
-		//
-
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
-
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+		uint32 i0 = meshData.Indices32[i*3+0];
+		uint32 i1 = meshData.Indices32[i*3+1];
+		uint32 i2 = meshData.Indices32[i*3+2];
+
+		uint32 m0 = midpoints.Find(i0, i1, *this, meshData.Vertices);
+		uint32 m1 = midpoints.Find(i1, i2, *this, meshData.Vertices);
+		uint32 m2 = midpoints.Find(i0, i2, *this, meshData.Vertices);
+
+		uint32* out = &meshData.Indices32[i*12];
+		out[0] = i0;  out[1] = m0;  out[2] = m2;
+		out[3] = m0;  out[4] = m1;  out[5] = m2;
+		out[6] = m2;  out[7] = m1;  out[8] = i2;
+		out[9] = m0;  out[10] = i1; out[11] = m1;
+	}
+}
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+GeometryGenerator::EdgeMidpoints::EdgeMidpoints(uint32 maxEdges)
+{
+	// At most half full, so probe runs stay short.
+	size_t size = 16;
+	while(size < 2*(size_t)maxEdges)
+		size *= 2;
+	mSlots.assign(size, Slot{ EmptyKey, 0 });
+	mMask = size - 1;
+}
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+GeometryGenerator::uint32 GeometryGenerator::EdgeMidpoints::Find(uint32 a, uint32 b, GeometryGenerator& generator,
+	std::vector<Vertex>& vertices)
+{
+	// The edge is the same whichever triangle walks it and in which direction.
+	uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mMask;
+	while(mSlots[slot].Key != key)
+	{
+		if(mSlots[slot].Key == EmptyKey)
+		{
+			mSlots[slot].Key = key;
+			mSlots[slot].Index = (uint32)vertices.size();
+			Vertex m = generator.MidPoint(vertices[a], vertices[b]);
+			vertices.push_back(m);
+			break;
+		}
+		slot = (slot + 1) & mMask;
 	}
+	return mSlots[slot].Index;
+}
+
+void GeometryGenerator::OptimizeVertexCache(MeshData& meshData)
+{
+	// Row by row, a wide mesh's vertices leave the cache before the next row
+	// reuses them.
+	if(mOptimizeVertexCache)
+		VertexCache::Optimize(meshData.Indices32.data(), meshData.Indices32.size(), meshData.Vertices.size());
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -304,19 +325,45 @@ GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Ve
     return v;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
+GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions, JobSystem* jobs)
 {
     MeshData meshData;
 
-	// Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+    meshData.Vertices.resize(GeosphereVertexCount(numSubdivisions));
+    meshData.Indices32.resize(GeosphereIndexCount(numSubdivisions));
+
+    CreateGeosphere(radius, numSubdivisions, meshData.Vertices.data(), meshData.Indices32.data(), jobs);
+
+    return meshData;
+}
+
+size_t GeometryGenerator::GeosphereVertexCount(uint32 numSubdivisions)
+{
+	// 10n^2 + 2 for n segments per icosahedron edge, by Euler's formula.
+	if(numSubdivisions > MaxGeosphereSubdivisions)
+		numSubdivisions = MaxGeosphereSubdivisions;
+	size_t n = (size_t)1 << numSubdivisions;
+	return 10*n*n + 2;
+}
 
+size_t GeometryGenerator::GeosphereIndexCount(uint32 numSubdivisions)
+{
+	// n^2 triangles per face.
+	if(numSubdivisions > MaxGeosphereSubdivisions)
+		numSubdivisions = MaxGeosphereSubdivisions;
+	size_t n = (size_t)1 << numSubdivisions;
+	return 20*3*n*n;
+}
+
+void GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions, Vertex* vertices, uint32* indices,
+	JobSystem* jobs)
+{
 	// Approximate a sphere by tessellating an icosahedron.
 
 	const float X = 0.525731f; 
 	const float Z = 0.850651f;
 
-	XMFLOAT3 pos[12] = 
+	const XMFLOAT3 pos[12] = 
 	{
 		XMFLOAT3(-X, 0.0f, Z),  XMFLOAT3(X, 0.0f, Z),  
 		XMFLOAT3(-X, 0.0f, -Z), XMFLOAT3(X, 0.0f, -Z),    
@@ -326,7 +373,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		XMFLOAT3(Z, -X, 0.0f),  XMFLOAT3(-Z, -X, 0.0f)
 	};
 
-    uint32 k[60] =
+    const uint32 k[60] =
 	{
 		1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,    
 		1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,    
@@ -334,49 +381,160 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
 	};
 
-    meshData.Vertices.resize(12);
-    meshData.Indices32.assign(&k[0], &k[60]);
+	// Each face is cut into an n x n triangular grid, whose vertex (i, j) is
+	// c0 + i/n (c1 - c0) + j/n (c2 - c0) for i + j <= n.  Rather than
+	// subdividing n times, every vertex gets a fixed place in the output: the
+	// 12 corners, then the n-1 inner vertices of each of the 30 edges (from
+	// its lower corner to its higher), then the (n-1)(n-2)/2 inner vertices of
+	// each face, row by row.  Vertices shared by faces are written once by
+	// their edge or corner, so edges and blocks of face rows are independent
+	// jobs writing disjoint parts of the arrays.
+	if(numSubdivisions > MaxGeosphereSubdivisions)
+		numSubdivisions = MaxGeosphereSubdivisions;
+	const uint32 n = 1u << numSubdivisions;
+	const float step = 1.0f / n;
+
+	uint32 edgeId[12][12];
+	uint32 edges[30][2];
+	uint32 numEdges = 0;
+	std::fill(&edgeId[0][0], &edgeId[0][0] + 12*12, ~0u);
+	for(uint32 f = 0; f < 20; ++f)
+	{
+		for(uint32 e = 0; e < 3; ++e)
+		{
+			uint32 a = std::min(k[f*3+e], k[f*3+(e+1)%3]);
+			uint32 b = std::max(k[f*3+e], k[f*3+(e+1)%3]);
+			if(edgeId[a][b] == ~0u)
+			{
+				edgeId[a][b] = edgeId[b][a] = numEdges;
+				edges[numEdges][0] = a;
+				edges[numEdges][1] = b;
+				++numEdges;
+			}
+		}
+	}
+	assert(numEdges == 30);
 
-	for(uint32 i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
+	const uint32 edgeBase = 12;
+	const uint32 faceBase = edgeBase + 30*(n-1);
+	const uint32 perFace = (n-1)*(n-2)/2;
+
+	// Index of the vertex t steps from corner a towards corner b, 0 < t < n.
+	auto edgeVertex = [&](uint32 a, uint32 b, uint32 t)
+	{
+		uint32 first = edgeBase + edgeId[a][b]*(n-1);
+		return a < b ? first + t-1 : first + n-1-t;
+	};
 
-	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	// Index of vertex (i, 1) of face f, 0 < i < n-1; the row runs on to j = n-1-i.
+	auto innerRow = [&](uint32 f, uint32 i)
+	{
+		return faceBase + f*perFace + (i-1)*(n-1) - (i-1)*i/2;
+	};
+
+	// Indices of row i of face f, j = 0..n-i.
+	auto faceRow = [&](uint32 f, uint32 i, uint32* row)
+	{
+		const uint32* c = &k[f*3];
+		uint32 last = n - i;
+		if(i == n)
+		{
+			row[0] = c[1];
+			return;
+		}
+		row[0] = i == 0 ? c[0] : edgeVertex(c[0], c[1], i);
+		row[last] = i == 0 ? c[2] : edgeVertex(c[1], c[2], last);
+		for(uint32 j = 1; j < last; ++j)
+			row[j] = i == 0 ? edgeVertex(c[0], c[2], j) : innerRow(f, i) + j-1;
+	};
 
-	// Project vertices onto sphere and scale.
-	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
+	auto project = [&](FXMVECTOR p, Vertex& v)
 	{
 		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
+		XMVECTOR normal = XMVector3Normalize(p);
 
 		// Project onto sphere.
-		XMVECTOR p = radius*n;
-
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
+		XMStoreFloat3(&v.Position, radius*normal);
+		XMStoreFloat3(&v.Normal, normal);
 
 		// Derive texture coordinates from spherical coordinates.
-        float theta = atan2f(meshData.Vertices[i].Position.z, meshData.Vertices[i].Position.x);
+        float theta = atan2f(v.Position.z, v.Position.x);
 
         // Put in [0, 2pi].
         if(theta < 0.0f)
             theta += XM_2PI;
 
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
+		float phi = acosf(v.Position.y / radius);
 
-		meshData.Vertices[i].TexC.x = theta/XM_2PI;
-		meshData.Vertices[i].TexC.y = phi/XM_PI;
+		v.TexC.x = theta/XM_2PI;
+		v.TexC.y = phi/XM_PI;
 
 		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
+		XMVECTOR T = XMVectorSet(-radius*sinf(phi)*sinf(theta), 0.0f, +radius*sinf(phi)*cosf(theta), 0.0f);
+		XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+	};
 
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
-	}
+	for(uint32 i = 0; i < 12; ++i)
+		project(XMLoadFloat3(&pos[i]), vertices[i]);
 
-    return meshData;
+	// Jobs 0-29 fill in an edge each, the rest a block of rows of a face:
+	// their inner vertices and the triangles between each row and the next.
+	const uint32 rowsPerJob = 32;
+	const uint32 blocksPerFace = (n + rowsPerJob - 1) / rowsPerJob;
+
+	auto job = [&](uint32 index)
+	{
+		if(index < 30)
+		{
+			XMVECTOR a = XMLoadFloat3(&pos[edges[index][0]]);
+			XMVECTOR b = XMLoadFloat3(&pos[edges[index][1]]);
+			uint32 first = edgeBase + index*(n-1);
+			for(uint32 t = 1; t < n; ++t)
+				project(XMVectorLerp(a, b, t*step), vertices[first + t-1]);
+			return;
+		}
+
+		uint32 f = (index - 30) / blocksPerFace;
+		uint32 firstRow = (index - 30) % blocksPerFace * rowsPerJob;
+		uint32 endRow = std::min(firstRow + rowsPerJob, n);
+
+		XMVECTOR c0 = XMLoadFloat3(&pos[k[f*3+0]]);
+		XMVECTOR d1 = (XMLoadFloat3(&pos[k[f*3+1]]) - c0) * step;
+		XMVECTOR d2 = (XMLoadFloat3(&pos[k[f*3+2]]) - c0) * step;
+
+		for(uint32 i = std::max(firstRow, 1u); i < std::min(endRow, n-1); ++i)
+		{
+			Vertex* row = &vertices[innerRow(f, i)];
+			for(uint32 j = 1; j < n-i; ++j)
+				project(c0 + (float)i*d1 + (float)j*d2, row[j-1]);
+		}
+
+		// Row i has n-i upward triangles and n-i-1 downward ones, interleaved;
+		// rows before it hold 2ni - i^2 triangles.
+		std::vector<uint32> top(n+1), bottom(n+1);
+		faceRow(f, firstRow, top.data());
+		for(uint32 i = firstRow; i < endRow; ++i)
+		{
+			faceRow(f, i+1, bottom.data());
+			uint32* out = &indices[3*((size_t)f*n*n + 2*(size_t)n*i - (size_t)i*i)];
+			for(uint32 j = 0; j < n-i; ++j)
+			{
+				*out++ = top[j];  *out++ = bottom[j];  *out++ = top[j+1];
+				if(j+1 < n-i)
+				{
+					*out++ = bottom[j];  *out++ = bottom[j+1];  *out++ = top[j+1];
+				}
+			}
+			top.swap(bottom);
+		}
+	};
+
+	uint32 numJobs = 30 + 20*blocksPerFace;
+	if(jobs)
+		jobs->ParallelFor(numJobs, 1, job);
+	else
+		for(uint32 i = 0; i < numJobs; ++i)
+			job(i);
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
@@ -470,6 +628,8 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
 	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
 
+	OptimizeVertexCache(meshData);
+
     return meshData;
 }
 
@@ -610,6 +770,8 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 		}
 	}
 
+	OptimizeVertexCache(meshData);
+
     return meshData;
 }
 
@@ -18,6 +18,8 @@
 #include <DirectXMath.h>
 #include <vector>
 
+class JobSystem;
+
 class GeometryGenerator
 {
 public:
@@ -88,9 +90,23 @@ public:
 
 	///<summary>
 	/// Creates a geosphere centered at the origin with the given radius.  The
-	/// depth controls the level of tessellation.
+	/// depth controls the level of tessellation: each icosahedron edge is cut
+	/// into 2^numSubdivisions segments.  Given a job system, the faces are
+	/// generated in parallel.
+	///</summary>
+    MeshData CreateGeosphere(float radius, uint32 numSubdivisions, JobSystem* jobs = nullptr);
+
+	///<summary>
+	/// Same, written straight into arrays of GeosphereVertexCount and
+	/// GeosphereIndexCount elements, such as a mapped upload buffer.
 	///</summary>
-    MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
+    void CreateGeosphere(float radius, uint32 numSubdivisions, Vertex* vertices, uint32* indices, JobSystem* jobs = nullptr);
+
+    static size_t GeosphereVertexCount(uint32 numSubdivisions);
+    static size_t GeosphereIndexCount(uint32 numSubdivisions);
+
+    // Deeper geospheres have more vertices than 32-bit indices can address.
+    static const uint32 MaxGeosphereSubdivisions = 14;
 
 	///<summary>
 	/// Creates a cylinder parallel to the y-axis, and centered about the origin.  
@@ -110,10 +126,38 @@ public:
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 
+	///<summary>
+	/// Whether CreateSphere, CreateCylinder and CreateGrid reorder their triangles
+	/// for the post-transform vertex cache (VertexCache::Optimize).  On by default.
+	///</summary>
+    void SetOptimizeVertexCache(bool optimize) { mOptimizeVertexCache = optimize; }
+
 private:
+	// Open-addressing map from an undirected edge (a pair of vertex indices)
+	// to the index of its midpoint vertex, made on first use.
+	class EdgeMidpoints
+	{
+	public:
+		explicit EdgeMidpoints(uint32 maxEdges);
+		uint32 Find(uint32 a, uint32 b, GeometryGenerator& generator, std::vector<Vertex>& vertices);
+
+	private:
+		static const uint64_t EmptyKey = ~0ull;
+		struct Slot
+		{
+			uint64_t Key;
+			uint32 Index;
+		};
+		std::vector<Slot> mSlots;
+		size_t mMask;
+	};
+
 	void Subdivide(MeshData& meshData);
+	void OptimizeVertexCache(MeshData& meshData);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
     void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
     void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+
+    bool mOptimizeVertexCache = true;
 };
 
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a. Fast and stable across runs and platforms, so it can name
+// things stored on disk; not meant to resist deliberate collisions.
+namespace Fnv1a {
+  const uint64_t Offset = 14695981039346656037ull;
+  const uint64_t Prime = 1099511628211ull;
+
+  // Continues hash over size bytes of data.
+  inline uint64_t Hash(const void *data, size_t size, uint64_t hash = Offset) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * Prime;
+    }
+    return hash;
+  }
+
+  // Hashes the length first, so consecutive strings cannot run together.
+  inline uint64_t Hash(const std::string &s, uint64_t hash = Offset) {
+    uint64_t size = s.size();
+    return Hash(s.data(), s.size(), Hash(&size, sizeof(size), hash));
+  }
+}
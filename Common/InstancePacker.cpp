@@ -0,0 +1,36 @@
+#include "InstancePacker.h"
+#include <algorithm>
+
+void InstancePacker::Add(uint32_t key, const DirectX::XMFLOAT4X4 &world) {
+  mKeys.push_back(key);
+  mWorlds.push_back(&world);
+  mKeyCount = std::max(mKeyCount, key + 1);
+}
+
+void InstancePacker::Pack(InstanceData *instances) {
+  // Histogram, then exclusive prefix sums give each key's first slot.
+  mOffsets.assign(mKeyCount, 0);
+  for (uint32_t key : mKeys) {
+    mOffsets[key]++;
+  }
+  mBatches.clear();
+  uint32_t first = 0;
+  for (uint32_t key = 0; key < mKeyCount; key++) {
+    uint32_t count = mOffsets[key];
+    if (count != 0) {
+      mBatches.push_back({ key, first, count });
+    }
+    mOffsets[key] = first;
+    first += count;
+  }
+  for (size_t i = 0; i < mKeys.size(); i++) {
+    instances[mOffsets[mKeys[i]]++].World = *mWorlds[i];
+  }
+}
+
+void InstancePacker::Clear() {
+  mKeys.clear();
+  mWorlds.clear();
+  mBatches.clear();
+  mKeyCount = 0;
+}
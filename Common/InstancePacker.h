@@ -0,0 +1,42 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// One element of the instanced vertex shader's StructuredBuffer. World is
+// stored as the CPU holds it; color.hlsl declares it row_major.
+struct InstanceData {
+  DirectX::XMFLOAT4X4 World;
+};
+
+// Groups instances by geometry so that each group is one instanced draw.
+// Keys are small dense integers chosen by the caller (one per mesh/submesh),
+// which lets Pack() use a counting sort instead of a comparison sort.
+class InstancePacker {
+public:
+  struct Batch {
+    uint32_t Key;
+    uint32_t FirstInstance;
+    uint32_t InstanceCount;
+  };
+
+  // world must stay valid until Pack().
+  void Add(uint32_t key, const DirectX::XMFLOAT4X4 &world);
+
+  // Writes every instance to instances, which must hold InstanceCount()
+  // elements, grouped by key in increasing key order and in Add() order within
+  // a key, and builds one batch per key used.
+  void Pack(InstanceData *instances);
+
+  size_t InstanceCount() const { return mKeys.size(); }
+  const std::vector<Batch> &Batches() const { return mBatches; }
+  // Keeps the allocations for the next frame.
+  void Clear();
+
+private:
+  std::vector<uint32_t> mKeys;
+  std::vector<const DirectX::XMFLOAT4X4*> mWorlds;
+  std::vector<uint32_t> mOffsets;
+  std::vector<Batch> mBatches;
+  uint32_t mKeyCount = 0;
+};
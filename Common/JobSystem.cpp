@@ -0,0 +1,202 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+  // Which queue the current thread owns, and in which system.
+  thread_local const JobSystem *tSystem = nullptr;
+  thread_local unsigned int tQueue = 0;
+}
+
+bool JobSystem::Counter::Done() const {
+  if (mPending.load(std::memory_order_acquire) != 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPending.load(std::memory_order_relaxed) == 0;
+}
+
+JobSystem::JobSystem(unsigned int threadCount) : mCreator(std::this_thread::get_id()) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned int i = 0; i < threadCount; i++) {
+    mQueues.push_back(std::make_unique<Queue>());
+  }
+  for (unsigned int i = 1; i < threadCount; i++) {
+    mThreads.emplace_back(&JobSystem::WorkerLoop, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mQuit = true;
+  }
+  mWake.notify_all();
+  for (std::thread &t : mThreads) {
+    t.join();
+  }
+}
+
+unsigned int JobSystem::QueueIndex() const {
+  // Other threads push to the creating thread's queue.
+  return tSystem == this ? tQueue : 0;
+}
+
+void JobSystem::Run(Job job, Counter *counter) {
+  if (counter) {
+    counter->mPending.fetch_add(1, std::memory_order_relaxed);
+  }
+  Push(QueueIndex(), std::move(job), counter);
+}
+
+void JobSystem::RunAfter(Counter &dependency, Job job, Counter *counter) {
+  if (counter) {
+    counter->mPending.fetch_add(1, std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> lock(dependency.mMutex);
+    if (dependency.mPending.load(std::memory_order_relaxed) != 0) {
+      dependency.mContinuations.emplace_back(std::move(job), counter);
+      return;
+    }
+  }
+  Push(QueueIndex(), std::move(job), counter);
+}
+
+void JobSystem::Push(unsigned int queue, Job job, Counter *counter) {
+  {
+    std::lock_guard<std::mutex> lock(mQueues[queue]->Mutex);
+    mQueues[queue]->Jobs.emplace_back(std::move(job), counter);
+  }
+  mQueued.fetch_add(1);
+  if (mSleeping.load() > 0) {
+    // Taking the lock orders this against a worker between its check and its wait.
+    { std::lock_guard<std::mutex> lock(mSleepMutex); }
+    mWake.notify_one();
+  }
+}
+
+bool JobSystem::TryRunOne(unsigned int index, const Counter *only) {
+  std::pair<Job, Counter*> job;
+  bool found = false;
+  {
+    // Own queue, newest first: its data is most likely still in cache.
+    Queue &own = *mQueues[index];
+    std::lock_guard<std::mutex> lock(own.Mutex);
+    auto it = std::find_if(own.Jobs.rbegin(), own.Jobs.rend(), [only](const std::pair<Job, Counter*> &j) {
+      return !only || j.second == only;
+    });
+    if (it != own.Jobs.rend()) {
+      job = std::move(*it);
+      own.Jobs.erase(std::next(it).base());
+      found = true;
+    }
+  }
+  for (unsigned int i = 1; !found && i < mQueues.size(); i++) {
+    // Steal the oldest job of the others, which tends to be the largest.
+    Queue &victim = *mQueues[(index + i) % mQueues.size()];
+    std::lock_guard<std::mutex> lock(victim.Mutex);
+    auto it = std::find_if(victim.Jobs.begin(), victim.Jobs.end(), [only](const std::pair<Job, Counter*> &j) {
+      return !only || j.second == only;
+    });
+    if (it != victim.Jobs.end()) {
+      job = std::move(*it);
+      victim.Jobs.erase(it);
+      found = true;
+      mStolen.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if (!found) {
+    return false;
+  }
+  mQueued.fetch_sub(1);
+  std::exception_ptr error;
+  try {
+    job.first();
+  } catch (...) {
+    if (!job.second) {
+      std::terminate();
+    }
+    error = std::current_exception();
+  }
+  mExecuted.fetch_add(1, std::memory_order_relaxed);
+  Finish(job.second, error);
+  return true;
+}
+
+void JobSystem::Finish(Counter *counter, std::exception_ptr error) {
+  if (!counter) {
+    return;
+  }
+  std::vector<std::pair<Job, Counter*>> continuations;
+  {
+    std::lock_guard<std::mutex> lock(counter->mMutex);
+    if (error && !counter->mError) {
+      counter->mError = error;
+    }
+    if (counter->mPending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    continuations.swap(counter->mContinuations);
+  }
+  for (auto &c : continuations) {
+    Push(QueueIndex(), std::move(c.first), c.second);
+  }
+}
+
+void JobSystem::Wait(Counter &counter) {
+  unsigned int index = QueueIndex();
+  bool member = tSystem == this || std::this_thread::get_id() == mCreator;
+  while (!counter.Done()) {
+    if (!TryRunOne(index, member ? nullptr : &counter)) {
+      std::this_thread::yield();
+    }
+  }
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(counter.mMutex);
+    error.swap(counter.mError);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void JobSystem::ParallelFor(unsigned int count, unsigned int grain, const std::function<void(unsigned int)> &fn) {
+  grain = std::max(1u, grain);
+  if (count <= grain || mQueues.size() == 1) {
+    for (unsigned int i = 0; i < count; i++) {
+      fn(i);
+    }
+    return;
+  }
+  Counter counter;
+  for (unsigned int begin = 0; begin < count; begin += grain) {
+    unsigned int end = std::min(count, begin + grain);
+    Run([&fn, begin, end] {
+      for (unsigned int i = begin; i < end; i++) {
+        fn(i);
+      }
+    }, &counter);
+  }
+  Wait(counter);
+}
+
+void JobSystem::WorkerLoop(unsigned int index) {
+  tSystem = this;
+  tQueue = index;
+  for (;;) {
+    if (TryRunOne(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    mSleeping.fetch_add(1);
+    mWake.wait(lock, [this] { return mQuit || mQueued.load() > 0; });
+    mSleeping.fetch_sub(1);
+    if (mQuit) {
+      return;
+    }
+  }
+}
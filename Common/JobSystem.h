@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing job scheduler. Every thread of the system has its own deque:
+// it pushes and pops jobs at the back, and idle threads steal from the front
+// of the others'. Like WorkerPool, the thread that created the system takes
+// part (whenever it waits), so N threads spawn N-1 workers. Any other thread
+// may submit jobs too, but while it waits it only runs jobs of the counter it
+// waits on, so e.g. a render thread never picks up a long shader compile.
+// Such a thread must not wait on RunAfter() chains in a one-thread system,
+// where nobody else would run the dependencies.
+class JobSystem {
+public:
+  typedef std::function<void()> Job;
+
+  // Counts unfinished jobs. Jobs started with a counter decrement it when
+  // they finish, even by throwing; RunAfter() continuations are scheduled
+  // once it reaches zero. The first exception thrown by one of its jobs is
+  // kept and rethrown by Wait().
+  class Counter {
+  public:
+    Counter() {}
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+    bool Done() const;
+
+  private:
+    friend class JobSystem;
+    std::atomic<int> mPending{ 0 };
+    // Held by the last job while it takes the continuations, so a waiter
+    // cannot see Done() and destroy the counter while that is in progress.
+    mutable std::mutex mMutex;
+    std::vector<std::pair<Job, Counter*>> mContinuations;
+    std::exception_ptr mError;
+  };
+
+  // threadCount == 0 uses std::thread::hardware_concurrency().
+  explicit JobSystem(unsigned int threadCount = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  unsigned int ThreadCount() const { return static_cast<unsigned int>(mQueues.size()); }
+
+  // Queues job; counter, if given, stays non-zero until it has run. Like an
+  // exception leaving a std::thread, one leaving a job without a counter
+  // terminates the program.
+  void Run(Job job, Counter *counter = nullptr);
+  // Queues job once dependency is done, whether or not its jobs threw.
+  void RunAfter(Counter &dependency, Job job, Counter *counter = nullptr);
+  // Runs queued jobs on the calling thread until counter is done, then
+  // rethrows (and clears) the first exception one of its jobs threw.
+  void Wait(Counter &counter);
+
+  // Calls fn(i) for every i in [0, count) in jobs of grain indices each and
+  // returns once all calls finished, rethrowing the first exception.
+  void ParallelFor(unsigned int count, unsigned int grain, const std::function<void(unsigned int)> &fn);
+
+  struct Stats {
+    unsigned long long Executed, Stolen;
+  };
+  Stats GetStats() const { return { mExecuted.load(), mStolen.load() }; }
+
+private:
+  struct Queue {
+    std::mutex Mutex;
+    std::deque<std::pair<Job, Counter*>> Jobs;
+  };
+
+  void WorkerLoop(unsigned int index);
+  unsigned int QueueIndex() const;
+  void Push(unsigned int queue, Job job, Counter *counter);
+  // only, if given, restricts the search to that counter's jobs.
+  bool TryRunOne(unsigned int index, const Counter *only = nullptr);
+  void Finish(Counter *counter, std::exception_ptr error);
+
+  std::vector<std::unique_ptr<Queue>> mQueues;
+  std::vector<std::thread> mThreads;
+  std::thread::id mCreator;
+  std::atomic<int> mQueued{ 0 };
+  std::atomic<int> mSleeping{ 0 };
+  std::mutex mSleepMutex;
+  std::condition_variable mWake;
+  bool mQuit = false;
+  std::atomic<unsigned long long> mExecuted{ 0 }, mStolen{ 0 };
+};
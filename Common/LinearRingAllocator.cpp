@@ -0,0 +1,50 @@
+#include "LinearRingAllocator.h"
+#include <cassert>
+
+uint64_t LinearRingAllocator::Allocate(uint64_t size, uint64_t alignment) {
+  assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of two.");
+  if (size == 0 || size > mCapacity) {
+    return InvalidOffset;
+  }
+  if (mUsed == 0) {
+    // Nothing is live: restart at the beginning so the whole ring is contiguous.
+    mHead = mTail = 0;
+  }
+
+  uint64_t offset = (mHead + alignment - 1) & ~(alignment - 1);
+  if (mHead > mTail || mUsed == 0) {
+    // Free space is [head, capacity) followed by [0, tail).
+    if (offset + size > mCapacity) {
+      if (size > mTail) {
+        return InvalidOffset;
+      }
+      // Wrap; the bytes from head to the end stay with this frame until it retires.
+      offset = 0;
+    }
+  } else if (offset + size > mTail) {
+    // Free space is [head, tail), empty when head == tail.
+    return InvalidOffset;
+  }
+
+  uint64_t bytes = (offset >= mHead ? offset - mHead : mCapacity - mHead) + size;
+  mHead = offset + size;
+  mUsed += bytes;
+  mOpenFrameSize += bytes;
+  return offset;
+}
+
+void LinearRingAllocator::FinishFrame(uint64_t fence) {
+  mFrames.push_back({ fence, mHead, mOpenFrameSize });
+  mOpenFrameSize = 0;
+}
+
+void LinearRingAllocator::Retire(uint64_t completedFence) {
+  while (!mFrames.empty() && mFrames.front().Fence <= completedFence) {
+    // Empty frames may predate a restart at offset 0; they never move the tail.
+    if (mFrames.front().Size != 0) {
+      mTail = mFrames.front().End;
+    }
+    mUsed -= mFrames.front().Size;
+    mFrames.pop_front();
+  }
+}
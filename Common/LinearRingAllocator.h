@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+
+// Bump allocator over a fixed-size ring of bytes, recycled by fence value.
+// Allocations are made from the head; FinishFrame() tags everything handed out
+// since the previous call with the fence that guards it, and Retire() moves the
+// tail past every frame whose fence has completed. It only deals in offsets,
+// so it can sit on top of a mapped upload heap or plain memory alike.
+class LinearRingAllocator {
+public:
+  static const uint64_t InvalidOffset = ~0ull;
+  // D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, as in d3dUtil::CalcConstantBufferByteSize.
+  static const uint64_t ConstantBufferAlignment = 256;
+
+  explicit LinearRingAllocator(uint64_t capacity) : mCapacity(capacity) {}
+
+  // Returns the offset of size bytes aligned to alignment (a power of two), or
+  // InvalidOffset when the ring is full until older frames retire.
+  uint64_t Allocate(uint64_t size, uint64_t alignment = ConstantBufferAlignment);
+
+  // Closes the current frame; its allocations stay live until fence completes.
+  void FinishFrame(uint64_t fence);
+  // Releases the frames whose fence is <= completedFence.
+  void Retire(uint64_t completedFence);
+
+  // Fence of the oldest frame still holding memory, or 0 if none.
+  uint64_t OldestFence() const { return mFrames.empty() ? 0 : mFrames.front().Fence; }
+  uint64_t Capacity() const { return mCapacity; }
+  // Bytes owned by live frames and the open frame, including alignment and wrap padding.
+  uint64_t Used() const { return mUsed; }
+
+private:
+  struct Frame {
+    uint64_t Fence;
+    uint64_t End;   // head when the frame was closed: the tail once it retires
+    uint64_t Size;  // bytes the frame holds, padding included
+  };
+
+  uint64_t mCapacity;
+  uint64_t mHead = 0;
+  uint64_t mTail = 0;
+  uint64_t mUsed = 0;
+  uint64_t mOpenFrameSize = 0;
+  std::deque<Frame> mFrames;
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue for any number of producer threads and one consumer
+// thread. Every slot carries a sequence number telling whose turn it is:
+// producers claim a slot by advancing the tail with a compare-exchange, fill
+// it and publish it by bumping its sequence, so a slow producer delays only
+// the consumer reaching its slot, never the other producers.
+template<typename T>
+class MpscQueue {
+public:
+  // Holds capacity items, rounded up to a power of two.
+  explicit MpscQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mCells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++) {
+      mCells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+    mMask = size - 1;
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  size_t Capacity() const { return mMask + 1; }
+
+  // Any thread. False if the queue is full.
+  bool TryPush(T value) {
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = mCells[tail & mMask];
+      size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+      intptr_t turn = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(tail);
+      if (turn == 0) {
+        // The slot is free; claim it unless another producer just did.
+        if (mTail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+          cell.Value = std::move(value);
+          cell.Sequence.store(tail + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (turn < 0) {
+        // The consumer has not emptied the slot one lap ago.
+        return false;
+      } else {
+        tail = mTail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Consumer only. False if the queue is empty or the next item is still
+  // being written.
+  bool TryPop(T &value) {
+    Cell &cell = mCells[mHead & mMask];
+    if (cell.Sequence.load(std::memory_order_acquire) != mHead + 1) {
+      return false;
+    }
+    value = std::move(cell.Value);
+    // Free the slot for the producer one lap ahead.
+    cell.Sequence.store(mHead + mMask + 1, std::memory_order_release);
+    mHead++;
+    return true;
+  }
+
+  // Consumer only.
+  bool Empty() const { return mCells[mHead & mMask].Sequence.load(std::memory_order_acquire) != mHead + 1; }
+
+private:
+  static const size_t CacheLine = 64;
+
+  struct Cell {
+    std::atomic<size_t> Sequence;
+    T Value;
+  };
+
+  std::unique_ptr<Cell[]> mCells;
+  size_t mMask;
+  char mPad0[CacheLine];
+  std::atomic<size_t> mTail{ 0 };
+  char mPad1[CacheLine];
+  // Only the consumer touches the head, so it needs no atomics.
+  size_t mHead = 0;
+  char mPad2[CacheLine];
+};
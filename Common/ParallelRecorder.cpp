@@ -0,0 +1,29 @@
+#include "ParallelRecorder.h"
+#include <algorithm>
+
+std::vector<ParallelRecorder::Chunk> ParallelRecorder::Split(unsigned int drawCount, unsigned int maxChunks,
+                                                             unsigned int minDrawsPerChunk) {
+  std::vector<Chunk> chunks;
+  if (drawCount == 0 || maxChunks == 0) {
+    return chunks;
+  }
+  unsigned int byMinimum = std::max(1u, drawCount / std::max(1u, minDrawsPerChunk));
+  unsigned int count = std::min(maxChunks, byMinimum);
+  unsigned int base = drawCount / count, extra = drawCount % count;
+  unsigned int first = 0;
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned int size = base + (i < extra ? 1 : 0);
+    chunks.push_back({ first, size });
+    first += size;
+  }
+  return chunks;
+}
+
+const std::vector<ParallelRecorder::Chunk> &ParallelRecorder::Record(unsigned int drawCount, unsigned int maxChunks,
+    const std::function<void(unsigned int, const Chunk&)> &record) {
+  mChunks = Split(drawCount, maxChunks, mMinDrawsPerChunk);
+  mJobs.ParallelFor(static_cast<unsigned int>(mChunks.size()), 1, [&](unsigned int i) {
+    record(i, mChunks[i]);
+  });
+  return mChunks;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "JobSystem.h"
+#include <functional>
+#include <vector>
+
+// Splits a draw list into contiguous chunks and records them concurrently on
+// a JobSystem, one command list (or recorder) per chunk. Chunk i covers the
+// draws right before chunk i + 1, so submitting the chunks in index order
+// reproduces the serial draw order.
+class ParallelRecorder {
+public:
+  struct Chunk {
+    unsigned int First, Count;
+  };
+
+  // Chunks hold at least minDrawsPerChunk draws (except when there are fewer
+  // draws in total), since each costs a command list reset and pass setup.
+  ParallelRecorder(JobSystem &jobs, unsigned int minDrawsPerChunk) : mJobs(jobs), mMinDrawsPerChunk(minDrawsPerChunk) {}
+
+  // Splits drawCount draws into at most maxChunks near-equal chunks.
+  static std::vector<Chunk> Split(unsigned int drawCount, unsigned int maxChunks, unsigned int minDrawsPerChunk);
+
+  // Calls record(chunkIndex, chunk) for every chunk, concurrently, and
+  // returns the chunks once all are recorded.
+  const std::vector<Chunk> &Record(unsigned int drawCount, unsigned int maxChunks,
+                                   const std::function<void(unsigned int, const Chunk&)> &record);
+
+private:
+  JobSystem &mJobs;
+  unsigned int mMinDrawsPerChunk;
+  std::vector<Chunk> mChunks;
+};
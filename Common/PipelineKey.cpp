@@ -0,0 +1,155 @@
+#include "PipelineKey.h"
+#include "Hash.h"
+#include <cctype>
+#include <cstring>
+
+namespace {
+  // Bytes per element of the DXGI formats vertex data commonly uses, or 0.
+  uint32_t FormatSize(uint32_t format) {
+    if (format >= 1 && format <= 4) return 16;   // R32G32B32A32
+    if (format >= 5 && format <= 8) return 12;   // R32G32B32
+    if (format >= 9 && format <= 18) return 8;   // R16G16B16A16, R32G32
+    if (format >= 23 && format <= 43) return 4;  // R10G10B10A2 to R32
+    if (format == 87 || format == 88) return 4;  // B8G8R8A8, B8G8R8X8
+    if (format >= 48 && format <= 59) return 2;  // R8G8, R16
+    if (format >= 60 && format <= 64) return 1;  // R8
+    return 0;
+  }
+
+  class Writer {
+  public:
+    explicit Writer(std::vector<uint32_t> &words) : mWords(words) {}
+
+    void operator()(uint32_t value) { mWords.push_back(value); }
+    void operator()(int32_t value) { mWords.push_back(static_cast<uint32_t>(value)); }
+    void operator()(uint64_t value) {
+      mWords.push_back(static_cast<uint32_t>(value));
+      mWords.push_back(static_cast<uint32_t>(value >> 32));
+    }
+    void operator()(float value) {
+      // -0 and +0 behave the same.
+      uint32_t bits = 0;
+      if (value != 0.0f) {
+        memcpy(&bits, &value, sizeof(bits));
+      }
+      mWords.push_back(bits);
+    }
+    // Semantics match regardless of case.
+    void Semantic(const std::string &name) {
+      mWords.push_back(static_cast<uint32_t>(name.size()));
+      uint32_t word = 0;
+      for (size_t i = 0; i < name.size(); i++) {
+        word |= static_cast<uint32_t>(toupper(static_cast<unsigned char>(name[i]))) << (8 * (i % 4));
+        if (i % 4 == 3 || i + 1 == name.size()) {
+          mWords.push_back(word);
+          word = 0;
+        }
+      }
+    }
+
+  private:
+    std::vector<uint32_t> &mWords;
+  };
+}
+
+PipelineKey::PipelineKey(const PipelineDesc &desc) {
+  mWords.reserve(256);
+  Writer put(mWords);
+
+  put(desc.RootSignature);
+  for (uint64_t shader : desc.Shaders) {
+    put(shader);
+  }
+
+  put(static_cast<uint32_t>(desc.InputLayout.size()));
+  // Where the next append-aligned element of each slot goes, or
+  // AppendAligned once an element of unknown size makes that unknowable.
+  uint32_t slotEnd[16] = {};
+  for (const PipelineDesc::InputElement &e : desc.InputLayout) {
+    uint32_t offset = e.AlignedByteOffset;
+    uint32_t *end = e.InputSlot < 16 ? &slotEnd[e.InputSlot] : nullptr;
+    if (end) {
+      if (offset == PipelineDesc::AppendAligned) {
+        offset = *end;
+      }
+      uint32_t size = FormatSize(e.Format);
+      *end = offset == PipelineDesc::AppendAligned || size == 0 ? PipelineDesc::AppendAligned : offset + size;
+    }
+    put.Semantic(e.SemanticName);
+    put(e.SemanticIndex);
+    put(e.Format);
+    put(e.InputSlot);
+    put(offset);
+    put(e.InputSlotClass);
+    // Per-vertex data (class 0) has no step rate.
+    put(e.InputSlotClass == 0 ? 0u : e.InstanceDataStepRate);
+  }
+
+  put(desc.FillMode);
+  put(desc.CullMode);
+  put(desc.FrontCounterClockwise);
+  put(desc.DepthBias);
+  put(desc.DepthBiasClamp);
+  put(desc.SlopeScaledDepthBias);
+  put(desc.DepthClipEnable);
+  put(desc.MultisampleEnable);
+  put(desc.AntialiasedLineEnable);
+  put(desc.ForcedSampleCount);
+  put(desc.ConservativeRaster);
+
+  uint32_t targets = desc.NumRenderTargets < PipelineDesc::MaxRenderTargets ? desc.NumRenderTargets : PipelineDesc::MaxRenderTargets;
+  // Without independent blending every target uses the first one's state.
+  uint32_t blendTargets = desc.IndependentBlendEnable ? targets : (targets > 0 ? 1 : 0);
+  put(desc.AlphaToCoverageEnable);
+  put(blendTargets > 1 ? 1u : 0u);
+  for (uint32_t i = 0; i < blendTargets; i++) {
+    const PipelineDesc::RenderTargetBlend &b = desc.Blend[i];
+    put(b.BlendEnable);
+    put(b.LogicOpEnable);
+    if (b.BlendEnable) {
+      put(b.SrcBlend);
+      put(b.DestBlend);
+      put(b.BlendOp);
+      put(b.SrcBlendAlpha);
+      put(b.DestBlendAlpha);
+      put(b.BlendOpAlpha);
+    }
+    if (b.LogicOpEnable) {
+      put(b.LogicOp);
+    }
+    put(b.RenderTargetWriteMask);
+  }
+  uint32_t samples = desc.SampleCount;
+  put(samples < 32 ? desc.SampleMask & ((1u << samples) - 1) : desc.SampleMask);
+
+  put(desc.DepthEnable);
+  if (desc.DepthEnable) {
+    put(desc.DepthWriteMask);
+    put(desc.DepthFunc);
+  }
+  put(desc.StencilEnable);
+  if (desc.StencilEnable) {
+    put(desc.StencilReadMask);
+    put(desc.StencilWriteMask);
+    for (const PipelineDesc::StencilOps *ops : { &desc.FrontFace, &desc.BackFace }) {
+      put(ops->FailOp);
+      put(ops->DepthFailOp);
+      put(ops->PassOp);
+      put(ops->Func);
+    }
+  }
+
+  put(desc.IBStripCutValue);
+  put(desc.PrimitiveTopologyType);
+  put(targets);
+  for (uint32_t i = 0; i < targets; i++) {
+    put(desc.RTVFormats[i]);
+  }
+  put(desc.DSVFormat);
+  put(desc.SampleCount);
+  put(desc.SampleQuality);
+  put(desc.NodeMask);
+  put(desc.Flags);
+
+  mHash = Fnv1a::Hash(mWords.data(), mWords.size() * sizeof(uint32_t));
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The parts of a graphics pipeline that decide the compiled PSO, without API
+// types. Enums and formats hold their D3D12/DXGI values. Shaders and the root
+// signature appear as hashes of their bytecode and serialized blob, which
+// unlike pointers are the same from run to run.
+struct PipelineDesc {
+  static const uint32_t AppendAligned = 0xffffffff; // D3D12_APPEND_ALIGNED_ELEMENT
+  static const int MaxRenderTargets = 8;
+  enum Stage { VS, PS, DS, HS, GS, StageCount };
+
+  struct InputElement {
+    std::string SemanticName;
+    uint32_t SemanticIndex, Format, InputSlot, AlignedByteOffset, InputSlotClass, InstanceDataStepRate;
+  };
+  struct RenderTargetBlend {
+    uint32_t BlendEnable, LogicOpEnable;
+    uint32_t SrcBlend, DestBlend, BlendOp, SrcBlendAlpha, DestBlendAlpha, BlendOpAlpha;
+    uint32_t LogicOp, RenderTargetWriteMask;
+  };
+  struct StencilOps {
+    uint32_t FailOp, DepthFailOp, PassOp, Func;
+  };
+
+  uint64_t RootSignature = 0;
+  // 0 for an unused stage.
+  uint64_t Shaders[StageCount] = {};
+  std::vector<InputElement> InputLayout;
+
+  uint32_t FillMode = 0, CullMode = 0, FrontCounterClockwise = 0;
+  int32_t DepthBias = 0;
+  float DepthBiasClamp = 0.0f, SlopeScaledDepthBias = 0.0f;
+  uint32_t DepthClipEnable = 0, MultisampleEnable = 0, AntialiasedLineEnable = 0;
+  uint32_t ForcedSampleCount = 0, ConservativeRaster = 0;
+
+  uint32_t AlphaToCoverageEnable = 0, IndependentBlendEnable = 0;
+  RenderTargetBlend Blend[MaxRenderTargets] = {};
+  uint32_t SampleMask = 0;
+
+  uint32_t DepthEnable = 0, DepthWriteMask = 0, DepthFunc = 0;
+  uint32_t StencilEnable = 0, StencilReadMask = 0, StencilWriteMask = 0;
+  StencilOps FrontFace = {}, BackFace = {};
+
+  uint32_t IBStripCutValue = 0, PrimitiveTopologyType = 0;
+  uint32_t NumRenderTargets = 0;
+  uint32_t RTVFormats[MaxRenderTargets] = {};
+  uint32_t DSVFormat = 0;
+  uint32_t SampleCount = 1, SampleQuality = 0;
+  uint32_t NodeMask = 0, Flags = 0;
+};
+
+// A canonical form of a PipelineDesc: descs that create the same pipeline
+// give equal keys even when written differently. Fields the pipeline ignores
+// are cleared (formats and blend of unbound render targets, per-target blend
+// without IndependentBlendEnable, blend factors with blending off, depth and
+// stencil ops with the tests off, sample mask bits above the sample count,
+// step rates of per-vertex elements). Semantic names are compared without
+// case and append-aligned offsets are resolved for the common vertex formats.
+class PipelineKey {
+public:
+  struct Hasher {
+    size_t operator()(const PipelineKey &key) const { return static_cast<size_t>(key.mHash); }
+  };
+
+  PipelineKey() {}
+  explicit PipelineKey(const PipelineDesc &desc);
+
+  uint64_t Hash() const { return mHash; }
+  // The canonical fields, for storing next to cached pipelines so a hash
+  // collision can be told apart.
+  const std::vector<uint32_t> &Words() const { return mWords; }
+
+  bool operator==(const PipelineKey &rhs) const { return mHash == rhs.mHash && mWords == rhs.mWords; }
+  bool operator!=(const PipelineKey &rhs) const { return !(*this == rhs); }
+
+private:
+  std::vector<uint32_t> mWords;
+  uint64_t mHash = 0;
+};
@@ -0,0 +1,41 @@
+#include "RadixSort.h"
+#include <utility>
+
+void RadixSorter::Sort(std::vector<Item> &items) {
+  const size_t count = items.size();
+  mLastPassCount = 0;
+  if (count < 2) {
+    return;
+  }
+  size_t histograms[8][256] = {};
+  for (const Item &item : items) {
+    for (int pass = 0; pass < 8; pass++) {
+      histograms[pass][(item.Key >> (8 * pass)) & 0xff]++;
+    }
+  }
+
+  mScratch.resize(count);
+  Item *src = items.data(), *dst = mScratch.data();
+  for (int pass = 0; pass < 8; pass++) {
+    size_t *histogram = histograms[pass];
+    int shift = 8 * pass;
+    if (histogram[(src[0].Key >> shift) & 0xff] == count) {
+      // Every key has the same byte here; the order would not change.
+      continue;
+    }
+    size_t offset = 0;
+    for (int digit = 0; digit < 256; digit++) {
+      size_t n = histogram[digit];
+      histogram[digit] = offset;
+      offset += n;
+    }
+    for (size_t i = 0; i < count; i++) {
+      dst[histogram[(src[i].Key >> shift) & 0xff]++] = src[i];
+    }
+    std::swap(src, dst);
+    mLastPassCount++;
+  }
+  if (src != items.data()) {
+    items.swap(mScratch);
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stable LSD radix sort of (64-bit key, 32-bit value) pairs, one byte per
+// pass. All eight byte histograms are built in a single read of the input,
+// and passes whose byte is the same for every key are skipped, which is
+// common for draw keys whose upper fields take few values.
+class RadixSorter {
+public:
+  struct Item {
+    uint64_t Key;
+    uint32_t Value;
+  };
+
+  // Sorts items by Key, keeping the order of equal keys. The scratch buffer is
+  // kept between calls.
+  void Sort(std::vector<Item> &items);
+
+  // Passes run by the last Sort(), at most 8.
+  int LastPassCount() const { return mLastPassCount; }
+
+private:
+  std::vector<Item> mScratch;
+  int mLastPassCount = 0;
+};
@@ -0,0 +1,120 @@
+#include "RangeAllocator.h"
+#include <algorithm>
+#include <cassert>
+
+RangeAllocator::RangeAllocator(uint64_t capacity) : mCapacity(capacity), mFreeSize(0) {
+  if (capacity > 0) {
+    InsertFree(0, capacity);
+  }
+}
+
+RangeAllocator::Handle RangeAllocator::Allocate(uint64_t size) {
+  if (size == 0) {
+    return InvalidHandle;
+  }
+  // Best fit keeps large ranges intact for large requests.
+  auto fit = mFreeBySize.lower_bound(size);
+  if (fit == mFreeBySize.end()) {
+    return InvalidHandle;
+  }
+  uint64_t offset = fit->second;
+  uint64_t rangeSize = fit->first;
+  EraseFree(mFreeByOffset.find(offset));
+  if (rangeSize > size) {
+    InsertFree(offset + size, rangeSize - size);
+  }
+
+  Handle handle;
+  if (!mFreeHandles.empty()) {
+    handle = mFreeHandles.back();
+    mFreeHandles.pop_back();
+  } else {
+    handle = static_cast<Handle>(mAllocations.size());
+    mAllocations.emplace_back();
+  }
+  mAllocations[handle] = { offset, size, true };
+  mLiveCount++;
+  return handle;
+}
+
+void RangeAllocator::Free(Handle handle) {
+  assert(handle < mAllocations.size() && mAllocations[handle].Live && "Freeing an invalid handle.");
+  Allocation &a = mAllocations[handle];
+  uint64_t offset = a.Offset, size = a.Size;
+  a.Live = false;
+  mFreeHandles.push_back(handle);
+  mLiveCount--;
+
+  // Merge with the free ranges directly after and before.
+  auto next = mFreeByOffset.lower_bound(offset);
+  if (next != mFreeByOffset.end() && next->first == offset + size) {
+    size += next->second;
+    auto after = std::next(next);
+    EraseFree(next);
+    next = after;
+  }
+  if (next != mFreeByOffset.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      EraseFree(prev);
+    }
+  }
+  InsertFree(offset, size);
+}
+
+std::vector<RangeAllocator::Move> RangeAllocator::Defragment() {
+  std::vector<Handle> live;
+  live.reserve(mLiveCount);
+  for (Handle h = 0; h < mAllocations.size(); h++) {
+    if (mAllocations[h].Live) {
+      live.push_back(h);
+    }
+  }
+  std::sort(live.begin(), live.end(), [this](Handle a, Handle b) {
+    return mAllocations[a].Offset < mAllocations[b].Offset;
+  });
+
+  std::vector<Move> moves;
+  uint64_t cursor = 0;
+  for (Handle h : live) {
+    Allocation &a = mAllocations[h];
+    if (a.Offset != cursor) {
+      if (!moves.empty() && moves.back().From + moves.back().Size == a.Offset &&
+          moves.back().To + moves.back().Size == cursor) {
+        moves.back().Size += a.Size;
+      } else {
+        moves.push_back({ h, a.Offset, cursor, a.Size });
+      }
+      a.Offset = cursor;
+    }
+    cursor += a.Size;
+  }
+
+  mFreeByOffset.clear();
+  mFreeBySize.clear();
+  mFreeSize = 0;
+  if (cursor < mCapacity) {
+    InsertFree(cursor, mCapacity - cursor);
+  }
+  return moves;
+}
+
+void RangeAllocator::InsertFree(uint64_t offset, uint64_t size) {
+  mFreeByOffset.emplace(offset, size);
+  mFreeBySize.emplace(size, offset);
+  mFreeSize += size;
+}
+
+void RangeAllocator::EraseFree(std::map<uint64_t, uint64_t>::iterator it) {
+  auto range = mFreeBySize.equal_range(it->second);
+  for (auto s = range.first; s != range.second; ++s) {
+    if (s->second == it->first) {
+      mFreeBySize.erase(s);
+      break;
+    }
+  }
+  mFreeSize -= it->second;
+  mFreeByOffset.erase(it);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Best-fit free-list allocator of [offset, offset + size) ranges inside a
+// fixed capacity. Units are up to the caller (bytes, vertices, indices).
+// Freed ranges are coalesced with their neighbours; Defragment() compacts all
+// live ranges to the front and reports the moves so the caller can relocate
+// the data. Allocations are referred to by handles that survive compaction.
+class RangeAllocator {
+public:
+  typedef uint32_t Handle;
+  static const Handle InvalidHandle = ~0u;
+
+  struct Move {
+    Handle Allocation;
+    uint64_t From, To, Size;
+  };
+
+  explicit RangeAllocator(uint64_t capacity);
+
+  // Returns InvalidHandle when no single free range can hold size units,
+  // even though FreeSize() may be larger (see Defragment()).
+  Handle Allocate(uint64_t size);
+  void Free(Handle handle);
+
+  uint64_t Offset(Handle handle) const { return mAllocations[handle].Offset; }
+  uint64_t Size(Handle handle) const { return mAllocations[handle].Size; }
+
+  // Slides every live range down to close the gaps, in increasing offset
+  // order, so each move's destination never overlaps a range moved later.
+  // Adjacent ranges that move by the same distance are reported as one move
+  // (its Allocation is the first of them). Returns the moves performed.
+  std::vector<Move> Defragment();
+
+  uint64_t Capacity() const { return mCapacity; }
+  uint64_t FreeSize() const { return mFreeSize; }
+  uint64_t LargestFree() const { return mFreeBySize.empty() ? 0 : mFreeBySize.rbegin()->first; }
+  size_t FreeRangeCount() const { return mFreeByOffset.size(); }
+  size_t AllocationCount() const { return mLiveCount; }
+  // 0 when all free space is one range, approaching 1 as it splinters.
+  double Fragmentation() const { return mFreeSize == 0 ? 0.0 : 1.0 - static_cast<double>(LargestFree()) / mFreeSize; }
+
+private:
+  struct Allocation {
+    uint64_t Offset, Size;
+    bool Live;
+  };
+
+  void InsertFree(uint64_t offset, uint64_t size);
+  void EraseFree(std::map<uint64_t, uint64_t>::iterator it);
+
+  uint64_t mCapacity;
+  uint64_t mFreeSize;
+  size_t mLiveCount = 0;
+  std::map<uint64_t, uint64_t> mFreeByOffset;      // offset -> size
+  std::multimap<uint64_t, uint64_t> mFreeBySize;   // size -> offset
+  std::vector<Allocation> mAllocations;
+  std::vector<Handle> mFreeHandles;
+};
@@ -0,0 +1,92 @@
+#include "ShaderCache.h"
+#include "Hash.h"
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+
+namespace {
+  bool ReadFile(const std::string &path, std::string &contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      return false;
+    }
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+  }
+
+  std::string Directory(const std::string &path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+  }
+
+  // The file named by an #include line, or an empty string.
+  std::string IncludeTarget(const std::string &line) {
+    size_t i = line.find_first_not_of(" \t");
+    if (i == std::string::npos || line[i] != '#') {
+      return std::string();
+    }
+    i = line.find_first_not_of(" \t", i + 1);
+    if (i == std::string::npos || line.compare(i, 7, "include") != 0) {
+      return std::string();
+    }
+    i = line.find_first_not_of(" \t", i + 7);
+    if (i == std::string::npos || (line[i] != '"' && line[i] != '<')) {
+      return std::string();
+    }
+    size_t end = line.find(line[i] == '"' ? '"' : '>', i + 1);
+    return end == std::string::npos ? std::string() : line.substr(i + 1, end - i - 1);
+  }
+
+  // Hashes path and, depth first, every file it includes. Each file counts
+  // once, which also stops include cycles.
+  uint64_t HashSource(const std::string &path, uint64_t hash, std::set<std::string> &visited) {
+    if (!visited.insert(path).second) {
+      return hash;
+    }
+    std::string contents;
+    if (!ReadFile(path, contents)) {
+      // The compiler will report it; hash the name so the key is still stable.
+      return Fnv1a::Hash("missing " + path, hash);
+    }
+    hash = Fnv1a::Hash(contents, hash);
+    std::istringstream lines(contents);
+    std::string line;
+    while (std::getline(lines, line)) {
+      std::string include = IncludeTarget(line);
+      if (!include.empty()) {
+        hash = HashSource(Directory(path) + include, hash, visited);
+      }
+    }
+    return hash;
+  }
+}
+
+std::vector<uint8_t> ShaderCache::Load(const ShaderDesc &desc) {
+  uint64_t key = Key(desc);
+  std::vector<uint8_t> bytecode;
+  if (mStore.Read(key, bytecode)) {
+    mHits++;
+    return bytecode;
+  }
+  mMisses++;
+  bytecode = mCompiler.Compile(desc);
+  mStore.Write(key, bytecode.data(), bytecode.size());
+  return bytecode;
+}
+
+uint64_t ShaderCache::Key(const ShaderDesc &desc) const {
+  uint64_t hash = Fnv1a::Hash(mCompiler.Version());
+  hash = Fnv1a::Hash(desc.EntryPoint, hash);
+  hash = Fnv1a::Hash(desc.Target, hash);
+  hash = Fnv1a::Hash(&desc.Flags, sizeof(desc.Flags), hash);
+  // Define order matters to the preprocessor, so it is hashed as given.
+  uint64_t defineCount = desc.Defines.size();
+  hash = Fnv1a::Hash(&defineCount, sizeof(defineCount), hash);
+  for (const ShaderDefine &define : desc.Defines) {
+    hash = Fnv1a::Hash(define.Name, hash);
+    hash = Fnv1a::Hash(define.Value, hash);
+  }
+  std::set<std::string> visited;
+  return HashSource(desc.Path, hash, visited);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "BlobStore.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ShaderDefine {
+  std::string Name, Value;
+};
+
+// One compilation: a source file, its entry point and target profile, the
+// macros it is compiled with and compiler-specific flags.
+struct ShaderDesc {
+  std::string Path;
+  std::string EntryPoint;
+  std::string Target;
+  std::vector<ShaderDefine> Defines;
+  uint32_t Flags = 0;
+};
+
+// Turns a ShaderDesc into bytecode, throwing if it does not compile. Must be
+// safe to call from several threads at once.
+class ShaderCompiler {
+public:
+  virtual ~ShaderCompiler() {}
+  // Identifies the compiler build; bytecode from another version is not reused.
+  virtual std::string Version() const = 0;
+  virtual std::vector<uint8_t> Compile(const ShaderDesc &desc) = 0;
+};
+
+// Keeps compiled bytecode in a directory, one file per key. The key hashes
+// the source and every file it includes, the entry point, target, defines,
+// flags and compiler version, so editing any of them compiles again and
+// anything else loads from disk. Includes are found by scanning #include
+// lines relative to the including file, as the standard D3D include handler
+// resolves them; conditional includes are hashed whether taken or not.
+class ShaderCache {
+public:
+  struct Stats {
+    uint64_t Hits, Misses;
+  };
+
+  // The directory must exist.
+  ShaderCache(ShaderCompiler &compiler, const std::string &directory) : mCompiler(compiler), mStore(directory, ".sbc") {}
+
+  // Cached bytecode for desc, compiling and storing it on a miss. Safe to call
+  // from several threads.
+  std::vector<uint8_t> Load(const ShaderDesc &desc);
+
+  uint64_t Key(const ShaderDesc &desc) const;
+  std::string PathFor(uint64_t key) const { return mStore.PathFor(key); }
+
+  Stats GetStats() const { return { mHits.load(), mMisses.load() }; }
+
+private:
+  ShaderCompiler &mCompiler;
+  BlobStore mStore;
+  std::atomic<uint64_t> mHits{ 0 }, mMisses{ 0 };
+};
@@ -0,0 +1,123 @@
+#include "ShaderPermutations.h"
+#include <cassert>
+#include <chrono>
+#include <exception>
+
+ShaderPermutations::ShaderPermutations(ShaderCache &cache, JobSystem &jobs, const ShaderDesc &base,
+                                       const std::vector<std::string> &features) :
+  mCache(cache), mJobs(jobs), mBase(base), mFeatures(features) {
+  assert(features.size() <= MaxFeatures);
+}
+
+ShaderPermutations::~ShaderPermutations() {
+  // Waiting runs other jobs, which must not find the mutex held.
+  std::vector<JobSystem::Counter*> loading;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto &variant : mVariants) {
+      loading.push_back(variant.second.Loaded.get());
+    }
+  }
+  for (JobSystem::Counter *counter : loading) {
+    mJobs.Wait(*counter);
+  }
+  // Load jobs keep their errors in the futures, but an onLoaded callback may
+  // throw, and a destructor has nowhere to report it.
+  try {
+    mJobs.Wait(mCallbacks);
+  } catch (...) {
+  }
+}
+
+ShaderPermutations::Mask ShaderPermutations::Feature(const std::string &name) const {
+  for (size_t i = 0; i < mFeatures.size(); i++) {
+    if (mFeatures[i] == name) {
+      return 1u << i;
+    }
+  }
+  assert(false && "unknown shader feature");
+  return 0;
+}
+
+ShaderDesc ShaderPermutations::Desc(Mask mask) const {
+  ShaderDesc desc = mBase;
+  for (size_t i = 0; i < mFeatures.size(); i++) {
+    if (mask & (1u << i)) {
+      desc.Defines.push_back({ mFeatures[i], "1" });
+    }
+  }
+  return desc;
+}
+
+ShaderPermutations::Future ShaderPermutations::Request(Mask mask) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return Start(mask).Bytecode;
+}
+
+ShaderPermutations::Future ShaderPermutations::Request(Mask mask, JobSystem::Job onLoaded) {
+  Future future;
+  JobSystem::Counter *loaded;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Variant &variant = Start(mask);
+    future = variant.Bytecode;
+    loaded = variant.Loaded.get();
+  }
+  mJobs.RunAfter(*loaded, std::move(onLoaded), &mCallbacks);
+  return future;
+}
+
+void ShaderPermutations::RequestAll() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (Mask mask = 0; mask < VariantCount(); mask++) {
+    Start(mask);
+  }
+}
+
+ShaderPermutations::Variant &ShaderPermutations::Start(Mask mask) {
+  assert(mask < VariantCount());
+  mRequests++;
+  auto found = mVariants.find(mask);
+  if (found != mVariants.end()) {
+    return found->second;
+  }
+  // std::function needs a copyable job, so the promise is shared.
+  auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+  Variant &variant = mVariants[mask];
+  variant.Bytecode = promise->get_future().share();
+  variant.Loaded = std::make_unique<JobSystem::Counter>();
+  ShaderDesc desc = Desc(mask);
+  mJobs.Run([this, promise, desc] {
+    try {
+      promise->set_value(mCache.Load(desc));
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+    mFinished++;
+  }, variant.Loaded.get());
+  return variant;
+}
+
+bool ShaderPermutations::Ready(Mask mask) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto found = mVariants.find(mask);
+  return found != mVariants.end() &&
+    found->second.Bytecode.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+const std::vector<uint8_t> &ShaderPermutations::Get(Mask mask) {
+  Variant *variant;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    variant = &Start(mask);
+  }
+  // Variants are never erased and unordered_map nodes do not move, so the
+  // reference outlives the lock.
+  mJobs.Wait(*variant->Loaded);
+  return variant->Bytecode.get();
+}
+
+ShaderPermutations::Stats ShaderPermutations::GetStats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return { mRequests, mVariants.size(), mFinished.load() };
+}
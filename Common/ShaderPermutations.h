@@ -0,0 +1,79 @@
+#pragma once
+#include "JobSystem.h"
+#include "ShaderCache.h"
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The variants of one shader entry point that a set of on/off feature
+// defines produces. A variant is named by a mask whose bit i defines
+// Features[i] as 1. Variants are loaded through a ShaderCache by jobs on a
+// JobSystem, so the caller can keep rendering with a fallback and pick up a
+// variant once its future is ready. Each variant is loaded once however
+// often it is requested.
+class ShaderPermutations {
+public:
+  typedef uint32_t Mask;
+  typedef std::shared_future<std::vector<uint8_t>> Future;
+  static const unsigned int MaxFeatures = 16;
+
+  struct Stats {
+    uint64_t Requests, Started, Finished;
+  };
+
+  // base gives the path, entry point, target, flags and any defines every
+  // variant shares.
+  ShaderPermutations(ShaderCache &cache, JobSystem &jobs, const ShaderDesc &base,
+                     const std::vector<std::string> &features);
+  // Waits for variants still loading, since their jobs refer to this.
+  ~ShaderPermutations();
+
+  ShaderPermutations(const ShaderPermutations&) = delete;
+  ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+  // The bit of a feature name, which must be one of the features.
+  Mask Feature(const std::string &name) const;
+  unsigned int VariantCount() const { return 1u << mFeatures.size(); }
+  ShaderDesc Desc(Mask mask) const;
+
+  // Starts loading a variant unless it already was.
+  Future Request(Mask mask);
+  // Also runs onLoaded as a job once the variant has loaded or failed.
+  Future Request(Mask mask, JobSystem::Job onLoaded);
+  // Requests every variant.
+  void RequestAll();
+  // Whether the variant was requested and has finished, successfully or not.
+  bool Ready(Mask mask) const;
+  // The variant's bytecode, requesting it if needed and running queued jobs
+  // on the calling thread until it is loaded. Rethrows a compile error.
+  const std::vector<uint8_t> &Get(Mask mask);
+
+  Stats GetStats() const;
+
+private:
+  struct Variant {
+    Future Bytecode;
+    // Done once the variant's job has run; lets Get() help the job system
+    // instead of blocking on the future.
+    std::unique_ptr<JobSystem::Counter> Loaded;
+  };
+
+  Variant &Start(Mask mask);
+
+  ShaderCache &mCache;
+  JobSystem &mJobs;
+  ShaderDesc mBase;
+  std::vector<std::string> mFeatures;
+
+  mutable std::mutex mMutex;
+  std::unordered_map<Mask, Variant> mVariants;
+  // Outstanding onLoaded jobs.
+  JobSystem::Counter mCallbacks;
+  uint64_t mRequests = 0;
+  std::atomic<uint64_t> mFinished{ 0 };
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Each side keeps a stale copy of the other's index and only reloads
+// it when the queue looks full or empty, so in steady state a push or pop
+// touches no cache line the other thread writes.
+template<typename T>
+class SpscQueue {
+public:
+  // Holds capacity items, rounded up to a power of two.
+  explicit SpscQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mSlots.resize(size);
+    mMask = size - 1;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  size_t Capacity() const { return mSlots.size(); }
+
+  // Producer only. False if the queue is full.
+  bool TryPush(T value) {
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    if (tail - mCachedHead == mSlots.size()) {
+      mCachedHead = mHead.load(std::memory_order_acquire);
+      if (tail - mCachedHead == mSlots.size()) {
+        return false;
+      }
+    }
+    mSlots[tail & mMask] = std::move(value);
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. False if the queue is empty.
+  bool TryPop(T &value) {
+    size_t head = mHead.load(std::memory_order_relaxed);
+    if (head == mCachedTail) {
+      mCachedTail = mTail.load(std::memory_order_acquire);
+      if (head == mCachedTail) {
+        return false;
+      }
+    }
+    value = std::move(mSlots[head & mMask]);
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only.
+  bool Empty() const { return mHead.load(std::memory_order_relaxed) == mTail.load(std::memory_order_acquire); }
+
+private:
+  static const size_t CacheLine = 64;
+
+  std::vector<T> mSlots;
+  size_t mMask;
+  char mPad0[CacheLine];
+  // Written by the consumer.
+  std::atomic<size_t> mHead{ 0 };
+  size_t mCachedTail = 0;
+  char mPad1[CacheLine];
+  // Written by the producer.
+  std::atomic<size_t> mTail{ 0 };
+  size_t mCachedHead = 0;
+  char mPad2[CacheLine];
+};
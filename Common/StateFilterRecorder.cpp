@@ -0,0 +1,129 @@
+#include "StateFilterRecorder.h"
+#include <cstring>
+
+namespace {
+  // Bitwise; every tracked type is plain data without padding.
+  template<typename T>
+  bool Same(const T &a, const T &b) { return memcmp(&a, &b, sizeof(T)) == 0; }
+}
+
+uint64_t StateFilterRecorder::Stats::TotalIssued() const {
+  uint64_t total = 0;
+  for (uint64_t n : Issued) {
+    total += n;
+  }
+  return total;
+}
+
+uint64_t StateFilterRecorder::Stats::TotalFiltered() const {
+  uint64_t total = 0;
+  for (uint64_t n : Filtered) {
+    total += n;
+  }
+  return total;
+}
+
+StateFilterRecorder::Stats &StateFilterRecorder::Stats::operator+=(const Stats &rhs) {
+  for (int i = 0; i < static_cast<int>(Type::Count); i++) {
+    Issued[i] += rhs.Issued[i];
+    Filtered[i] += rhs.Filtered[i];
+  }
+  return *this;
+}
+
+void StateFilterRecorder::Reset() {
+  mRootSignature.Known = mPipeline.Known = mTopology.Known = false;
+  mViewport.Known = mScissor.Known = false;
+  mVertexBuffer.Known = mIndexBuffer.Known = false;
+  ForgetRootArguments();
+}
+
+void StateFilterRecorder::ResetStats() {
+  memset(&mStats, 0, sizeof(mStats));
+}
+
+void StateFilterRecorder::ForgetRootArguments() {
+  for (uint32_t slot = 0; slot < TrackedRootSlots; slot++) {
+    mConstantBuffers[slot].Known = mShaderResources[slot].Known = false;
+  }
+}
+
+template<typename T>
+bool StateFilterRecorder::Changes(Type type, State<T> &state, const T &value) {
+  if (state.Known && Same(state.Value, value)) {
+    mStats.Filtered[static_cast<int>(type)]++;
+    return false;
+  }
+  state.Value = value;
+  state.Known = true;
+  mStats.Issued[static_cast<int>(type)]++;
+  return true;
+}
+
+void StateFilterRecorder::SetRootSignature(uint64_t rootSignature) {
+  if (Changes(Type::SetRootSignature, mRootSignature, rootSignature)) {
+    // A new root signature leaves every root argument undefined.
+    ForgetRootArguments();
+    mTarget.SetRootSignature(rootSignature);
+  }
+}
+
+void StateFilterRecorder::SetPipelineState(uint64_t pipeline) {
+  if (Changes(Type::SetPipelineState, mPipeline, pipeline)) {
+    mTarget.SetPipelineState(pipeline);
+  }
+}
+
+void StateFilterRecorder::SetPrimitiveTopology(uint32_t topology) {
+  if (Changes(Type::SetPrimitiveTopology, mTopology, topology)) {
+    mTarget.SetPrimitiveTopology(topology);
+  }
+}
+
+void StateFilterRecorder::SetViewport(const Viewport &viewport) {
+  if (Changes(Type::SetViewport, mViewport, viewport)) {
+    mTarget.SetViewport(viewport);
+  }
+}
+
+void StateFilterRecorder::SetScissorRect(const ScissorRect &rect) {
+  if (Changes(Type::SetScissorRect, mScissor, rect)) {
+    mTarget.SetScissorRect(rect);
+  }
+}
+
+void StateFilterRecorder::SetVertexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t stride) {
+  if (Changes(Type::SetVertexBuffer, mVertexBuffer, BufferView{ address, sizeInBytes, stride })) {
+    mTarget.SetVertexBuffer(address, sizeInBytes, stride);
+  }
+}
+
+void StateFilterRecorder::SetIndexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t indexSize) {
+  if (Changes(Type::SetIndexBuffer, mIndexBuffer, BufferView{ address, sizeInBytes, indexSize })) {
+    mTarget.SetIndexBuffer(address, sizeInBytes, indexSize);
+  }
+}
+
+void StateFilterRecorder::SetConstantBuffer(uint32_t slot, uint64_t address) {
+  if (slot >= TrackedRootSlots) {
+    mStats.Issued[static_cast<int>(Type::SetConstantBuffer)]++;
+    mTarget.SetConstantBuffer(slot, address);
+  } else if (Changes(Type::SetConstantBuffer, mConstantBuffers[slot], address)) {
+    mTarget.SetConstantBuffer(slot, address);
+  }
+}
+
+void StateFilterRecorder::SetShaderResource(uint32_t slot, uint64_t address) {
+  if (slot >= TrackedRootSlots) {
+    mStats.Issued[static_cast<int>(Type::SetShaderResource)]++;
+    mTarget.SetShaderResource(slot, address);
+  } else if (Changes(Type::SetShaderResource, mShaderResources[slot], address)) {
+    mTarget.SetShaderResource(slot, address);
+  }
+}
+
+void StateFilterRecorder::DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                                      int32_t baseVertex, uint32_t startInstance) {
+  mStats.Issued[static_cast<int>(Type::DrawIndexed)]++;
+  mTarget.DrawIndexed(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
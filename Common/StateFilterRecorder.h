@@ -0,0 +1,65 @@
+#pragma once
+#include "CommandRecorder.h"
+#include <cstdint>
+
+// Forwards commands to another recorder, dropping those that would set
+// state to the value it already has. Draws always pass. Call Reset() whenever
+// the target starts a new command list, whose state is undefined.
+class StateFilterRecorder : public CommandRecorder {
+public:
+  static const uint32_t TrackedRootSlots = 8;
+
+  struct Stats {
+    uint64_t Issued[static_cast<int>(Type::Count)];
+    uint64_t Filtered[static_cast<int>(Type::Count)];
+
+    uint64_t TotalIssued() const;
+    uint64_t TotalFiltered() const;
+    Stats &operator+=(const Stats &rhs);
+  };
+
+  explicit StateFilterRecorder(CommandRecorder &target) : mTarget(target) { Reset(); ResetStats(); }
+
+  void Reset();
+  const Stats &GetStats() const { return mStats; }
+  void ResetStats();
+
+  void SetRootSignature(uint64_t rootSignature) override;
+  void SetPipelineState(uint64_t pipeline) override;
+  void SetPrimitiveTopology(uint32_t topology) override;
+  void SetViewport(const Viewport &viewport) override;
+  void SetScissorRect(const ScissorRect &rect) override;
+  void SetVertexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t stride) override;
+  void SetIndexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t indexSize) override;
+  void SetConstantBuffer(uint32_t slot, uint64_t address) override;
+  void SetShaderResource(uint32_t slot, uint64_t address) override;
+  void DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                   int32_t baseVertex, uint32_t startInstance) override;
+
+private:
+  // A tracked value and whether it is known.
+  template<typename T>
+  struct State {
+    T Value;
+    bool Known;
+  };
+
+  struct BufferView {
+    uint64_t Address;
+    uint32_t Size, Format;
+  };
+
+  // Returns true if the command must be issued, updating state and counters.
+  template<typename T>
+  bool Changes(Type type, State<T> &state, const T &value);
+  void ForgetRootArguments();
+
+  CommandRecorder &mTarget;
+  Stats mStats;
+  State<uint64_t> mRootSignature, mPipeline;
+  State<uint32_t> mTopology;
+  State<Viewport> mViewport;
+  State<ScissorRect> mScissor;
+  State<BufferView> mVertexBuffer, mIndexBuffer;
+  State<uint64_t> mConstantBuffers[TrackedRootSlots], mShaderResources[TrackedRootSlots];
+};
@@ -0,0 +1,55 @@
+#include "UploadPlanner.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+void UploadPlanner::Add(uint32_t destination, uint64_t destOffset, const void *data, uint64_t size) {
+  if (size == 0) {
+    return;
+  }
+  mRequests.push_back({ destination, destOffset, data, size, 0 });
+  mRequestBytes += size;
+}
+
+void UploadPlanner::Plan(uint64_t alignment) {
+  assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of two.");
+  std::stable_sort(mRequests.begin(), mRequests.end(), [](const Request &a, const Request &b) {
+    return a.Destination != b.Destination ? a.Destination < b.Destination : a.DestOffset < b.DestOffset;
+  });
+
+  mCopies.clear();
+  uint64_t staging = 0;
+  for (Request &r : mRequests) {
+    if (!mCopies.empty()) {
+      Copy &last = mCopies.back();
+      assert((last.Destination != r.Destination || last.DestOffset + last.Size <= r.DestOffset) &&
+        "Upload requests overlap.");
+      if (last.Destination == r.Destination && last.DestOffset + last.Size == r.DestOffset) {
+        // Continues the previous range: stage it right behind and extend the copy.
+        r.SourceOffset = staging;
+        last.Size += r.Size;
+        staging += r.Size;
+        continue;
+      }
+    }
+    staging = (staging + alignment - 1) & ~(alignment - 1);
+    r.SourceOffset = staging;
+    mCopies.push_back({ r.Destination, r.DestOffset, staging, r.Size });
+    staging += r.Size;
+  }
+  mStagingSize = staging;
+}
+
+void UploadPlanner::Pack(void *staging) const {
+  unsigned char *dst = static_cast<unsigned char*>(staging);
+  for (const Request &r : mRequests) {
+    memcpy(dst + r.SourceOffset, r.Data, r.Size);
+  }
+}
+
+void UploadPlanner::Clear() {
+  mRequests.clear();
+  mCopies.clear();
+  mStagingSize = 0;
+  mRequestBytes = 0;
+}
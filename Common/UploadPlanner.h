@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU side of batched buffer uploads. Requests to write bytes into
+// destination buffers (identified by caller-chosen indices) are packed back to
+// back into one staging allocation, and requests that are contiguous in the
+// same destination are merged so each destination range needs one copy.
+// Has no graphics API dependency; UploadBatcher drives it for D3D12.
+class UploadPlanner {
+public:
+  struct Copy {
+    uint32_t Destination;
+    uint64_t DestOffset;
+    uint64_t SourceOffset;  // into the staging allocation
+    uint64_t Size;
+  };
+
+  // Queues size bytes from data for destination at destOffset. Requests must
+  // not overlap, and data must stay valid until Pack().
+  void Add(uint32_t destination, uint64_t destOffset, const void *data, uint64_t size);
+
+  // Orders the requests by destination and offset, assigns staging offsets
+  // (each copy starts on an alignment boundary) and builds the copy list.
+  void Plan(uint64_t alignment = 16);
+
+  // Valid after Plan().
+  uint64_t StagingSize() const { return mStagingSize; }
+  const std::vector<Copy> &Copies() const { return mCopies; }
+
+  // Writes every request into staging, which must hold StagingSize() bytes.
+  void Pack(void *staging) const;
+
+  size_t RequestCount() const { return mRequests.size(); }
+  uint64_t RequestBytes() const { return mRequestBytes; }
+  void Clear();
+
+private:
+  struct Request {
+    uint32_t Destination;
+    uint64_t DestOffset;
+    const void *Data;
+    uint64_t Size;
+    uint64_t SourceOffset;
+  };
+
+  std::vector<Request> mRequests;
+  std::vector<Copy> mCopies;
+  uint64_t mStagingSize = 0;
+  uint64_t mRequestBytes = 0;
+};
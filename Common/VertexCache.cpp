@@ -0,0 +1,332 @@
+#include "VertexCache.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <DirectXMath.h>
+#include <vector>
+using namespace DirectX;
+
+namespace VertexCache {
+  namespace {
+    // Forsyth's published weights.
+    const float CacheDecayPower = 1.5f;
+    const float LastTriangleScore = 0.75f;
+    const float ValenceBoostScale = 2.0f;
+    const float ValenceBoostPower = 0.5f;
+    const uint32_t MaxValenceTable = 64;
+
+    struct Scores {
+      float Cache[MaxCacheSize];
+      float Valence[MaxValenceTable];
+
+      explicit Scores(uint32_t cacheSize) {
+        for (uint32_t i = 0; i < MaxCacheSize; i++) {
+          // The last triangle's vertices score the same whatever their order,
+          // so that it is not favoured to continue from one particular edge.
+          if (i < 3) {
+            Cache[i] = LastTriangleScore;
+          } else if (i < cacheSize) {
+            Cache[i] = std::pow(1.0f - static_cast<float>(i - 3) / (cacheSize - 3), CacheDecayPower);
+          } else {
+            Cache[i] = 0.0f;
+          }
+        }
+        Valence[0] = 0.0f;
+        for (uint32_t i = 1; i < MaxValenceTable; i++) {
+          Valence[i] = ValenceBoost(i);
+        }
+      }
+
+      // Vertices with few triangles left are boosted, so they are finished
+      // off instead of being left behind as lone triangles.
+      static float ValenceBoost(uint32_t remaining) {
+        return ValenceBoostScale * std::pow(static_cast<float>(remaining), -ValenceBoostPower);
+      }
+
+      float Vertex(int cachePosition, uint32_t remaining) const {
+        if (remaining == 0) {
+          return -1.0f;
+        }
+        float score = cachePosition >= 0 ? Cache[cachePosition] : 0.0f;
+        return score + (remaining < MaxValenceTable ? Valence[remaining] : ValenceBoost(remaining));
+      }
+    };
+
+    // A vertex is cached while fewer than Size others were shaded after it.
+    class FifoCache {
+    public:
+      FifoCache(size_t vertexCount, uint32_t size) : mShadedAt(vertexCount, Never), mSize(size) {}
+
+      // Returns 1 if v had to be shaded.
+      uint32_t Touch(uint32_t v) {
+        uint64_t &at = mShadedAt[v];
+        if (at != Never && mTransforms - at <= mSize) {
+          return 0;
+        }
+        at = mTransforms++;
+        return 1;
+      }
+      // Makes every vertex miss, as if Size others were shaded.
+      void Flush() { mTransforms += mSize; }
+
+    private:
+      static const uint64_t Never = ~0ull;
+      std::vector<uint64_t> mShadedAt;
+      uint64_t mTransforms = 0;
+      uint32_t mSize;
+    };
+  }
+
+  Stats Simulate(const uint32_t *indices, size_t indexCount, uint32_t cacheSize, Policy policy) {
+    Stats stats;
+    stats.Triangles = indexCount / 3;
+    // In size_t so that index 0xFFFFFFFF does not wrap the count to zero.
+    size_t vertexCount = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+      vertexCount = std::max(vertexCount, static_cast<size_t>(indices[i]) + 1);
+    }
+    std::vector<bool> referenced(vertexCount, false);
+    for (size_t i = 0; i < indexCount; i++) {
+      if (!referenced[indices[i]]) {
+        referenced[indices[i]] = true;
+        stats.Vertices++;
+      }
+    }
+
+    if (policy == Policy::Fifo) {
+      FifoCache cache(vertexCount, cacheSize);
+      for (size_t i = 0; i < indexCount; i++) {
+        stats.Transforms += cache.Touch(indices[i]);
+      }
+    } else {
+      // Most recently used first.
+      std::vector<uint32_t> cache;
+      cache.reserve(cacheSize + 1);
+      for (size_t i = 0; i < indexCount; i++) {
+        auto it = std::find(cache.begin(), cache.end(), indices[i]);
+        if (it == cache.end()) {
+          stats.Transforms++;
+          if (cache.size() == cacheSize) {
+            cache.pop_back();
+          }
+          cache.insert(cache.begin(), indices[i]);
+        } else {
+          std::rotate(cache.begin(), it, it + 1);
+        }
+      }
+    }
+    return stats;
+  }
+
+  void Optimize(uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+    assert(cacheSize > 3 && cacheSize <= MaxCacheSize);
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) {
+      return;
+    }
+    const Scores scores(cacheSize);
+    const std::vector<uint32_t> input(indices, indices + triangleCount * 3);
+
+    // Each vertex's triangles not yet emitted are the first Remaining of its
+    // range in triangles.
+    std::vector<uint32_t> first(vertexCount + 1, 0), remaining(vertexCount, 0);
+    for (uint32_t v : input) {
+      remaining[v]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+      first[v + 1] = first[v] + remaining[v];
+    }
+    std::vector<uint32_t> triangles(input.size());
+    {
+      std::vector<uint32_t> filled(vertexCount, 0);
+      for (size_t i = 0; i < input.size(); i++) {
+        uint32_t v = input[i];
+        triangles[first[v] + filled[v]++] = static_cast<uint32_t>(i / 3);
+      }
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+      vertexScore[v] = scores.Vertex(-1, remaining[v]);
+    }
+    std::vector<bool> emitted(triangleCount, false);
+    size_t best = 0;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; t++) {
+      const uint32_t *tri = &input[t * 3];
+      float score = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+      if (score > bestScore) {
+        bestScore = score;
+        best = t;
+      }
+    }
+
+    // Cache contents, most recent first; the emitted triangle's vertices go
+    // in front and push up to 3 others out past cacheSize.
+    uint32_t cache[MaxCacheSize + 3], next[MaxCacheSize + 3];
+    uint32_t cacheCount = 0;
+    const size_t none = ~size_t(0);
+    size_t cursor = 0;
+    for (size_t out = 0; out < triangleCount; out++) {
+      if (best == none) {
+        // Nothing in the cache has triangles left: continue with the next
+        // unemitted one in input order.
+        while (emitted[cursor]) {
+          cursor++;
+        }
+        best = cursor;
+      }
+      const uint32_t *tri = &input[best * 3];
+      indices[out * 3 + 0] = tri[0];
+      indices[out * 3 + 1] = tri[1];
+      indices[out * 3 + 2] = tri[2];
+      emitted[best] = true;
+
+      for (int k = 0; k < 3; k++) {
+        uint32_t v = tri[k];
+        uint32_t *begin = &triangles[first[v]], *end = begin + remaining[v];
+        std::iter_swap(std::find(begin, end, static_cast<uint32_t>(best)), end - 1);
+        remaining[v]--;
+      }
+
+      uint32_t nextCount = 0;
+      for (int k = 0; k < 3; k++) {
+        if (std::find(next, next + nextCount, tri[k]) == next + nextCount) {
+          next[nextCount++] = tri[k];
+        }
+      }
+      for (uint32_t i = 0; i < cacheCount; i++) {
+        uint32_t v = cache[i];
+        if (v != tri[0] && v != tri[1] && v != tri[2]) {
+          next[nextCount++] = v;
+        }
+      }
+      for (uint32_t i = cacheSize; i < nextCount; i++) {
+        vertexScore[next[i]] = scores.Vertex(-1, remaining[next[i]]);
+      }
+      cacheCount = std::min(nextCount, cacheSize);
+      std::copy(next, next + cacheCount, cache);
+      for (uint32_t i = 0; i < cacheCount; i++) {
+        vertexScore[cache[i]] = scores.Vertex(static_cast<int>(i), remaining[cache[i]]);
+      }
+
+      // The best triangle left with a vertex in the cache is next; no other
+      // triangle's score went up.
+      best = none;
+      bestScore = -1.0f;
+      for (uint32_t i = 0; i < cacheCount; i++) {
+        uint32_t v = cache[i];
+        for (uint32_t j = 0; j < remaining[v]; j++) {
+          uint32_t t = triangles[first[v] + j];
+          const uint32_t *other = &input[t * 3];
+          float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+          if (score > bestScore) {
+            bestScore = score;
+            best = t;
+          }
+        }
+      }
+    }
+  }
+
+  void OptimizeOverdraw(uint32_t *indices, size_t indexCount, const float *positions, size_t positionStride,
+                        size_t vertexCount, float threshold, uint32_t cacheSize) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) {
+      return;
+    }
+    const std::vector<uint32_t> input(indices, indices + triangleCount * 3);
+    auto misses = [&](FifoCache &cache, size_t t) {
+      return cache.Touch(input[t * 3]) + cache.Touch(input[t * 3 + 1]) + cache.Touch(input[t * 3 + 2]);
+    };
+
+    // Triangles whose vertices are all new to the cache already start over,
+    // so moving them costs nothing: they split the list into hard clusters.
+    std::vector<size_t> hard;
+    {
+      FifoCache cache(vertexCount, cacheSize);
+      for (size_t t = 0; t < triangleCount; t++) {
+        if (misses(cache, t) == 3) {
+          hard.push_back(t);
+        }
+      }
+      if (hard.empty() || hard[0] != 0) {
+        hard.insert(hard.begin(), 0);
+      }
+      hard.push_back(triangleCount);
+    }
+
+    // Each hard cluster is cut again as soon as the part since the last cut,
+    // starting cold, is within threshold of the whole cluster's misses.
+    std::vector<size_t> clusters;
+    {
+      FifoCache cache(vertexCount, cacheSize);
+      for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t begin = hard[h], end = hard[h + 1];
+        cache.Flush();
+        uint64_t total = 0;
+        for (size_t t = begin; t < end; t++) {
+          total += misses(cache, t);
+        }
+        float limit = threshold * total / (end - begin);
+        cache.Flush();
+        clusters.push_back(begin);
+        uint64_t since = 0;
+        for (size_t t = begin; t + 1 < end; t++) {
+          since += misses(cache, t);
+          if (since <= limit * (t + 1 - clusters.back())) {
+            clusters.push_back(t + 1);
+            cache.Flush();
+            since = 0;
+          }
+        }
+      }
+      clusters.push_back(triangleCount);
+    }
+
+    // Area-weighted centroids and normals. Front faces are clockwise in D3D's
+    // left-handed space, so (p1 - p0) x (p2 - p0) points out of the surface.
+    auto position = [&](uint32_t v) {
+      XMFLOAT3 p;
+      memcpy(&p, reinterpret_cast<const unsigned char*>(positions) + v * positionStride, sizeof p);
+      return XMLoadFloat3(&p);
+    };
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<XMFLOAT3> centroids(clusterCount), normals(clusterCount);
+    XMVECTOR meshCentroid = XMVectorZero();
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+      XMVECTOR centroid = XMVectorZero(), normal = XMVectorZero();
+      float area = 0.0f;
+      for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+        XMVECTOR p0 = position(input[t * 3]), p1 = position(input[t * 3 + 1]), p2 = position(input[t * 3 + 2]);
+        XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+        float a = XMVectorGetX(XMVector3Length(n));
+        centroid += a * (p0 + p1 + p2) / 3.0f;
+        normal += n;
+        area += a;
+      }
+      meshCentroid += centroid;
+      meshArea += area;
+      XMStoreFloat3(&centroids[c], area > 0.0f ? centroid / area : centroid);
+      XMStoreFloat3(&normals[c], XMVector3Normalize(normal));
+    }
+    if (meshArea > 0.0f) {
+      meshCentroid /= meshArea;
+    }
+
+    std::vector<float> keys(clusterCount);
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+      keys[c] = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&centroids[c]) - meshCentroid, XMLoadFloat3(&normals[c])));
+      order[c] = static_cast<uint32_t>(c);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    uint32_t *out = indices;
+    for (uint32_t c : order) {
+      out = std::copy(&input[clusters[c] * 3], &input[clusters[c + 1] * 3], out);
+    }
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// The GPU's post-transform vertex cache: an indexed vertex whose shaded
+// result is still cached is not shaded again. Optimize() reorders a triangle
+// list so consecutive triangles share vertices; Simulate() counts the vertex
+// shader invocations an order costs.
+namespace VertexCache {
+  // Fifo evicts the vertex shaded longest ago, like most hardware; Lru the
+  // one used longest ago.
+  enum class Policy { Fifo, Lru };
+
+  struct Stats {
+    uint64_t Triangles = 0;
+    uint64_t Vertices = 0;   // distinct vertices referenced
+    uint64_t Transforms = 0; // vertex shader invocations, i.e. cache misses
+
+    // Average cache miss ratio: invocations per triangle, about 0.5 at best
+    // for a large regular mesh and 3 at worst.
+    double Acmr() const { return Triangles ? static_cast<double>(Transforms) / Triangles : 0.0; }
+    // Average transform to vertex ratio: invocations per vertex, 1 at best.
+    double Atvr() const { return Vertices ? static_cast<double>(Transforms) / Vertices : 0.0; }
+  };
+
+  Stats Simulate(const uint32_t *indices, size_t indexCount, uint32_t cacheSize, Policy policy);
+
+  const uint32_t MaxCacheSize = 64;
+
+  // Reorders the triangles of a triangle list, keeping each triangle's
+  // winding, with Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+  // for an LRU cache of cacheSize (4 to MaxCacheSize) entries. The result
+  // suits FIFO caches of similar size too. Indices must be < vertexCount.
+  void Optimize(uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 32);
+
+  // Reorders a vertex cache optimized triangle list to reduce overdraw
+  // (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality
+  // and Reduced Overdraw"). The list is cut into clusters wherever that
+  // keeps every cluster's FIFO cache misses, starting cold, within threshold
+  // times the input order's; clusters facing away from the mesh's centroid
+  // on its outside are moved first, since from most viewpoints they are in
+  // front of the rest. positions is the first vertex's float3 position and
+  // positionStride the bytes between vertices.
+  void OptimizeOverdraw(uint32_t *indices, size_t indexCount, const float *positions, size_t positionStride,
+                        size_t vertexCount, float threshold = 1.05f, uint32_t cacheSize = 32);
+}
@@ -0,0 +1,87 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned int i = 1; i < threadCount; i++) {
+    mThreads.emplace_back(&WorkerPool::WorkerLoop, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQuit = true;
+  }
+  mWake.notify_all();
+  for (std::thread &t : mThreads) {
+    t.join();
+  }
+}
+
+void WorkerPool::ParallelFor(unsigned int count, const std::function<void(unsigned int)> &fn) {
+  if (count == 0) {
+    return;
+  }
+  bool wake = !mThreads.empty() && count > 1;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTask = &fn;
+    mCount = count;
+    mNext = 0;
+    if (wake) {
+      mBusy = static_cast<unsigned int>(mThreads.size());
+      mGeneration++;
+    }
+  }
+  if (wake) {
+    mWake.notify_all();
+  }
+
+  RunTask();
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  mDone.wait(lock, [this] { return mBusy == 0; });
+  mTask = nullptr;
+  if (mError) {
+    std::exception_ptr error;
+    std::swap(error, mError);
+    lock.unlock();
+    std::rethrow_exception(error);
+  }
+}
+
+void WorkerPool::WorkerLoop() {
+  unsigned long long seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWake.wait(lock, [&] { return mQuit || mGeneration != seen; });
+      if (mQuit) {
+        return;
+      }
+      seen = mGeneration;
+    }
+    RunTask();
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mBusy--;
+    }
+    mDone.notify_one();
+  }
+}
+
+void WorkerPool::RunTask() {
+  for (unsigned int i = mNext++; i < mCount; i = mNext++) {
+    try {
+      (*mTask)(i);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (!mError) {
+        mError = std::current_exception();
+      }
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that execute ParallelFor loops. The calling
+// thread takes part in every loop, so a pool of N threads spawns N-1 workers.
+class WorkerPool {
+public:
+  // threadCount == 0 uses std::thread::hardware_concurrency().
+  explicit WorkerPool(unsigned int threadCount = 0);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  unsigned int ThreadCount() const { return static_cast<unsigned int>(mThreads.size()) + 1; }
+
+  // Calls fn(i) for every i in [0, count) and returns once all calls finished.
+  // Indices are handed out dynamically so uneven work balances itself.
+  // If calls throw, the other indices still run and the first exception is
+  // rethrown here afterwards.
+  void ParallelFor(unsigned int count, const std::function<void(unsigned int)> &fn);
+
+private:
+  void WorkerLoop();
+  void RunTask();
+
+  std::vector<std::thread> mThreads;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::condition_variable mDone;
+
+  const std::function<void(unsigned int)> *mTask = nullptr;
+  std::atomic<unsigned int> mNext{ 0 };
+  unsigned int mCount = 0;
+  unsigned int mBusy = 0;
+  unsigned long long mGeneration = 0;
+  std::exception_ptr mError;
+  bool mQuit = false;
+};
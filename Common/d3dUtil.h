@@ -181,8 +181,36 @@ struct MeshGeometry
 
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
 	// Use this container to define the Submesh geometries so we can draw
-	// the Submeshes individually.
-	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
+	// the Submeshes individually.  Draws refer to them by handle, an index
+	// into Submeshes; the names are only for looking handles up at load time.
+	typedef UINT SubmeshHandle;
+	static const SubmeshHandle InvalidSubmesh = ~0u;
+
+	std::vector<SubmeshGeometry> Submeshes;
+	std::unordered_map<std::string, SubmeshHandle> SubmeshNames;
+
+	// Adds a named submesh, or replaces the one with that name.
+	SubmeshHandle AddSubmesh(const std::string& name, const SubmeshGeometry& submesh)
+	{
+		auto inserted = SubmeshNames.emplace(name, (SubmeshHandle)Submeshes.size());
+		if(inserted.second)
+			Submeshes.push_back(submesh);
+		else
+			Submeshes[inserted.first->second] = submesh;
+		return inserted.first->second;
+	}
+
+	SubmeshHandle FindSubmesh(const std::string& name)const
+	{
+		auto it = SubmeshNames.find(name);
+		return it == SubmeshNames.end() ? InvalidSubmesh : it->second;
+	}
+
+	const SubmeshGeometry& Submesh(SubmeshHandle handle)const
+	{
+		assert(handle < Submeshes.size());
+		return Submeshes[handle];
+	}
 
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 	{
@@ -0,0 +1,2120 @@
+#include "Benchmark.h"
+#include "Rasterizer.h"
+#include "OcclusionCuller.h"
+#include "FrustumCuller.h"
+#include "MeshStreams.h"
+#include "OverdrawSimulator.h"
+#include "../Common/FrameRing.h"
+#include "../Common/LinearRingAllocator.h"
+#include "../Common/UploadPlanner.h"
+#include "../Common/RangeAllocator.h"
+#include "../Common/CommandRecorder.h"
+#include "../Common/ParallelRecorder.h"
+#include "../Common/WorkerPool.h"
+#include "../Common/JobSystem.h"
+#include "../Common/InstancePacker.h"
+#include "../Common/DrawSortKey.h"
+#include "../Common/RadixSort.h"
+#include "../Common/StateFilterRecorder.h"
+#include "../Common/ShaderCache.h"
+#include "../Common/ShaderPermutations.h"
+#include "../Common/PipelineKey.h"
+#include "../Common/BlobStore.h"
+#include "../Common/SpscQueue.h"
+#include "../Common/MpscQueue.h"
+#include "../Common/GeometryGenerator.h"
+#include "../Common/Hash.h"
+#include "../Common/VertexCache.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+using namespace std;
+using namespace DirectX;
+
+namespace {
+  typedef chrono::high_resolution_clock Clock;
+
+  double SecondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  // Correctness checks run next to the timings; RunBenchmarks returns how
+  // many failed.
+  int failedChecks = 0;
+
+  // Returns the text to print for ok, counting a failure if it is false.
+  const char *Check(bool ok, const char *pass, const char *fail) {
+    if (!ok) {
+      failedChecks++;
+    }
+    return ok ? pass : fail;
+  }
+
+  // Same cube as Rasterizer::BuildGeometry.
+  const Vertex BoxVertices[8] = {
+    { XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT4(Colors::White) },
+    { XMFLOAT3(-1.0f, +1.0f, -1.0f), XMFLOAT4(Colors::Black) },
+    { XMFLOAT3(+1.0f, +1.0f, -1.0f), XMFLOAT4(Colors::Red) },
+    { XMFLOAT3(+1.0f, -1.0f, -1.0f), XMFLOAT4(Colors::Green) },
+    { XMFLOAT3(-1.0f, -1.0f, +1.0f), XMFLOAT4(Colors::Blue) },
+    { XMFLOAT3(-1.0f, +1.0f, +1.0f), XMFLOAT4(Colors::Yellow) },
+    { XMFLOAT3(+1.0f, +1.0f, +1.0f), XMFLOAT4(Colors::Cyan) },
+    { XMFLOAT3(+1.0f, -1.0f, +1.0f), XMFLOAT4(Colors::Magenta) }
+  };
+  const uint16_t BoxIndices[36] = {
+    0, 1, 2, 0, 2, 3,
+    4, 6, 5, 4, 7, 6,
+    4, 5, 1, 4, 1, 0,
+    3, 2, 6, 3, 6, 7,
+    1, 5, 6, 1, 6, 2,
+    4, 0, 3, 4, 3, 7
+  };
+
+  // Deterministic field of boxes in front of the camera with heavy overdraw.
+  vector<ObjectConstants> BuildBoxField(int count, float aspect) {
+    mt19937 rng(1234);
+    uniform_real_distribution<float> xy(-12.0f, 12.0f), z(8.0f, 60.0f), angle(0.0f, XM_2PI), scale(0.5f, 2.5f);
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, -10.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, aspect, 1.0f, 1000.0f);
+    vector<ObjectConstants> objects(count);
+    for (ObjectConstants &obj : objects) {
+      float s = scale(rng);
+      XMMATRIX world = XMMatrixScaling(s, s, s) * XMMatrixRotationY(angle(rng)) * XMMatrixTranslation(xy(rng), xy(rng), z(rng));
+      XMStoreFloat4x4(&obj.WorldViewProj, XMMatrixTranspose(world * view * proj));
+    }
+    return objects;
+  }
+
+  // Scalar vs SSE vs AVX2 coverage over full 64-pixel tile rows of random
+  // triangles. Every kernel is checked against the scalar reference first.
+  void BenchmarkCoverageKernels(ostream &out) {
+    const int tile = SoftwareRasterizer::TileSize, triangleCount = 4096, repeats = 16;
+    mt19937 rng(42);
+    uniform_real_distribution<float> coord(-16.0f, tile + 16.0f);
+    vector<RasterKernels::EdgeFunctions> triangles;
+    while (triangles.size() < triangleCount) {
+      float x[3], y[3];
+      for (int i = 0; i < 3; i++) {
+        // Snap some vertices to pixel centers so the top-left ties get exercised.
+        x[i] = coord(rng);
+        y[i] = (i == 0) ? floor(coord(rng)) + 0.5f : coord(rng);
+      }
+      float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+      if (area < 0.0f) {
+        swap(x[1], x[2]);
+        swap(y[1], y[2]);
+      }
+      if (area != 0.0f) {
+        triangles.push_back(RasterKernels::SetupEdges(x, y));
+      }
+    }
+
+    vector<RasterKernels::Isa> isas = { RasterKernels::Isa::Scalar, RasterKernels::Isa::SSE };
+    if (RasterKernels::DetectIsa() == RasterKernels::Isa::AVX2) {
+      isas.push_back(RasterKernels::Isa::AVX2);
+    }
+
+    out << "Coverage kernels, " << triangleCount << " triangles over " << tile << "x" << tile << " tiles\n";
+    double scalarRate = 0.0;
+    for (RasterKernels::Isa isa : isas) {
+      RasterKernels::CoverageFn coverage = RasterKernels::SelectCoverage(isa);
+      size_t mismatches = 0;
+      for (const RasterKernels::EdgeFunctions &edges : triangles) {
+        for (int y = 0; y < tile; y++) {
+          mismatches += coverage(edges, 0, y, tile) != RasterKernels::CoverageScalar(edges, 0, y, tile);
+        }
+      }
+
+      unsigned long long start = __rdtsc();
+      for (int r = 0; r < repeats; r++) {
+        for (const RasterKernels::EdgeFunctions &edges : triangles) {
+          for (int y = 0; y < tile; y++) {
+            coverage(edges, 0, y, tile);
+          }
+        }
+      }
+      double cycles = static_cast<double>(__rdtsc() - start);
+      double pixels = static_cast<double>(repeats) * triangleCount * tile * tile;
+      double rate = pixels / cycles;
+      if (isa == RasterKernels::Isa::Scalar) {
+        scalarRate = rate;
+      }
+      out << "  " << setw(6) << RasterKernels::IsaName(isa)
+          << "  pixels/cycle " << setw(6) << fixed << setprecision(3) << rate
+          << "  vs scalar " << setw(6) << setprecision(2) << rate / scalarRate << "x"
+          << "  mismatches " << mismatches << Check(mismatches == 0, "", "  FAILED") << "\n";
+    }
+  }
+
+  void BenchmarkSoftwareRasterizer(ostream &out) {
+    const int width = 1920, height = 1080, frames = 10;
+    vector<ObjectConstants> objects = BuildBoxField(4000, static_cast<float>(width) / height);
+
+    vector<unsigned int> threadCounts;
+    unsigned int hardwareThreads = max(1u, thread::hardware_concurrency());
+    for (unsigned int n = 1; n < hardwareThreads; n *= 2) {
+      threadCounts.push_back(n);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    out << "SoftwareRasterizer " << width << "x" << height << ", " << objects.size() << " boxes, "
+        << SoftwareRasterizer::TileSize << "px tiles\n";
+    double baseline = 0.0;
+    for (unsigned int threads : threadCounts) {
+      SoftwareRasterizer raster(threads);
+      raster.Resize(width, height);
+      auto start = Clock::now();
+      for (int f = 0; f < frames; f++) {
+        raster.Clear(Colors::Navy, 1.0f);
+        for (const ObjectConstants &obj : objects) {
+          raster.DrawIndexed(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, obj.WorldViewProj);
+        }
+        raster.Flush();
+      }
+      double seconds = SecondsSince(start);
+      if (threads == 1) {
+        baseline = seconds;
+      }
+      const SoftwareRasterizer::Stats &stats = raster.GetStats();
+      out << "  threads " << setw(3) << threads
+          << "  ms/frame " << setw(8) << fixed << setprecision(2) << 1000.0 * seconds / frames
+          << "  Mtris/s " << setw(8) << stats.Triangles / seconds / 1e6
+          << "  Mpixels/s " << setw(8) << stats.Pixels / seconds / 1e6
+          << "  speedup " << setw(6) << baseline / seconds << "x\n";
+    }
+
+    // A throwing call lets every other index run and is rethrown on the
+    // calling thread; the pool stays usable afterwards.
+    WorkerPool pool(max(2u, hardwareThreads));
+    const unsigned int taskCount = 4096;
+    atomic<unsigned int> calls{ 0 };
+    bool rethrown = false;
+    try {
+      pool.ParallelFor(taskCount, [&calls](unsigned int i) {
+        if (i == 100) {
+          throw runtime_error("task failed");
+        }
+        calls++;
+      });
+    } catch (runtime_error &) {
+      rethrown = true;
+    }
+    pool.ParallelFor(taskCount, [&calls](unsigned int) { calls++; });
+    out << "  throwing task  " << Check(rethrown && calls == 2 * taskCount - 1, "ok", "FAILED") << "\n";
+  }
+
+  // Hierarchical-Z on/off for the box field drawn in random order and sorted
+  // front to back (by view depth, the translation's w after projection).
+  void BenchmarkHiZ(ostream &out) {
+    const int width = 1920, height = 1080, frames = 10;
+    vector<ObjectConstants> random = BuildBoxField(4000, static_cast<float>(width) / height);
+    vector<ObjectConstants> sorted = random;
+    sort(sorted.begin(), sorted.end(), [](const ObjectConstants &a, const ObjectConstants &b) {
+      return a.WorldViewProj(3, 3) < b.WorldViewProj(3, 3);
+    });
+
+    out << "Hierarchical-Z " << width << "x" << height << ", " << random.size() << " boxes, "
+        << SoftwareRasterizer::HiZBlockSize << "x" << SoftwareRasterizer::HiZBlockSize << " blocks\n";
+    const struct { const char *Name; const vector<ObjectConstants> *Objects; } orders[] = {
+      { "random", &random }, { "front-to-back", &sorted }
+    };
+    for (const auto &order : orders) {
+      vector<uint32_t> images[2];
+      for (bool hiz : { false, true }) {
+        SoftwareRasterizer raster;
+        raster.Resize(width, height);
+        raster.SetHiZEnabled(hiz);
+        auto start = Clock::now();
+        for (int f = 0; f < frames; f++) {
+          raster.Clear(Colors::Navy, 1.0f);
+          for (const ObjectConstants &obj : *order.Objects) {
+            raster.DrawIndexed(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, obj.WorldViewProj);
+          }
+          raster.Flush();
+        }
+        double seconds = SecondsSince(start);
+        images[hiz].resize(static_cast<size_t>(width) * height);
+        raster.ResolveColor(images[hiz].data());
+        const SoftwareRasterizer::Stats &stats = raster.GetStats();
+        out << "  " << setw(13) << left << order.Name << right << (hiz ? "  hiz on " : "  hiz off")
+            << "  ms/frame " << setw(8) << fixed << setprecision(2) << 1000.0 * seconds / frames
+            << "  depth tests/frame " << setw(10) << stats.DepthTests / frames
+            << "  tile rejects/frame " << setw(8) << stats.TileTrianglesRejected / frames
+            << "  block rejects/frame " << setw(8) << stats.BlocksRejected / frames
+            << "  block accepts/frame " << setw(8) << stats.BlocksAccepted / frames
+            << (hiz ? Check(images[0] == images[1], "  same image", "  IMAGE DIFFERS") : "") << "\n";
+      }
+    }
+  }
+
+  // A row of walls in front of the camera with a deterministic field of boxes
+  // behind and beside them. World matrices are not transposed.
+  struct OcclusionScene {
+    XMFLOAT4X4 ViewProj;
+    vector<XMFLOAT4X4> Occluders;
+    vector<XMFLOAT4X4> Objects;
+  };
+
+  OcclusionScene BuildOcclusionScene(int objectCount, float aspect) {
+    OcclusionScene scene;
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, -10.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMStoreFloat4x4(&scene.ViewProj, view * XMMatrixPerspectiveFovLH(0.25f*XM_PI, aspect, 1.0f, 1000.0f));
+    for (int i = 0; i < 4; i++) {
+      XMFLOAT4X4 wall;
+      XMStoreFloat4x4(&wall, XMMatrixScaling(4.5f, 6.0f, 0.5f) * XMMatrixTranslation(-15.0f + 10.0f * i, 0.0f, 5.0f));
+      scene.Occluders.push_back(wall);
+    }
+    mt19937 rng(4321);
+    uniform_real_distribution<float> x(-30.0f, 30.0f), y(-6.0f, 6.0f), z(10.0f, 80.0f), angle(0.0f, XM_2PI), scale(0.3f, 1.5f);
+    for (int i = 0; i < objectCount; i++) {
+      float s = scale(rng);
+      XMFLOAT4X4 world;
+      XMStoreFloat4x4(&world, XMMatrixScaling(s, s, s) * XMMatrixRotationY(angle(rng)) * XMMatrixTranslation(x(rng), y(rng), z(rng)));
+      scene.Objects.push_back(world);
+    }
+    return scene;
+  }
+
+  XMFLOAT4X4 CbufferWorldViewProj(const XMFLOAT4X4 &world, const XMFLOAT4X4 &viewProj) {
+    XMFLOAT4X4 result;
+    XMStoreFloat4x4(&result, XMMatrixTranspose(XMLoadFloat4x4(&world) * XMLoadFloat4x4(&viewProj)));
+    return result;
+  }
+
+  // Culls the synthetic scene, checks every culled box really produces no
+  // pixels behind the walls in the software rasterizer, and compares frame
+  // times with and without culling.
+  void BenchmarkOcclusionCulling(ostream &out) {
+    const int width = 1024, height = 512, frames = 10;
+    OcclusionScene scene = BuildOcclusionScene(10000, static_cast<float>(width) / height);
+    BoundingBox bounds;
+    BoundingBox::CreateFromPoints(bounds, 8, &BoxVertices[0].Pos, sizeof(Vertex));
+
+    OcclusionCuller culler;
+    vector<const XMFLOAT4X4*> visible;
+    auto start = Clock::now();
+    for (int f = 0; f < frames; f++) {
+      culler.BeginFrame(scene.ViewProj);
+      for (const XMFLOAT4X4 &wall : scene.Occluders) {
+        culler.AddOccluder(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, wall);
+      }
+      visible.clear();
+      for (const XMFLOAT4X4 &object : scene.Objects) {
+        if (culler.IsVisible(bounds, object)) {
+          visible.push_back(&object);
+        }
+      }
+    }
+    double cullSeconds = SecondsSince(start);
+
+    // Ground truth: draw the walls, then each culled box on its own. Boxes drawn
+    // earlier only add depth, so any pixel written proves a false cull.
+    SoftwareRasterizer raster;
+    raster.Resize(width, height);
+    raster.Clear(Colors::Navy, 1.0f);
+    for (const XMFLOAT4X4 &wall : scene.Occluders) {
+      raster.DrawIndexed(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, CbufferWorldViewProj(wall, scene.ViewProj));
+    }
+    raster.Flush();
+    size_t falseCulls = 0, next = 0;
+    for (const XMFLOAT4X4 &object : scene.Objects) {
+      if (next < visible.size() && visible[next] == &object) {
+        next++;
+        continue;
+      }
+      uint64_t before = raster.GetStats().Pixels;
+      raster.DrawIndexed(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, CbufferWorldViewProj(object, scene.ViewProj));
+      raster.Flush();
+      falseCulls += raster.GetStats().Pixels != before;
+    }
+
+    out << "OcclusionCuller " << OcclusionCuller::Width << "x" << OcclusionCuller::Height << ", "
+        << scene.Occluders.size() << " occluders, " << scene.Objects.size() << " boxes\n"
+        << "  cull ms/frame " << fixed << setprecision(3) << 1000.0 * cullSeconds / frames
+        << "  culled " << scene.Objects.size() - visible.size() << "/" << scene.Objects.size()
+        << "  false culls " << falseCulls << Check(falseCulls == 0, "", "  FAILED") << "\n";
+
+    for (bool cull : { false, true }) {
+      raster.ResetStats();
+      auto drawStart = Clock::now();
+      for (int f = 0; f < frames; f++) {
+        raster.Clear(Colors::Navy, 1.0f);
+        for (const XMFLOAT4X4 &wall : scene.Occluders) {
+          raster.DrawIndexed(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, CbufferWorldViewProj(wall, scene.ViewProj));
+        }
+        if (cull) {
+          for (const XMFLOAT4X4 *object : visible) {
+            raster.DrawIndexed(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, CbufferWorldViewProj(*object, scene.ViewProj));
+          }
+        } else {
+          for (const XMFLOAT4X4 &object : scene.Objects) {
+            raster.DrawIndexed(BoxVertices, sizeof(Vertex), BoxIndices, true, 36, 0, 0, CbufferWorldViewProj(object, scene.ViewProj));
+          }
+        }
+        raster.Flush();
+      }
+      double seconds = SecondsSince(drawStart);
+      out << (cull ? "  culled   " : "  all      ")
+          << "  draws/frame " << setw(6) << (cull ? visible.size() : scene.Objects.size()) + scene.Occluders.size()
+          << "  ms/frame " << setw(8) << setprecision(2) << 1000.0 * seconds / frames
+          << "  pixels/frame " << setw(8) << raster.GetStats().Pixels / frames << "\n";
+    }
+  }
+
+  // Scalar vs SSE vs AVX2 plane tests over a large deterministic object field
+  // around the camera; each kernel must return exactly the scalar visible list.
+  void BenchmarkFrustumCulling(ostream &out) {
+    const int objectCount = 100000, frames = 20;
+    BoundingBox bounds;
+    BoundingBox::CreateFromPoints(bounds, 8, &BoxVertices[0].Pos, sizeof(Vertex));
+    mt19937 rng(99);
+    uniform_real_distribution<float> position(-200.0f, 200.0f), angle(0.0f, XM_2PI), scale(0.2f, 3.0f);
+    FrustumCuller::BoundsSoA soa;
+    for (int i = 0; i < objectCount; i++) {
+      float s = scale(rng);
+      XMFLOAT4X4 world;
+      XMStoreFloat4x4(&world, XMMatrixScaling(s, s, s) * XMMatrixRotationY(angle(rng)) *
+        XMMatrixTranslation(position(rng), position(rng) * 0.1f, position(rng)));
+      soa.Add(bounds, world);
+    }
+    XMFLOAT4X4 viewProj;
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 5.0f, -20.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMStoreFloat4x4(&viewProj, view * XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f / 9.0f, 1.0f, 150.0f));
+
+    out << "FrustumCuller " << objectCount << " boxes\n";
+    vector<RasterKernels::Isa> isas = { RasterKernels::Isa::Scalar, RasterKernels::Isa::SSE };
+    if (RasterKernels::DetectIsa() == RasterKernels::Isa::AVX2) {
+      isas.push_back(RasterKernels::Isa::AVX2);
+    }
+    FrustumCuller culler;
+    culler.SetFrustum(viewProj);
+    vector<uint32_t> reference, visible;
+    culler.SetIsa(RasterKernels::Isa::Scalar);
+    culler.Cull(soa, reference);
+    double scalarSeconds = 0.0;
+    for (RasterKernels::Isa isa : isas) {
+      culler.SetIsa(isa);
+      auto start = Clock::now();
+      for (int f = 0; f < frames; f++) {
+        culler.Cull(soa, visible);
+      }
+      double seconds = SecondsSince(start);
+      if (isa == RasterKernels::Isa::Scalar) {
+        scalarSeconds = seconds;
+      }
+      out << "  " << setw(6) << RasterKernels::IsaName(isa)
+          << "  ns/box " << setw(7) << fixed << setprecision(3) << 1e9 * seconds / (static_cast<double>(frames) * objectCount)
+          << "  visible " << setw(6) << visible.size()
+          << "  vs scalar " << setw(6) << setprecision(2) << scalarSeconds / seconds << "x"
+          << "  matches scalar " << Check(visible == reference, "yes", "NO") << "\n";
+    }
+  }
+
+  // Frame pacing against a fake GPU running a fixed number of frames behind:
+  // with N frame resources the CPU should only wait once the GPU lags by N.
+  void BenchmarkFramePacing(ostream &out) {
+    const int frames = 1000;
+    out << "FrameRing pacing, " << frames << " frames, waits per frame\n";
+    out << "  latency";
+    for (unsigned int resources = 1; resources <= 4; resources++) {
+      out << "  " << resources << " frame(s)";
+    }
+    out << "\n";
+    for (unsigned int latency = 0; latency <= 4; latency++) {
+      out << "  " << setw(7) << latency;
+      bool expected = true;
+      for (unsigned int resources = 1; resources <= 4; resources++) {
+        FakeFenceQueue queue(latency);
+        FrameRing ring(queue, resources);
+        for (int f = 0; f < frames; f++) {
+          ring.BeginFrame();
+          ring.EndFrame();
+        }
+        // Once every slot was used, each frame waits iff the GPU is at least
+        // as many frames behind as there are slots.
+        expected = expected && ring.GetStats().Waits == (latency >= resources ? frames - resources : 0);
+        out << "  " << setw(10) << fixed << setprecision(3) << static_cast<double>(ring.GetStats().Waits) / frames;
+      }
+      out << "  " << Check(expected, "ok", "WRONG WAITS") << "\n";
+    }
+  }
+
+  // Per-object constants through the ring allocator on plain memory, paced by
+  // a fake GPU two frames behind, against one heap allocation per object.
+  void BenchmarkUploadRing(ostream &out) {
+    const int frames = 200, objects = 10000;
+    const uint64_t constantSize = LinearRingAllocator::ConstantBufferAlignment;
+    ObjectConstants constants;
+    out << "Upload ring, " << objects << " ObjectConstants per frame, " << frames << " frames\n";
+
+    for (uint64_t capacity : { 4ull << 20, 8ull << 20, 16ull << 20 }) {
+      vector<unsigned char> memory(capacity);
+      FakeFenceQueue queue(2);
+      FrameRing ring(queue, 3);
+      LinearRingAllocator allocator(capacity);
+      uint64_t ringWaits = 0;
+      auto start = Clock::now();
+      for (int f = 0; f < frames; f++) {
+        ring.BeginFrame();
+        allocator.Retire(queue.CompletedValue());
+        for (int i = 0; i < objects; i++) {
+          uint64_t offset = allocator.Allocate(constantSize);
+          while (offset == LinearRingAllocator::InvalidOffset) {
+            ringWaits++;
+            queue.WaitFor(allocator.OldestFence());
+            allocator.Retire(queue.CompletedValue());
+            offset = allocator.Allocate(constantSize);
+          }
+          memcpy(&memory[offset], &constants, sizeof constants);
+        }
+        ring.EndFrame();
+        allocator.FinishFrame(ring.Fence(ring.Current()));
+      }
+      double seconds = SecondsSince(start);
+      out << "  ring " << setw(3) << (capacity >> 20) << "MB"
+          << "  ns/object " << setw(7) << fixed << setprecision(2) << 1e9 * seconds / (static_cast<double>(frames) * objects)
+          << "  ring-full waits/frame " << setw(7) << static_cast<double>(ringWaits) / frames << "\n";
+    }
+
+    vector<unsigned char*> blocks(objects);
+    auto start = Clock::now();
+    for (int f = 0; f < frames; f++) {
+      for (int i = 0; i < objects; i++) {
+        blocks[i] = new unsigned char[constantSize];
+        memcpy(blocks[i], &constants, sizeof constants);
+      }
+      for (unsigned char *block : blocks) {
+        delete[] block;
+      }
+    }
+    double seconds = SecondsSince(start);
+    out << "  new/delete per object  ns/object " << setw(7) << 1e9 * seconds / (static_cast<double>(frames) * objects) << "\n";
+  }
+
+  // Plans and packs a level load of meshes, once with a vertex and index
+  // buffer per mesh and once with all meshes back to back in shared buffers.
+  void BenchmarkUploadPlanner(ostream &out) {
+    const int meshCount = 2000, repeats = 5;
+    mt19937 rng(2024);
+    uniform_int_distribution<uint32_t> vertexCount(32, 4096), triangleCount(16, 4096);
+    struct Mesh { uint64_t VertexBytes, IndexBytes; };
+    vector<Mesh> meshes(meshCount);
+    uint64_t largest = 0;
+    for (Mesh &mesh : meshes) {
+      mesh.VertexBytes = vertexCount(rng) * sizeof(Vertex);
+      mesh.IndexBytes = triangleCount(rng) * 3 * sizeof(uint16_t);
+      largest = max(largest, max(mesh.VertexBytes, mesh.IndexBytes));
+    }
+    vector<unsigned char> source(largest, 0x5a);
+
+    out << "UploadPlanner, " << meshCount << " meshes\n";
+    for (bool shared : { false, true }) {
+      UploadPlanner planner;
+      vector<unsigned char> staging;
+      double planSeconds = 0.0, packSeconds = 0.0;
+      for (int r = 0; r < repeats; r++) {
+        planner.Clear();
+        auto start = Clock::now();
+        uint64_t vertexOffset = 0, indexOffset = 0;
+        for (uint32_t m = 0; m < meshes.size(); m++) {
+          if (shared) {
+            planner.Add(0, vertexOffset, source.data(), meshes[m].VertexBytes);
+            planner.Add(1, indexOffset, source.data(), meshes[m].IndexBytes);
+            vertexOffset += meshes[m].VertexBytes;
+            indexOffset += meshes[m].IndexBytes;
+          } else {
+            planner.Add(2 * m, 0, source.data(), meshes[m].VertexBytes);
+            planner.Add(2 * m + 1, 0, source.data(), meshes[m].IndexBytes);
+          }
+        }
+        planner.Plan();
+        planSeconds += SecondsSince(start);
+        staging.resize(planner.StagingSize());
+        start = Clock::now();
+        planner.Pack(staging.data());
+        packSeconds += SecondsSince(start);
+      }
+      out << (shared ? "  shared buffers   " : "  buffer per mesh  ")
+          << "  requests " << setw(6) << planner.RequestCount()
+          << "  copies " << setw(6) << planner.Copies().size()
+          << "  staging MB " << setw(7) << fixed << setprecision(2) << planner.StagingSize() / 1048576.0
+          << "  plan ms " << setw(6) << 1000.0 * planSeconds / repeats
+          << "  packed GB/s " << setw(6) << planner.RequestBytes() * repeats / packSeconds / 1e9 << "\n";
+    }
+  }
+
+  // Live ranges lie inside the capacity without overlapping, and together
+  // with the free space account for all of it.
+  bool ValidRanges(const RangeAllocator &ranges, vector<RangeAllocator::Handle> live) {
+    sort(live.begin(), live.end(), [&](RangeAllocator::Handle a, RangeAllocator::Handle b) {
+      return ranges.Offset(a) < ranges.Offset(b);
+    });
+    uint64_t end = 0, used = 0;
+    for (RangeAllocator::Handle h : live) {
+      if (ranges.Offset(h) < end) {
+        return false;
+      }
+      end = ranges.Offset(h) + ranges.Size(h);
+      used += ranges.Size(h);
+    }
+    return end <= ranges.Capacity() && used + ranges.FreeSize() == ranges.Capacity() &&
+           ranges.AllocationCount() == live.size();
+  }
+
+  // Churns a geometry-arena-sized allocator with log-uniform mesh sizes until
+  // it splinters, with and without compacting when an allocation fails.
+  void BenchmarkRangeAllocator(ostream &out) {
+    const uint64_t capacity = 1 << 22;
+    const int churn = 200000;
+    out << "RangeAllocator, " << (capacity >> 20) << "M units, " << churn << " free/allocate pairs\n";
+    for (bool compact : { false, true }) {
+      mt19937 rng(77);
+      uniform_real_distribution<double> logSize(log(16.0), log(16384.0));
+      auto randomSize = [&]() { return static_cast<uint64_t>(exp(logSize(rng))); };
+      RangeAllocator ranges(capacity);
+      vector<RangeAllocator::Handle> live;
+      // Fill to roughly 90% before churning.
+      while (ranges.Capacity() - ranges.FreeSize() < capacity * 9 / 10) {
+        live.push_back(ranges.Allocate(randomSize()));
+      }
+
+      int failures = 0, defrags = 0;
+      bool compacted = true;
+      uint64_t movedUnits = 0;
+      double fragmentation = 0.0, defragSeconds = 0.0;
+      auto start = Clock::now();
+      for (int i = 0; i < churn; i++) {
+        size_t victim = uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+        ranges.Free(live[victim]);
+        live[victim] = live.back();
+        live.pop_back();
+
+        uint64_t size = randomSize();
+        RangeAllocator::Handle h = ranges.Allocate(size);
+        if (h == RangeAllocator::InvalidHandle && compact && ranges.FreeSize() >= size) {
+          auto defragStart = Clock::now();
+          for (const RangeAllocator::Move &move : ranges.Defragment()) {
+            movedUnits += move.Size;
+          }
+          defragSeconds += SecondsSince(defragStart);
+          compacted = compacted && ranges.FreeRangeCount() <= 1;
+          defrags++;
+          h = ranges.Allocate(size);
+        }
+        if (h == RangeAllocator::InvalidHandle) {
+          failures++;
+        } else {
+          live.push_back(h);
+        }
+        fragmentation += ranges.Fragmentation();
+      }
+      double seconds = SecondsSince(start) - defragSeconds;
+      out << (compact ? "  compact on failure" : "  never compact     ")
+          << "  failed " << setw(6) << failures
+          << "  defrags " << setw(4) << defrags
+          << "  moved/defrag " << setw(8) << (defrags ? movedUnits / defrags : 0)
+          << "  avg frag " << setw(5) << fixed << setprecision(3) << fragmentation / churn
+          << "  free ranges " << setw(5) << ranges.FreeRangeCount()
+          << "  Mops/s " << setw(6) << setprecision(2) << 2.0 * churn / seconds / 1e6
+          << "  defrag ms " << setw(6) << (defrags ? 1000.0 * defragSeconds / defrags : 0.0)
+          << "  " << Check(compacted && ValidRanges(ranges, live), "ranges ok", "RANGES CORRUPT") << "\n";
+    }
+  }
+
+  // Builds a frame's draw list from (mesh, submesh) references, once through
+  // the string-keyed map MeshGeometry::DrawArgs used to be and once through
+  // dense submesh handles.
+  void BenchmarkDrawListBuild(ostream &out) {
+    const int meshCount = 16, submeshesPerMesh = 64, drawCount = 50000, frames = 20;
+    mt19937 rng(11);
+    vector<MeshGeometry> meshes(meshCount);
+    vector<unordered_map<string, SubmeshGeometry>> drawArgs(meshCount);
+    for (int m = 0; m < meshCount; m++) {
+      for (int s = 0; s < submeshesPerMesh; s++) {
+        SubmeshGeometry submesh;
+        submesh.IndexCount = 36 + rng() % 3000;
+        submesh.StartIndexLocation = rng() % 100000;
+        submesh.BaseVertexLocation = rng() % 50000;
+        string name = "mesh" + to_string(m) + "_submesh" + to_string(s);
+        meshes[m].AddSubmesh(name, submesh);
+        drawArgs[m][name] = submesh;
+      }
+    }
+
+    struct Draw { int Mesh; string Name; MeshGeometry::SubmeshHandle Handle; };
+    vector<Draw> draws(drawCount);
+    for (Draw &draw : draws) {
+      draw.Mesh = rng() % meshCount;
+      draw.Name = "mesh" + to_string(draw.Mesh) + "_submesh" + to_string(rng() % submeshesPerMesh);
+      draw.Handle = meshes[draw.Mesh].FindSubmesh(draw.Name);
+    }
+
+    struct DrawArgs { UINT IndexCount, StartIndexLocation; INT BaseVertexLocation; };
+    vector<DrawArgs> list;
+    list.reserve(drawCount);
+    out << "Draw list build, " << drawCount << " draws\n";
+    for (bool handles : { false, true }) {
+      uint64_t checksum = 0;
+      auto start = Clock::now();
+      for (int f = 0; f < frames; f++) {
+        list.clear();
+        for (Draw &draw : draws) {
+          const SubmeshGeometry &sub = handles ? meshes[draw.Mesh].Submesh(draw.Handle) : drawArgs[draw.Mesh][draw.Name];
+          list.push_back({ sub.IndexCount, sub.StartIndexLocation, sub.BaseVertexLocation });
+        }
+        checksum += list.back().IndexCount + list.front().StartIndexLocation;
+      }
+      double seconds = SecondsSince(start);
+      out << (handles ? "  submesh handles " : "  string map      ")
+          << "  ms/frame " << setw(7) << fixed << setprecision(3) << 1000.0 * seconds / frames
+          << "  ns/draw " << setw(6) << setprecision(1) << 1e9 * seconds / (frames * drawCount)
+          << "  checksum " << checksum << "\n";
+    }
+  }
+
+  // Records a draw list the way Rasterizer::RecordDraws does, into in-memory
+  // recorders: serially, then split over 1..N threads by ParallelRecorder.
+  // The concatenated chunks must reproduce the serial draws in order.
+  void BenchmarkCommandRecording(ostream &out) {
+    const unsigned int drawCount = 100000, minDrawsPerChunk = 256;
+    const int frames = 20;
+    struct Draw { uint64_t Constants; uint32_t IndexCount, StartIndex; int32_t BaseVertex; };
+    mt19937 rng(5);
+    vector<Draw> draws(drawCount);
+    for (unsigned int i = 0; i < drawCount; i++) {
+      draws[i] = { 0x10000 + 256ull * i, static_cast<uint32_t>(36 + rng() % 3000), static_cast<uint32_t>(rng() % 100000),
+                   static_cast<int32_t>(rng() % 50000) };
+    }
+    auto record = [&](CommandRecorder &recorder, unsigned int first, unsigned int count) {
+      recorder.SetPipelineState(1);
+      recorder.SetVertexBuffer(0x1000, 1 << 20, sizeof(Vertex));
+      recorder.SetIndexBuffer(0x2000, 1 << 20, 2);
+      for (unsigned int i = first; i < first + count; i++) {
+        recorder.SetConstantBuffer(0, draws[i].Constants);
+        recorder.DrawIndexed(draws[i].IndexCount, 1, draws[i].StartIndex, draws[i].BaseVertex, 0);
+      }
+    };
+    auto drawCommands = [](const vector<MemoryCommandRecorder::Command> &commands, vector<MemoryCommandRecorder::Command> &into) {
+      for (const MemoryCommandRecorder::Command &c : commands) {
+        if (c.Kind == MemoryCommandRecorder::Type::SetConstantBuffer || c.Kind == MemoryCommandRecorder::Type::DrawIndexed) {
+          into.push_back(c);
+        }
+      }
+    };
+
+    MemoryCommandRecorder serial;
+    auto start = Clock::now();
+    for (int f = 0; f < frames; f++) {
+      serial.Clear();
+      record(serial, 0, drawCount);
+    }
+    double serialSeconds = SecondsSince(start);
+    vector<MemoryCommandRecorder::Command> expected;
+    drawCommands(serial.Commands(), expected);
+
+    out << "Command recording, " << drawCount << " draws\n";
+    out << "  serial      ms/frame " << setw(7) << fixed << setprecision(3) << 1000.0 * serialSeconds / frames
+        << "  Mdraws/s " << setw(6) << setprecision(1) << drawCount * frames / serialSeconds / 1e6 << "\n";
+    unsigned int maxThreads = max(1u, thread::hardware_concurrency());
+    for (unsigned int threads = 1; ; threads = min(threads * 2, maxThreads)) {
+      JobSystem jobs(threads);
+      ParallelRecorder parallel(jobs, minDrawsPerChunk);
+      vector<MemoryCommandRecorder> recorders(threads);
+      size_t chunkCount = 0;
+      start = Clock::now();
+      for (int f = 0; f < frames; f++) {
+        chunkCount = parallel.Record(drawCount, threads, [&](unsigned int index, const ParallelRecorder::Chunk &chunk) {
+          recorders[index].Clear();
+          record(recorders[index], chunk.First, chunk.Count);
+        }).size();
+      }
+      double seconds = SecondsSince(start);
+      vector<MemoryCommandRecorder::Command> recorded;
+      for (size_t i = 0; i < chunkCount; i++) {
+        drawCommands(recorders[i].Commands(), recorded);
+      }
+      out << "  " << setw(2) << threads << " threads  ms/frame " << setw(7) << setprecision(3) << 1000.0 * seconds / frames
+          << "  Mdraws/s " << setw(6) << setprecision(1) << drawCount * frames / seconds / 1e6
+          << "  chunks " << setw(2) << chunkCount
+          << "  order " << Check(recorded == expected, "ok", "MISMATCH") << "\n";
+      if (threads == maxThreads) {
+        break;
+      }
+    }
+  }
+
+  // Spawns a tree of jobs from inside jobs, fanout children per level.
+  void SpawnTree(JobSystem &jobs, JobSystem::Counter &counter, atomic<int> &executed, int depth, int fanout) {
+    executed++;
+    if (depth == 0) {
+      return;
+    }
+    for (int i = 0; i < fanout; i++) {
+      jobs.Run([&jobs, &counter, &executed, depth, fanout] {
+        SpawnTree(jobs, counter, executed, depth - 1, fanout);
+      }, &counter);
+    }
+  }
+
+  // Scaling of ParallelFor and of tiny jobs over 1..N threads, then stress
+  // rounds of nested spawning and RunAfter chains that must finish exactly.
+  void BenchmarkJobSystem(ostream &out) {
+    const unsigned int elements = 1 << 20, grain = 4096, tinyJobs = 200000;
+    vector<float> data(elements);
+    unsigned int maxThreads = max(1u, thread::hardware_concurrency());
+    out << "JobSystem\n";
+    double baseSeconds = 0.0;
+    for (unsigned int threads = 1; ; threads = min(threads * 2, maxThreads)) {
+      JobSystem jobs(threads);
+      auto start = Clock::now();
+      for (int r = 0; r < 10; r++) {
+        jobs.ParallelFor(elements, grain, [&](unsigned int i) {
+          float x = static_cast<float>(i) + r;
+          data[i] = sqrtf(x) * sinf(x) + cosf(x * 0.5f);
+        });
+      }
+      double forSeconds = SecondsSince(start) / 10;
+      if (threads == 1) {
+        baseSeconds = forSeconds;
+      }
+
+      JobSystem::Counter counter;
+      atomic<unsigned int> sum{ 0 };
+      start = Clock::now();
+      for (unsigned int i = 0; i < tinyJobs; i++) {
+        jobs.Run([&sum] { sum.fetch_add(1, memory_order_relaxed); }, &counter);
+      }
+      jobs.Wait(counter);
+      double tinySeconds = SecondsSince(start);
+
+      out << "  " << setw(2) << threads << " threads  ParallelFor ms " << setw(7) << fixed << setprecision(3) << 1000.0 * forSeconds
+          << "  speedup " << setw(5) << setprecision(2) << baseSeconds / forSeconds
+          << "  tiny jobs M/s " << setw(6) << tinyJobs / tinySeconds / 1e6
+          << "  stolen " << setw(7) << jobs.GetStats().Stolen
+          << Check(sum == tinyJobs, "", "  LOST JOBS") << "\n";
+      if (threads == maxThreads) {
+        break;
+      }
+    }
+
+    // Contention: every thread spawns and steals at once, and continuations
+    // race with the last job of the counter they wait on.
+    const int rounds = 20, depth = 7, fanout = 4, chain = 1000;
+    int expectedTree = 0;
+    for (int d = 0, level = 1; d <= depth; d++, level *= fanout) {
+      expectedTree += level;
+    }
+    JobSystem jobs(max(4u, maxThreads));
+    bool ok = true;
+    auto start = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+      JobSystem::Counter tree;
+      atomic<int> executed{ 0 };
+      jobs.Run([&] { SpawnTree(jobs, tree, executed, depth, fanout); }, &tree);
+      jobs.Wait(tree);
+      ok = ok && executed == expectedTree;
+
+      vector<unique_ptr<JobSystem::Counter>> stages;
+      vector<int> order;
+      stages.push_back(make_unique<JobSystem::Counter>());
+      jobs.Run([&order] { order.push_back(0); }, stages.back().get());
+      for (int k = 1; k < chain; k++) {
+        stages.push_back(make_unique<JobSystem::Counter>());
+        jobs.RunAfter(*stages[k - 1], [&order, k] { order.push_back(k); }, stages.back().get());
+      }
+      jobs.Wait(*stages.back());
+      for (int k = 0; k < chain; k++) {
+        ok = ok && order.size() == static_cast<size_t>(chain) && order[k] == k;
+      }
+    }
+    double stressSeconds = SecondsSince(start);
+
+    // A throwing job still finishes its counter; the exception reaches the
+    // waiter once every other job is done.
+    const unsigned int throwCount = 64 * 1024, throwGrain = 1024;
+    atomic<unsigned int> calls{ 0 };
+    bool rethrown = false;
+    try {
+      jobs.ParallelFor(throwCount, throwGrain, [&calls](unsigned int i) {
+        if (i == throwGrain * 5) {
+          throw runtime_error("job failed");
+        }
+        calls++;
+      });
+    } catch (runtime_error &) {
+      rethrown = true;
+    }
+    JobSystem::Counter failed;
+    jobs.Run([] { throw runtime_error("job failed"); }, &failed);
+    bool waitRethrown = false;
+    try {
+      jobs.Wait(failed);
+    } catch (runtime_error &) {
+      waitRethrown = true;
+    }
+    jobs.Wait(failed);
+    ok = ok && rethrown && waitRethrown && calls == throwCount - throwGrain;
+
+    // A thread outside the system only helps with what it waits on: the
+    // creator's queued job must still be there for the creator to run.
+    {
+      JobSystem single(1);
+      JobSystem::Counter creatorJob;
+      thread::id ranOn;
+      single.Run([&ranOn] { ranOn = this_thread::get_id(); }, &creatorJob);
+      thread outside([&single] {
+        JobSystem::Counter own;
+        single.Run([] {}, &own);
+        single.Wait(own);
+      });
+      outside.join();
+      bool untouched = !creatorJob.Done();
+      single.Wait(creatorJob);
+      ok = ok && untouched && ranOn == this_thread::get_id();
+    }
+
+    out << "  stress " << jobs.ThreadCount() << " threads, " << rounds << " rounds of " << expectedTree
+        << " nested jobs and a " << chain << "-job chain, then throwing jobs  ms " << setw(8) << setprecision(2) << 1000.0 * stressSeconds
+        << "  " << Check(ok, "ok", "FAILED") << "\n";
+  }
+
+  // Packs random instances of a few hundred meshes into per-mesh runs, with
+  // InstancePacker's counting sort and with a stable comparison sort.
+  void BenchmarkInstancePacking(ostream &out) {
+    const uint32_t keyCount = 256;
+    const int repeats = 5;
+    out << "Instance packing, " << keyCount << " meshes\n";
+    for (uint32_t instanceCount : { 100000u, 1000000u }) {
+      mt19937 rng(9);
+      vector<uint32_t> keys(instanceCount);
+      vector<XMFLOAT4X4> worlds(instanceCount);
+      for (uint32_t i = 0; i < instanceCount; i++) {
+        keys[i] = rng() % keyCount;
+        XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(static_cast<float>(i), 0.0f, static_cast<float>(keys[i])));
+      }
+
+      InstancePacker packer;
+      vector<InstanceData> packed(instanceCount);
+      double packSeconds = 0.0;
+      for (int r = 0; r < repeats; r++) {
+        auto start = Clock::now();
+        packer.Clear();
+        for (uint32_t i = 0; i < instanceCount; i++) {
+          packer.Add(keys[i], worlds[i]);
+        }
+        packer.Pack(packed.data());
+        packSeconds += SecondsSince(start);
+      }
+
+      vector<uint32_t> order(instanceCount);
+      vector<InstanceData> sorted(instanceCount);
+      double sortSeconds = 0.0;
+      for (int r = 0; r < repeats; r++) {
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < instanceCount; i++) {
+          order[i] = i;
+        }
+        stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+        for (uint32_t i = 0; i < instanceCount; i++) {
+          sorted[i].World = worlds[order[i]];
+        }
+        sortSeconds += SecondsSince(start);
+      }
+      bool same = memcmp(packed.data(), sorted.data(), instanceCount * sizeof(InstanceData)) == 0;
+
+      out << "  " << setw(7) << instanceCount << " instances  draws " << setw(3) << packer.Batches().size()
+          << "  counting sort ms " << setw(7) << fixed << setprecision(3) << 1000.0 * packSeconds / repeats
+          << "  stable_sort ms " << setw(8) << 1000.0 * sortSeconds / repeats
+          << "  M instances/s " << setw(6) << setprecision(1) << instanceCount * repeats / packSeconds / 1e6
+          << "  " << Check(same, "same order", "MISMATCH") << "\n";
+    }
+  }
+
+  // Sorts 1M draw keys with RadixSorter and with std::sort, for uniformly
+  // random keys and for keys built from a few pipelines and meshes, and counts
+  // the pipeline and mesh changes a recorder would issue before and after.
+  void BenchmarkDrawSort(ostream &out) {
+    const size_t count = 1000000;
+    const int repeats = 5;
+    mt19937_64 rng(15);
+    uniform_real_distribution<float> depth(0.0f, 1.0f);
+    vector<RadixSorter::Item> random(count), draws(count);
+    for (size_t i = 0; i < count; i++) {
+      random[i] = { rng(), static_cast<uint32_t>(i) };
+      draws[i] = { DrawSortKey::Make(static_cast<uint32_t>(rng() % 2), static_cast<uint32_t>(rng() % 32),
+        static_cast<uint32_t>(rng() % 512), static_cast<uint32_t>(rng() % 64), depth(rng)), static_cast<uint32_t>(i) };
+    }
+    auto stateChanges = [](const vector<RadixSorter::Item> &items, size_t &pipelines, size_t &meshes) {
+      pipelines = meshes = 0;
+      for (size_t i = 0; i < items.size(); i++) {
+        pipelines += i == 0 || DrawSortKey::Pipeline(items[i].Key) != DrawSortKey::Pipeline(items[i - 1].Key) ||
+          DrawSortKey::RootSignature(items[i].Key) != DrawSortKey::RootSignature(items[i - 1].Key);
+        meshes += i == 0 || DrawSortKey::Mesh(items[i].Key) != DrawSortKey::Mesh(items[i - 1].Key);
+      }
+    };
+
+    out << "Draw key sort, " << count << " keys\n";
+    const struct { const char *Name; const vector<RadixSorter::Item> *Items; } inputs[] = {
+      { "random keys", &random }, { "draw keys  ", &draws }
+    };
+    for (const auto &input : inputs) {
+      RadixSorter sorter;
+      vector<RadixSorter::Item> radixed, sorted;
+      double radixSeconds = 0.0, sortSeconds = 0.0;
+      for (int r = 0; r < repeats; r++) {
+        radixed = *input.Items;
+        auto start = Clock::now();
+        sorter.Sort(radixed);
+        radixSeconds += SecondsSince(start);
+
+        sorted = *input.Items;
+        start = Clock::now();
+        stable_sort(sorted.begin(), sorted.end(), [](const RadixSorter::Item &a, const RadixSorter::Item &b) { return a.Key < b.Key; });
+        sortSeconds += SecondsSince(start);
+      }
+      vector<RadixSorter::Item> unstable = *input.Items;
+      auto start = Clock::now();
+      sort(unstable.begin(), unstable.end(), [](const RadixSorter::Item &a, const RadixSorter::Item &b) { return a.Key < b.Key; });
+      double unstableSeconds = SecondsSince(start);
+      bool same = equal(radixed.begin(), radixed.end(), sorted.begin(), [](const RadixSorter::Item &a, const RadixSorter::Item &b) {
+        return a.Key == b.Key && a.Value == b.Value;
+      });
+      out << "  " << input.Name << "  radix ms " << setw(7) << fixed << setprecision(2) << 1000.0 * radixSeconds / repeats
+          << " (" << sorter.LastPassCount() << " passes)"
+          << "  std::sort ms " << setw(7) << 1000.0 * unstableSeconds
+          << "  std::stable_sort ms " << setw(7) << 1000.0 * sortSeconds / repeats
+          << "  " << Check(same, "same order", "MISMATCH") << "\n";
+      if (input.Items == &draws) {
+        size_t pipelinesBefore, meshesBefore, pipelinesAfter, meshesAfter;
+        stateChanges(draws, pipelinesBefore, meshesBefore);
+        stateChanges(radixed, pipelinesAfter, meshesAfter);
+        out << "  state changes  pipeline " << pipelinesBefore << " -> " << pipelinesAfter
+            << "  mesh " << meshesBefore << " -> " << meshesAfter << "\n";
+      }
+    }
+  }
+
+  // State a command stream leaves in effect at each draw, hashed, so a
+  // filtered stream can be checked against the unfiltered one.
+  vector<uint64_t> StateAtDraws(const vector<MemoryCommandRecorder::Command> &commands) {
+    typedef CommandRecorder::Type Type;
+    const int slots = StateFilterRecorder::TrackedRootSlots;
+    vector<MemoryCommandRecorder::Command> state(static_cast<int>(Type::Count) + 2 * slots);
+    vector<uint64_t> hashes;
+    for (const MemoryCommandRecorder::Command &c : commands) {
+      int kind = static_cast<int>(c.Kind);
+      switch (c.Kind) {
+        case Type::SetRootSignature:
+          for (int i = 0; i < 2 * slots; i++) {
+            state[static_cast<int>(Type::Count) + i] = {};
+          }
+          state[kind] = c;
+          break;
+        case Type::SetConstantBuffer:
+          state[static_cast<int>(Type::Count) + c.Args[0]] = c;
+          break;
+        case Type::SetShaderResource:
+          state[static_cast<int>(Type::Count) + slots + c.Args[0]] = c;
+          break;
+        case Type::DrawIndexed: {
+          uint64_t hash = 14695981039346656037ull;
+          const unsigned char *bytes = reinterpret_cast<const unsigned char*>(state.data());
+          for (size_t i = 0; i < state.size() * sizeof(MemoryCommandRecorder::Command); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+          }
+          hashes.push_back(hash ^ c.Args[0]);
+          break;
+        }
+        default:
+          state[kind] = c;
+      }
+    }
+    return hashes;
+  }
+
+  // Records a sorted 100k-draw list that sets all of each draw's state, as
+  // Rasterizer::RecordDraws does, straight into a recorder and through a
+  // StateFilterRecorder.
+  void BenchmarkStateFilter(ostream &out) {
+    const unsigned int drawCount = 100000;
+    const int frames = 10;
+    mt19937_64 rng(16);
+    vector<RadixSorter::Item> keys(drawCount);
+    for (unsigned int i = 0; i < drawCount; i++) {
+      keys[i] = { DrawSortKey::Make(0, static_cast<uint32_t>(rng() % 16), static_cast<uint32_t>(rng() % 256), 0, 0.5f), i };
+    }
+    RadixSorter().Sort(keys);
+
+    auto record = [&](CommandRecorder &recorder) {
+      recorder.SetRootSignature(0x100);
+      recorder.SetPrimitiveTopology(4);
+      recorder.SetViewport({ 0.0f, 0.0f, 1024.0f, 768.0f, 0.0f, 1.0f });
+      recorder.SetScissorRect({ 0, 0, 1024, 768 });
+      for (const RadixSorter::Item &key : keys) {
+        uint32_t mesh = DrawSortKey::Mesh(key.Key);
+        recorder.SetPipelineState(0x1000 + DrawSortKey::Pipeline(key.Key));
+        recorder.SetVertexBuffer(0x200000, 1 << 22, sizeof(Vertex));
+        recorder.SetIndexBuffer(0x600000, 1 << 21, 2);
+        recorder.SetConstantBuffer(0, 0x10000);
+        recorder.SetShaderResource(1, 0x800000 + 64ull * key.Value);
+        recorder.DrawIndexed(36, 1, mesh * 36, mesh * 8, 0);
+      }
+    };
+
+    MemoryCommandRecorder direct, filtered;
+    StateFilterRecorder filter(filtered);
+    double directSeconds = 0.0, filterSeconds = 0.0;
+    for (int f = 0; f < frames; f++) {
+      direct.Clear();
+      auto start = Clock::now();
+      record(direct);
+      directSeconds += SecondsSince(start);
+
+      filtered.Clear();
+      filter.Reset();
+      filter.ResetStats();
+      start = Clock::now();
+      record(filter);
+      filterSeconds += SecondsSince(start);
+    }
+    const StateFilterRecorder::Stats &stats = filter.GetStats();
+    bool same = StateAtDraws(direct.Commands()) == StateAtDraws(filtered.Commands());
+    out << "State filter, " << drawCount << " sorted draws\n"
+        << "  commands " << direct.Commands().size() << " -> " << filtered.Commands().size()
+        << "  (pipeline " << stats.Issued[static_cast<int>(CommandRecorder::Type::SetPipelineState)]
+        << ", vertex buffer " << stats.Issued[static_cast<int>(CommandRecorder::Type::SetVertexBuffer)]
+        << ", constants " << stats.Issued[static_cast<int>(CommandRecorder::Type::SetConstantBuffer)] << " issued)"
+        << "  filter ms " << setw(6) << fixed << setprecision(2) << 1000.0 * filterSeconds / frames
+        << "  direct ms " << setw(6) << 1000.0 * directSeconds / frames
+        << "  " << Check(same, "same state at every draw", "STATE MISMATCH") << "\n";
+  }
+
+  // Stands in for a real compiler: bytecode derived from the sources and
+  // defines, after sleeping for a fixed time. A BROKEN define fails to compile.
+  class StubShaderCompiler : public ShaderCompiler {
+  public:
+    explicit StubShaderCompiler(double seconds) : mSeconds(seconds) {}
+
+    std::string Version() const override { return "stub 1"; }
+
+    std::vector<uint8_t> Compile(const ShaderDesc &desc) override {
+      mCompiles++;
+      this_thread::sleep_for(chrono::duration<double>(mSeconds));
+      uint64_t hash = Fnv1a::Hash(desc.EntryPoint);
+      for (const ShaderDefine &define : desc.Defines) {
+        if (define.Name == "BROKEN") {
+          throw runtime_error(desc.Path + ": BROKEN is defined");
+        }
+        hash = Fnv1a::Hash(define.Name + "=" + define.Value, hash);
+      }
+      ifstream file(desc.Path, ios::binary);
+      string source((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+      hash = Fnv1a::Hash(source, hash);
+      vector<uint8_t> bytecode(4096);
+      for (size_t i = 0; i < bytecode.size(); i++) {
+        bytecode[i] = static_cast<uint8_t>(hash >> (8 * (i % 8)));
+      }
+      return bytecode;
+    }
+
+    atomic<int> mCompiles{ 0 };
+
+  private:
+    double mSeconds;
+  };
+
+  // Loads 16 permutations of a shader that includes a header: cold, warm, and
+  // after the header changes. The cache lives in the working directory.
+  void BenchmarkShaderCache(ostream &out) {
+    const double compileSeconds = 0.02;
+    const char *header = "bench_shader_common.hlsli";
+    const char *source = "bench_shader.hlsl";
+    ofstream(header) << "float4 Tint() { return float4(1, 1, 1, 1); }\n";
+    ofstream(source) << "#include \"" << header << "\"\nfloat4 PS() : SV_Target { return Tint(); }\n";
+
+    vector<ShaderDesc> descs;
+    for (int i = 0; i < 16; i++) {
+      ShaderDesc desc;
+      desc.Path = source;
+      desc.EntryPoint = "PS";
+      desc.Target = "ps_5_0";
+      for (int bit = 0; bit < 4; bit++) {
+        if (i & (1 << bit)) {
+          desc.Defines.push_back({ "FEATURE_" + to_string(bit), "1" });
+        }
+      }
+      descs.push_back(desc);
+    }
+
+    StubShaderCompiler compiler(compileSeconds);
+    ShaderCache cache(compiler, "");
+    vector<vector<uint8_t>> cold, warm;
+    auto start = Clock::now();
+    for (const ShaderDesc &desc : descs) {
+      cold.push_back(cache.Load(desc));
+    }
+    double coldSeconds = SecondsSince(start);
+    start = Clock::now();
+    for (const ShaderDesc &desc : descs) {
+      warm.push_back(cache.Load(desc));
+    }
+    double warmSeconds = SecondsSince(start);
+    int compilesBeforeEdit = compiler.mCompiles.load();
+
+    vector<uint64_t> oldKeys;
+    for (const ShaderDesc &desc : descs) {
+      oldKeys.push_back(cache.Key(desc));
+    }
+    ofstream(header) << "float4 Tint() { return float4(1, 0, 0, 1); }\n";
+    start = Clock::now();
+    for (const ShaderDesc &desc : descs) {
+      cache.Load(desc);
+    }
+    double editSeconds = SecondsSince(start);
+    int compilesAfterEdit = compiler.mCompiles.load();
+
+    // A corrupt file is a miss that gets rewritten, so the next run hits.
+    ofstream(cache.PathFor(cache.Key(descs[0])), ios::binary | ios::trunc) << "corrupt";
+    vector<uint8_t> rewritten = cache.Load(descs[0]);
+    StubShaderCompiler reopenedCompiler(0.0);
+    ShaderCache reopened(reopenedCompiler, "");
+    bool rewrote = reopened.Load(descs[0]) == rewritten && reopenedCompiler.mCompiles == 0;
+
+    for (const ShaderDesc &desc : descs) {
+      remove(cache.PathFor(cache.Key(desc)).c_str());
+    }
+    for (uint64_t key : oldKeys) {
+      remove(cache.PathFor(key).c_str());
+    }
+    remove(source);
+    remove(header);
+
+    ShaderCache::Stats stats = cache.GetStats();
+    out << "Shader cache, " << descs.size() << " permutations, stub compile " << static_cast<int>(1000.0 * compileSeconds) << " ms\n"
+        << "  cold ms " << setw(7) << fixed << setprecision(2) << 1000.0 * coldSeconds
+        << "  warm ms " << setw(6) << 1000.0 * warmSeconds
+        << "  after include edit ms " << setw(7) << 1000.0 * editSeconds
+        << "  compiles " << compilesBeforeEdit << " + " << compilesAfterEdit - compilesBeforeEdit
+        << "  hits " << stats.Hits
+        << "  " << Check(cold == warm, "same bytecode", "BYTECODE MISMATCH")
+        << "  " << Check(rewrote, "corrupt file rewritten", "CORRUPT FILE KEPT") << "\n";
+  }
+
+  // Loads the 8 variants of a shader with 3 features, each compile sleeping
+  // 20 ms, on job systems of increasing size. Three threads request every
+  // variant to check that each compiles once.
+  void BenchmarkShaderPermutations(ostream &out) {
+    const double compileSeconds = 0.02;
+    const char *source = "bench_permutations.hlsl";
+    ofstream(source) << "float4 PS() : SV_Target { return 1; }\n";
+    ShaderDesc base;
+    base.Path = source;
+    base.EntryPoint = "PS";
+    base.Target = "ps_5_0";
+    const vector<string> features = { "INSTANCED", "VERTEX_COLOR", "MSAA" };
+
+    out << "Shader permutations, " << (1 << features.size()) << " variants, stub compile "
+        << static_cast<int>(1000.0 * compileSeconds) << " ms\n";
+    for (unsigned int threads : { 1u, 2u, 4u, 8u }) {
+      StubShaderCompiler compiler(compileSeconds);
+      ShaderCache cache(compiler, "");
+      JobSystem jobs(threads);
+      double fallbackSeconds, allSeconds;
+      ShaderPermutations::Stats stats;
+      bool same = true;
+      {
+        ShaderPermutations permutations(cache, jobs, base, features);
+        for (ShaderPermutations::Mask mask = 0; mask < permutations.VariantCount(); mask++) {
+          remove(cache.PathFor(cache.Key(permutations.Desc(mask))).c_str());
+        }
+        auto start = Clock::now();
+        vector<thread> clients;
+        for (int c = 0; c < 3; c++) {
+          clients.emplace_back([&permutations] {
+            for (ShaderPermutations::Mask mask = permutations.VariantCount() - 1; mask > 0; mask--) {
+              permutations.Request(mask);
+            }
+          });
+        }
+        for (thread &t : clients) {
+          t.join();
+        }
+        // The fallback is requested last, as the renderer does with the
+        // variants it cannot start without.
+        permutations.Get(0);
+        fallbackSeconds = SecondsSince(start);
+        for (ShaderPermutations::Mask mask = 0; mask < permutations.VariantCount(); mask++) {
+          permutations.Get(mask);
+        }
+        allSeconds = SecondsSince(start);
+        stats = permutations.GetStats();
+        for (ShaderPermutations::Mask mask = 0; mask < permutations.VariantCount(); mask++) {
+          same = same && permutations.Get(mask) == compiler.Compile(permutations.Desc(mask));
+        }
+        for (ShaderPermutations::Mask mask = 0; mask < permutations.VariantCount(); mask++) {
+          remove(cache.PathFor(cache.Key(permutations.Desc(mask))).c_str());
+        }
+      }
+      out << "  threads " << setw(2) << threads
+          << "  fallback ms " << setw(7) << fixed << setprecision(2) << 1000.0 * fallbackSeconds
+          << "  all ms " << setw(7) << 1000.0 * allSeconds
+          << "  requests " << stats.Requests << "  compiles " << stats.Started
+          << "  " << Check(same, "bytecode ok", "BYTECODE MISMATCH")
+          << Check(stats.Started == 1u << features.size(), "", "  COMPILED TWICE") << "\n";
+    }
+
+    // A variant that does not compile rethrows from Get() and leaves the
+    // fallback usable.
+    {
+      StubShaderCompiler compiler(0.0);
+      ShaderCache cache(compiler, "");
+      JobSystem jobs(2);
+      ShaderPermutations permutations(cache, jobs, base, { "BROKEN" });
+      remove(cache.PathFor(cache.Key(permutations.Desc(0))).c_str());
+      permutations.Request(1);
+      bool threw = false;
+      try {
+        permutations.Get(1);
+      } catch (runtime_error &) {
+        threw = true;
+      }
+      bool fallback = permutations.Get(0) == compiler.Compile(permutations.Desc(0));
+      remove(cache.PathFor(cache.Key(permutations.Desc(0))).c_str());
+      out << "  broken variant " << Check(threw && fallback, "rethrown, fallback ok", "NOT ISOLATED") << "\n";
+    }
+    remove(source);
+  }
+
+  // The renderer's opaque pipeline, in D3D12 enum values.
+  PipelineDesc OpaquePipeline() {
+    PipelineDesc desc;
+    desc.RootSignature = 0x5157;
+    desc.Shaders[PipelineDesc::VS] = 0x1111;
+    desc.Shaders[PipelineDesc::PS] = 0x2222;
+    desc.InputLayout = {
+      { "POSITION", 0, 6, 0, 0, 0, 0 },   // R32G32B32_FLOAT
+      { "COLOR", 0, 2, 0, 12, 0, 0 }      // R32G32B32A32_FLOAT
+    };
+    desc.FillMode = 3;                    // SOLID
+    desc.CullMode = 3;                    // BACK
+    desc.DepthClipEnable = 1;
+    for (PipelineDesc::RenderTargetBlend &blend : desc.Blend) {
+      blend = { 0, 0, 2, 1, 1, 2, 1, 1, 5, 0xf };
+    }
+    desc.SampleMask = 0xffffffff;
+    desc.DepthEnable = 1;
+    desc.DepthWriteMask = 1;
+    desc.DepthFunc = 2;                   // LESS
+    desc.StencilReadMask = desc.StencilWriteMask = 0xff;
+    desc.FrontFace = desc.BackFace = { 1, 1, 1, 8 };
+    desc.PrimitiveTopologyType = 3;       // TRIANGLE
+    desc.NumRenderTargets = 1;
+    desc.RTVFormats[0] = 28;              // R8G8B8A8_UNORM
+    desc.DSVFormat = 45;                  // D24_UNORM_S8_UINT
+    return desc;
+  }
+
+  // Checks that descs written differently but creating the same pipeline
+  // share a key and that real changes do not, then times building keys and
+  // looking them up.
+  void BenchmarkPipelineKeys(ostream &out) {
+    const PipelineDesc base = OpaquePipeline();
+    const PipelineKey baseKey(base);
+
+    vector<PipelineDesc> same(6, base);
+    same[0].InputLayout[0].SemanticName = "position";
+    same[0].InputLayout[1].AlignedByteOffset = PipelineDesc::AppendAligned;
+    same[1].RTVFormats[3] = 2;
+    same[1].Blend[5].BlendEnable = 1;
+    same[2].Blend[0].SrcBlend = 5;
+    same[2].Blend[0].BlendOp = 3;
+    same[3].FrontFace.PassOp = 3;
+    same[3].BackFace.Func = 4;
+    same[4].SampleMask = 1;
+    same[5].DepthBiasClamp = -0.0f;
+    same[5].InputLayout[1].InstanceDataStepRate = 1;
+
+    vector<PipelineDesc> different(6, base);
+    different[0].CullMode = 1;
+    different[1].RTVFormats[0] = 87;
+    different[2].Shaders[PipelineDesc::VS] = 0x1112;
+    different[3].Blend[0].BlendEnable = 1;
+    different[4].InputLayout[1].AlignedByteOffset = 16;
+    different[5].SampleCount = 4;
+
+    int matched = 0, differed = 0;
+    for (const PipelineDesc &desc : same) {
+      matched += PipelineKey(desc) == baseKey ? 1 : 0;
+    }
+    for (const PipelineDesc &desc : different) {
+      differed += PipelineKey(desc) != baseKey ? 1 : 0;
+    }
+
+    // 1024 materials: shader, cull mode and target format vary.
+    vector<PipelineDesc> descs(1024, base);
+    for (size_t i = 0; i < descs.size(); i++) {
+      descs[i].Shaders[PipelineDesc::PS] = 0x10000 + i / 8;
+      descs[i].CullMode = 1 + i % 3;
+      descs[i].RTVFormats[0] = i % 8 < 4 ? 28 : 87;
+    }
+    const int keyCount = 1000000;
+    uint64_t checksum = 0;
+    size_t words = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < keyCount; i++) {
+      PipelineKey key(descs[i % descs.size()]);
+      checksum += key.Hash();
+      words += key.Words().size();
+    }
+    double keySeconds = SecondsSince(start);
+
+    unordered_set<PipelineKey, PipelineKey::Hasher> cache;
+    vector<PipelineKey> keys;
+    for (const PipelineDesc &desc : descs) {
+      keys.emplace_back(desc);
+      cache.insert(keys.back());
+    }
+    size_t found = 0;
+    start = Clock::now();
+    for (int i = 0; i < keyCount; i++) {
+      found += cache.count(keys[(i * 7) % keys.size()]);
+    }
+    double lookupSeconds = SecondsSince(start);
+
+    out << "Pipeline keys, " << descs.size() << " descs, " << words / keyCount << " words each\n"
+        << "  equivalent forms match " << matched << "/" << same.size()
+        << "  changes differ " << differed << "/" << different.size()
+        << "  distinct keys " << cache.size()
+        << "  build ns " << setw(6) << fixed << setprecision(1) << 1e9 * keySeconds / keyCount
+        << " (" << setprecision(0) << words * sizeof(uint32_t) / keySeconds / (1 << 20) << " MB/s)"
+        << "  lookup ns " << setprecision(1) << 1e9 * lookupSeconds / keyCount
+        << Check(found == static_cast<size_t>(keyCount) && checksum != 0, "", "  LOOKUP FAILED")
+        << Check(matched == static_cast<int>(same.size()) && differed == static_cast<int>(different.size()), "", "  KEYS WRONG")
+        << "\n";
+
+    // A rejected driver blob is stored again under the same key, so a newer
+    // write must replace the file.
+    BlobStore store("", ".bench");
+    const uint8_t stale[] = { 1, 2, 3 }, fresh[] = { 4, 5, 6, 7 };
+    store.Write(baseKey.Hash(), stale, sizeof stale);
+    store.Write(baseKey.Hash(), fresh, sizeof fresh);
+    vector<uint8_t> read;
+    bool replaced = store.Read(baseKey.Hash(), read) && read == vector<uint8_t>(begin(fresh), end(fresh));
+    store.Remove(baseKey.Hash());
+    out << "  blob store " << Check(replaced, "rewrite replaces", "REWRITE KEPT OLD BLOB") << "\n";
+  }
+
+  // The usual alternative to the lock-free queues, for comparison.
+  template<typename T>
+  class MutexQueue {
+  public:
+    explicit MutexQueue(size_t capacity) : mCapacity(capacity) {}
+
+    bool TryPush(T value) {
+      lock_guard<mutex> lock(mMutex);
+      if (mItems.size() == mCapacity) {
+        return false;
+      }
+      mItems.push_back(value);
+      return true;
+    }
+
+    bool TryPop(T &value) {
+      lock_guard<mutex> lock(mMutex);
+      if (mItems.empty()) {
+        return false;
+      }
+      value = mItems.front();
+      mItems.pop_front();
+      return true;
+    }
+
+  private:
+    mutex mMutex;
+    deque<T> mItems;
+    size_t mCapacity;
+  };
+
+  // Pushes itemsPerProducer items from each producer thread and pops them all
+  // on this thread. Items carry their producer and sequence number, so lost,
+  // duplicated or reordered items are caught. Returns items per second.
+  template<typename Queue>
+  double QueueThroughput(Queue &queue, int producers, uint32_t itemsPerProducer, bool &ordered) {
+    vector<thread> threads;
+    auto start = Clock::now();
+    for (int p = 0; p < producers; p++) {
+      threads.emplace_back([&queue, p, itemsPerProducer] {
+        for (uint32_t i = 0; i < itemsPerProducer; i++) {
+          while (!queue.TryPush((static_cast<uint64_t>(p) << 32) | i)) {
+            this_thread::yield();
+          }
+        }
+      });
+    }
+    vector<uint32_t> next(producers, 0);
+    uint64_t total = static_cast<uint64_t>(producers) * itemsPerProducer;
+    ordered = true;
+    for (uint64_t received = 0; received < total;) {
+      uint64_t item;
+      if (!queue.TryPop(item)) {
+        this_thread::yield();
+        continue;
+      }
+      uint32_t producer = static_cast<uint32_t>(item >> 32);
+      ordered = ordered && producer < next.size() && static_cast<uint32_t>(item) == next[producer];
+      if (producer < next.size()) {
+        next[producer]++;
+      }
+      received++;
+    }
+    double seconds = SecondsSince(start);
+    for (thread &t : threads) {
+      t.join();
+    }
+    return total / seconds;
+  }
+
+  // Round trips of one item between two threads over a pair of queues.
+  // Returns the median and 99th percentile in nanoseconds.
+  template<typename Queue>
+  pair<double, double> QueueLatency(int trips) {
+    Queue request(16), reply(16);
+    thread echo([&] {
+      for (int i = 0; i < trips; i++) {
+        uint64_t item;
+        while (!request.TryPop(item)) {
+          this_thread::yield();
+        }
+        while (!reply.TryPush(item)) {
+          this_thread::yield();
+        }
+      }
+    });
+    vector<double> times(trips);
+    for (int i = 0; i < trips; i++) {
+      auto start = Clock::now();
+      while (!request.TryPush(i)) {
+        this_thread::yield();
+      }
+      uint64_t item;
+      while (!reply.TryPop(item)) {
+        this_thread::yield();
+      }
+      times[i] = 1e9 * SecondsSince(start);
+    }
+    echo.join();
+    sort(times.begin(), times.end());
+    return { times[trips / 2], times[trips * 99 / 100] };
+  }
+
+  // The render thread's queues: items per second with one consumer and
+  // growing numbers of producers, and round-trip latency.
+  void BenchmarkQueues(ostream &out) {
+    const uint32_t items = 1 << 21;
+    const size_t capacity = 1024;
+    const unsigned int maxThreads = max(4u, thread::hardware_concurrency());
+    out << "Queues, " << items << " items, capacity " << capacity << "\n" << fixed << setprecision(1);
+    for (int producers = 1;; producers = min(producers * 2, static_cast<int>(maxThreads))) {
+      bool lockFreeOrdered, mutexOrdered, spscOrdered = true;
+      double spsc = 0.0;
+      if (producers == 1) {
+        SpscQueue<uint64_t> queue(capacity);
+        spsc = QueueThroughput(queue, 1, items, spscOrdered);
+      }
+      MpscQueue<uint64_t> mpsc(capacity);
+      double lockFree = QueueThroughput(mpsc, producers, items / producers, lockFreeOrdered);
+      MutexQueue<uint64_t> locked(capacity);
+      double withMutex = QueueThroughput(locked, producers, items / producers, mutexOrdered);
+      out << "  producers " << setw(2) << producers;
+      if (producers == 1) {
+        out << "  spsc M/s " << setw(6) << spsc / 1e6;
+      } else {
+        out << "              ";
+      }
+      out << "  mpsc M/s " << setw(6) << lockFree / 1e6
+          << "  mutex M/s " << setw(6) << withMutex / 1e6
+          << "  " << Check(spscOrdered && lockFreeOrdered && mutexOrdered, "fifo ok", "ORDER BROKEN") << "\n";
+      if (producers == static_cast<int>(maxThreads)) {
+        break;
+      }
+    }
+    const int trips = 20000;
+    pair<double, double> spsc = QueueLatency<SpscQueue<uint64_t>>(trips);
+    pair<double, double> mpsc = QueueLatency<MpscQueue<uint64_t>>(trips);
+    pair<double, double> locked = QueueLatency<MutexQueue<uint64_t>>(trips);
+    out << "  round trip ns (median/p99)  spsc " << spsc.first << "/" << spsc.second
+        << "  mpsc " << mpsc.first << "/" << mpsc.second
+        << "  mutex " << locked.first << "/" << locked.second << "\n";
+  }
+
+  // GeometryGenerator's former Subdivide and geosphere, for comparison: six
+  // new vertices per triangle, nothing shared.
+  GeometryGenerator::Vertex LegacyMidPoint(const GeometryGenerator::Vertex &v0, const GeometryGenerator::Vertex &v1) {
+    GeometryGenerator::Vertex v;
+    XMStoreFloat3(&v.Position, 0.5f * (XMLoadFloat3(&v0.Position) + XMLoadFloat3(&v1.Position)));
+    XMStoreFloat3(&v.Normal, XMVector3Normalize(0.5f * (XMLoadFloat3(&v0.Normal) + XMLoadFloat3(&v1.Normal))));
+    XMStoreFloat3(&v.TangentU, XMVector3Normalize(0.5f * (XMLoadFloat3(&v0.TangentU) + XMLoadFloat3(&v1.TangentU))));
+    XMStoreFloat2(&v.TexC, 0.5f * (XMLoadFloat2(&v0.TexC) + XMLoadFloat2(&v1.TexC)));
+    return v;
+  }
+
+  void LegacySubdivide(GeometryGenerator::MeshData &mesh) {
+    GeometryGenerator::MeshData input = mesh;
+    mesh.Vertices.resize(0);
+    mesh.Indices32.resize(0);
+    uint32_t triangles = static_cast<uint32_t>(input.Indices32.size() / 3);
+    for (uint32_t i = 0; i < triangles; i++) {
+      GeometryGenerator::Vertex v0 = input.Vertices[input.Indices32[i * 3 + 0]];
+      GeometryGenerator::Vertex v1 = input.Vertices[input.Indices32[i * 3 + 1]];
+      GeometryGenerator::Vertex v2 = input.Vertices[input.Indices32[i * 3 + 2]];
+      mesh.Vertices.push_back(v0);
+      mesh.Vertices.push_back(v1);
+      mesh.Vertices.push_back(v2);
+      mesh.Vertices.push_back(LegacyMidPoint(v0, v1));
+      mesh.Vertices.push_back(LegacyMidPoint(v1, v2));
+      mesh.Vertices.push_back(LegacyMidPoint(v0, v2));
+      const uint32_t local[12] = { 0, 3, 5, 3, 4, 5, 5, 4, 2, 3, 1, 4 };
+      for (uint32_t index : local) {
+        mesh.Indices32.push_back(i * 6 + index);
+      }
+    }
+  }
+
+  GeometryGenerator::MeshData LegacyGeosphere(float radius, uint32_t levels) {
+    // The icosahedron CreateGeosphere starts from.
+    GeometryGenerator::MeshData mesh = GeometryGenerator().CreateGeosphere(1.0f, 0);
+    for (uint32_t i = 0; i < levels; i++) {
+      LegacySubdivide(mesh);
+    }
+    for (GeometryGenerator::Vertex &v : mesh.Vertices) {
+      XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&v.Position));
+      XMStoreFloat3(&v.Position, radius * n);
+      XMStoreFloat3(&v.Normal, n);
+      float theta = atan2f(v.Position.z, v.Position.x);
+      if (theta < 0.0f) {
+        theta += XM_2PI;
+      }
+      float phi = acosf(v.Position.y / radius);
+      v.TexC = XMFLOAT2(theta / XM_2PI, phi / XM_PI);
+      XMStoreFloat3(&v.TangentU, XMVector3Normalize(XMVectorSet(-sinf(phi) * sinf(theta), 0.0f, sinf(phi) * cosf(theta), 0.0f)));
+    }
+    return mesh;
+  }
+
+  // True if every directed edge is matched by exactly one opposite edge, i.e.
+  // the surface is closed and has no cracks between triangles.
+  bool Watertight(const GeometryGenerator::MeshData &mesh) {
+    unordered_map<uint64_t, int> edges;
+    for (size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3) {
+      for (int e = 0; e < 3; e++) {
+        uint64_t a = mesh.Indices32[t + e], b = mesh.Indices32[t + (e + 1) % 3];
+        edges[a << 32 | b]++;
+      }
+    }
+    for (const auto &edge : edges) {
+      auto opposite = edges.find((edge.first & 0xffffffffull) << 32 | edge.first >> 32);
+      if (edge.second != 1 || opposite == edges.end() || opposite->second != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // True if every undirected edge belongs to one or two triangles, and the two
+  // walk it in opposite directions. borderEdges gets the one-triangle edges.
+  bool SharedEdges(const GeometryGenerator::MeshData &mesh, size_t &borderEdges) {
+    unordered_map<uint64_t, int> edges;
+    for (size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3) {
+      for (int e = 0; e < 3; e++) {
+        uint64_t a = mesh.Indices32[t + e], b = mesh.Indices32[t + (e + 1) % 3];
+        edges[a << 32 | b]++;
+      }
+    }
+    borderEdges = 0;
+    for (const auto &edge : edges) {
+      if (edge.second != 1) {
+        return false;
+      }
+      if (edges.count((edge.first & 0xffffffffull) << 32 | edge.first >> 32) == 0) {
+        borderEdges++;
+      }
+    }
+    return true;
+  }
+
+  // Subdivide through CreateBox, which shares every edge's midpoint, against
+  // the former subdivision. Each box face has its own vertices, so a face ends
+  // up as a (2^levels + 1)^2 grid and only the face borders are one-sided.
+  void BenchmarkSubdivide(ostream &out) {
+    GeometryGenerator generator;
+    out << "Box subdivision, shared edge midpoints vs six vertices per triangle\n";
+    for (uint32_t levels = 3; levels <= 6; levels++) {
+      const int reps = levels < 6 ? 8 : 2;
+      GeometryGenerator::MeshData shared, legacy;
+      auto start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        shared = generator.CreateBox(1.0f, 1.0f, 1.0f, levels);
+      }
+      double sharedSeconds = SecondsSince(start) / reps;
+      start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        legacy = generator.CreateBox(1.0f, 1.0f, 1.0f, 0);
+        for (uint32_t i = 0; i < levels; i++) {
+          LegacySubdivide(legacy);
+        }
+      }
+      double legacySeconds = SecondsSince(start) / reps;
+      size_t cells = size_t(1) << levels, borderEdges = 0;
+      bool ok = SharedEdges(shared, borderEdges) && borderEdges == 6 * 4 * cells &&
+        shared.Vertices.size() == 6 * (cells + 1) * (cells + 1);
+      size_t vertexBytes = sizeof(GeometryGenerator::Vertex);
+      out << "  level " << levels
+          << "  triangles " << setw(6) << shared.Indices32.size() / 3
+          << "  vertices " << setw(6) << shared.Vertices.size() << " vs " << setw(7) << legacy.Vertices.size()
+          << "  vertex MB " << fixed << setprecision(2) << shared.Vertices.size() * vertexBytes / 1048576.0
+          << " vs " << legacy.Vertices.size() * vertexBytes / 1048576.0
+          << "  ms " << setw(6) << 1000.0 * sharedSeconds << " vs " << setw(6) << 1000.0 * legacySeconds
+          << "  inner edges " << Check(ok, "shared", "NOT SHARED") << "\n";
+    }
+  }
+  // True if every vertex of mesh lies within tolerance of one of reference's
+  // and both have as many distinct positions.
+  bool SamePositions(const GeometryGenerator::MeshData &mesh, const GeometryGenerator::MeshData &reference, float tolerance) {
+    auto byX = [](const XMFLOAT3 &a, const XMFLOAT3 &b) {
+      return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+    };
+    vector<XMFLOAT3> points;
+    for (const GeometryGenerator::Vertex &v : reference.Vertices) {
+      points.push_back(v.Position);
+    }
+    sort(points.begin(), points.end(), byX);
+    points.erase(unique(points.begin(), points.end(), [](const XMFLOAT3 &a, const XMFLOAT3 &b) {
+      return a.x == b.x && a.y == b.y && a.z == b.z;
+    }), points.end());
+    if (points.size() != mesh.Vertices.size()) {
+      return false;
+    }
+    for (const GeometryGenerator::Vertex &v : mesh.Vertices) {
+      auto it = lower_bound(points.begin(), points.end(), XMFLOAT3(v.Position.x - tolerance, 0.0f, 0.0f), byX);
+      bool found = false;
+      for (; it != points.end() && it->x <= v.Position.x + tolerance && !found; ++it) {
+        found = fabsf(it->y - v.Position.y) <= tolerance && fabsf(it->z - v.Position.z) <= tolerance;
+      }
+      if (!found) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The closed-form geosphere against the subdivided one, then its
+  // throughput into preallocated arrays at levels past the former cap of 6.
+  void BenchmarkGeosphere(ostream &out) {
+    GeometryGenerator generator;
+    unsigned int maxThreads = max(1u, thread::hardware_concurrency());
+    out << "Geosphere, closed form vs six vertices per triangle subdivision\n";
+    for (uint32_t levels = 3; levels <= 6; levels++) {
+      const int reps = levels < 6 ? 8 : 2;
+      GeometryGenerator::MeshData closed, legacy;
+      auto start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        closed = generator.CreateGeosphere(1.0f, levels);
+      }
+      double closedSeconds = SecondsSince(start) / reps;
+      start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        legacy = LegacyGeosphere(1.0f, levels);
+      }
+      double legacySeconds = SecondsSince(start) / reps;
+      size_t vertexBytes = sizeof(GeometryGenerator::Vertex);
+      out << "  level " << levels
+          << "  triangles " << setw(6) << closed.Indices32.size() / 3
+          << "  vertices " << setw(6) << closed.Vertices.size() << " vs " << setw(7) << legacy.Vertices.size()
+          << "  vertex MB " << fixed << setprecision(2) << closed.Vertices.size() * vertexBytes / 1048576.0
+          << " vs " << legacy.Vertices.size() * vertexBytes / 1048576.0
+          << "  ms " << setw(6) << 1000.0 * closedSeconds << " vs " << setw(6) << 1000.0 * legacySeconds
+          << "  watertight " << Check(Watertight(closed), "yes", "NO") << " vs " << (Watertight(legacy) ? "yes" : "no") << "\n";
+    }
+    out << "Geosphere, faces generated in parallel\n";
+    {
+      const uint32_t levels = 5;
+      GeometryGenerator::MeshData mesh = generator.CreateGeosphere(1.0f, levels);
+      JobSystem jobs(max(4u, maxThreads));
+      GeometryGenerator::MeshData parallel = generator.CreateGeosphere(1.0f, 7, &jobs);
+      GeometryGenerator::MeshData serial = generator.CreateGeosphere(1.0f, 7);
+      bool same = parallel.Indices32 == serial.Indices32 &&
+        memcmp(parallel.Vertices.data(), serial.Vertices.data(), serial.Vertices.size() * sizeof(GeometryGenerator::Vertex)) == 0;
+      out << "  level " << levels << " positions " << Check(SamePositions(mesh, LegacyGeosphere(1.0f, levels), 1e-5f), "match", "MISMATCH")
+          << " subdivision, " << Check(Watertight(mesh), "watertight", "NOT WATERTIGHT")
+          << "  level 7 parallel " << Check(same, "same", "DIFFERENT") << " as serial\n";
+    }
+    for (uint32_t levels : { 6u, 8u, 10u }) {
+      vector<GeometryGenerator::Vertex> vertices(GeometryGenerator::GeosphereVertexCount(levels));
+      vector<uint32_t> indices(GeometryGenerator::GeosphereIndexCount(levels));
+      // Once untimed, so the arrays' pages are not faulted in on the clock.
+      generator.CreateGeosphere(1.0f, levels, vertices.data(), indices.data());
+      const int reps = levels < 10 ? 4 : 1;
+      double baseSeconds = 0.0;
+      for (unsigned int threads = 1; ; threads = min(threads * 2, maxThreads)) {
+        JobSystem jobs(threads);
+        auto start = Clock::now();
+        for (int r = 0; r < reps; r++) {
+          generator.CreateGeosphere(1.0f, levels, vertices.data(), indices.data(), &jobs);
+        }
+        double seconds = SecondsSince(start) / reps;
+        if (threads == 1) {
+          baseSeconds = seconds;
+        }
+        out << "  level " << setw(2) << levels << "  " << setw(2) << threads << " threads"
+            << "  triangles " << setw(8) << indices.size() / 3
+            << "  MB " << setw(6) << fixed << setprecision(1)
+            << (vertices.size() * sizeof(GeometryGenerator::Vertex) + indices.size() * sizeof(uint32_t)) / 1048576.0
+            << "  ms " << setw(8) << setprecision(2) << 1000.0 * seconds
+            << "  Mtris/s " << setw(6) << indices.size() / 3 / seconds / 1e6
+            << "  speedup " << setw(5) << baseSeconds / seconds << "\n";
+        if (threads == maxThreads) {
+          break;
+        }
+      }
+    }
+  }
+  // True if every vertex of a is within tolerance of the same vertex of b.
+  bool SameVertices(const GeometryGenerator::Vertex *a, const GeometryGenerator::Vertex *b, size_t count, float tolerance) {
+    for (size_t i = 0; i < count; i++) {
+      const float *fa = &a[i].Position.x, *fb = &b[i].Position.x;
+      for (size_t c = 0; c < sizeof(GeometryGenerator::Vertex) / sizeof(float); c++) {
+        if (!(fabsf(fa[c] - fb[c]) <= tolerance)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  bool SameStreams(const MeshStreams &a, const MeshStreams &b) {
+    const MeshStreams::Stream *sa[] = { &a.PositionX, &a.PositionY, &a.PositionZ, &a.NormalX, &a.NormalY, &a.NormalZ,
+                                        &a.TangentX, &a.TangentY, &a.TangentZ, &a.TexU, &a.TexV };
+    const MeshStreams::Stream *sb[] = { &b.PositionX, &b.PositionY, &b.PositionZ, &b.NormalX, &b.NormalY, &b.NormalZ,
+                                        &b.TangentX, &b.TangentY, &b.TangentZ, &b.TexU, &b.TexV };
+    for (int s = 0; s < 11; s++) {
+      if (a.Size() != b.Size() || memcmp(sa[s]->data(), sb[s]->data(), a.Size() * sizeof(float)) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void TransformVertices(vector<GeometryGenerator::Vertex> &vertices, const XMFLOAT4X4 &world) {
+    XMMATRIX m = XMLoadFloat4x4(&world);
+    XMMATRIX linear = m;
+    linear.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+    XMMATRIX normal = XMMatrixTranspose(XMMatrixInverse(nullptr, linear));
+    for (GeometryGenerator::Vertex &v : vertices) {
+      XMStoreFloat3(&v.Position, XMVector3Transform(XMLoadFloat3(&v.Position), m));
+      XMStoreFloat3(&v.TangentU, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&v.TangentU), m)));
+      XMStoreFloat3(&v.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&v.Normal), normal)));
+    }
+  }
+
+  // Bulk transforms and edge midpoints over a geosphere, on interleaved
+  // vertices with DirectXMath against MeshStreams with each kernel.
+  void BenchmarkMeshStreams(ostream &out) {
+    const int reps = 20;
+    GeometryGenerator::MeshData mesh = GeometryGenerator().CreateGeosphere(1.0f, 7);
+    XMFLOAT4X4 world;
+    XMStoreFloat4x4(&world, XMMatrixScaling(2.0f, 1.0f, 0.5f) * XMMatrixRotationY(0.7f) * XMMatrixTranslation(1.0f, 2.0f, 3.0f));
+    vector<uint32_t> first, second;
+    {
+      unordered_set<uint64_t> seen;
+      for (size_t t = 0; t < mesh.Indices32.size(); t += 3) {
+        for (int e = 0; e < 3; e++) {
+          uint32_t a = mesh.Indices32[t + e], b = mesh.Indices32[t + (e + 1) % 3];
+          if (seen.insert(static_cast<uint64_t>(min(a, b)) << 32 | max(a, b)).second) {
+            first.push_back(a);
+            second.push_back(b);
+          }
+        }
+      }
+    }
+    size_t edges = first.size();
+
+    vector<GeometryGenerator::Vertex> aos = mesh.Vertices;
+    auto start = Clock::now();
+    for (int r = 0; r < reps; r++) {
+      TransformVertices(aos, world);
+    }
+    double aosTransform = SecondsSince(start) / reps;
+    vector<GeometryGenerator::Vertex> aosMidpoints(edges);
+    start = Clock::now();
+    for (int r = 0; r < reps; r++) {
+      for (size_t i = 0; i < edges; i++) {
+        aosMidpoints[i] = LegacyMidPoint(mesh.Vertices[first[i]], mesh.Vertices[second[i]]);
+      }
+    }
+    double aosMidpoint = SecondsSince(start) / reps;
+    vector<GeometryGenerator::Vertex> once = mesh.Vertices;
+    TransformVertices(once, world);
+
+    out << "MeshStreams, " << mesh.Vertices.size() << " vertices, " << edges << " edge midpoints, AoS vs SoA\n";
+    out << "  AoS     transform ms " << setw(7) << fixed << setprecision(3) << 1000.0 * aosTransform
+        << "  midpoints ms " << setw(7) << 1000.0 * aosMidpoint << "\n";
+    vector<RasterKernels::Isa> isas = { RasterKernels::Isa::Scalar, RasterKernels::Isa::SSE };
+    if (RasterKernels::DetectIsa() == RasterKernels::Isa::AVX2) {
+      isas.push_back(RasterKernels::Isa::AVX2);
+    }
+    MeshStreams referenceTransform, referenceMidpoints;
+    for (RasterKernels::Isa isa : isas) {
+      MeshStreams soa(mesh), midpoints;
+      soa.SetIsa(isa);
+      start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        soa.Transform(world);
+      }
+      double transform = SecondsSince(start) / reps;
+      MeshStreams source(mesh);
+      source.SetIsa(isa);
+      start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        source.Midpoints(first.data(), second.data(), edges, midpoints);
+      }
+      double midpoint = SecondsSince(start) / reps;
+
+      MeshStreams checked(mesh);
+      checked.SetIsa(isa);
+      checked.Transform(world);
+      if (isa == RasterKernels::Isa::Scalar) {
+        referenceTransform = checked;
+        referenceMidpoints = midpoints;
+      }
+      GeometryGenerator::MeshData interleaved = checked.ToMeshData();
+      vector<GeometryGenerator::Vertex> interleavedMidpoints(edges);
+      midpoints.Interleave(interleavedMidpoints.data());
+      bool matchesAos = SameVertices(interleaved.Vertices.data(), once.data(), once.size(), 1e-5f) &&
+        SameVertices(interleavedMidpoints.data(), aosMidpoints.data(), edges, 1e-6f);
+      bool matchesScalar = SameStreams(checked, referenceTransform) && SameStreams(midpoints, referenceMidpoints);
+      out << "  " << setw(6) << RasterKernels::IsaName(isa)
+          << "  transform ms " << setw(7) << setprecision(3) << 1000.0 * transform
+          << " (" << setw(5) << setprecision(2) << aosTransform / transform << "x)"
+          << "  midpoints ms " << setw(7) << setprecision(3) << 1000.0 * midpoint
+          << " (" << setw(5) << setprecision(2) << aosMidpoint / midpoint << "x)"
+          << "  matches AoS " << Check(matchesAos, "yes", "NO")
+          << "  scalar " << Check(matchesScalar, "yes", "NO") << "\n";
+    }
+    vector<GeometryGenerator::Vertex> upload(edges);
+    referenceMidpoints.Interleave(upload.data());
+    start = Clock::now();
+    for (int r = 0; r < reps; r++) {
+      referenceMidpoints.Interleave(upload.data());
+    }
+    out << "  interleave " << edges << " vertices for upload ms " << setprecision(3) << 1000.0 * SecondsSince(start) / reps << "\n";
+  }
+  // Triangles of indices, each as written, in sorted order.
+  vector<array<uint32_t, 3>> SortedTriangles(const vector<uint32_t> &indices) {
+    vector<array<uint32_t, 3>> triangles;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+      triangles.push_back({ indices[t], indices[t + 1], indices[t + 2] });
+    }
+    sort(triangles.begin(), triangles.end());
+    return triangles;
+  }
+
+  // Vertex shader invocations of GeometryGenerator's meshes in their row
+  // order and after VertexCache::Optimize, under FIFO and LRU caches.
+  void BenchmarkVertexCache(ostream &out) {
+    struct Cache {
+      const char *Name;
+      uint32_t Size;
+      VertexCache::Policy Policy;
+    };
+    const Cache caches[] = {
+      { "fifo16", 16, VertexCache::Policy::Fifo },
+      { "fifo32", 32, VertexCache::Policy::Fifo },
+      { "lru32", 32, VertexCache::Policy::Lru },
+    };
+    struct Mesh {
+      const char *Name;
+      function<GeometryGenerator::MeshData(GeometryGenerator&)> Create;
+    };
+    const Mesh meshes[] = {
+      { "sphere 64x64", [](GeometryGenerator &g) { return g.CreateSphere(1.0f, 64, 64); } },
+      { "cylinder 64x32", [](GeometryGenerator &g) { return g.CreateCylinder(1.0f, 0.5f, 3.0f, 64, 32); } },
+      { "grid 256x256", [](GeometryGenerator &g) { return g.CreateGrid(100.0f, 100.0f, 256, 256); } },
+      { "grid 32x32", [](GeometryGenerator &g) { return g.CreateGrid(10.0f, 10.0f, 32, 32); } },
+    };
+
+    // Counted by hand: on reusing 0, LRU keeps it and evicts 1 for 3, FIFO
+    // evicts 0 anyway. A one-entry cache hits a repeated vertex.
+    const uint32_t reuse[] = { 0, 1, 2, 0, 3, 0 }, repeat[] = { 0, 0, 0 };
+    bool counted = VertexCache::Simulate(reuse, 6, 3, VertexCache::Policy::Fifo).Transforms == 5 &&
+                   VertexCache::Simulate(reuse, 6, 3, VertexCache::Policy::Lru).Transforms == 4 &&
+                   VertexCache::Simulate(reuse, 3, 3, VertexCache::Policy::Fifo).Transforms == 3 &&
+                   VertexCache::Simulate(repeat, 3, 1, VertexCache::Policy::Fifo).Transforms == 1 &&
+                   VertexCache::Simulate(repeat, 3, 1, VertexCache::Policy::Lru).Transforms == 1;
+    out << "Vertex cache, hand-counted sequences " << Check(counted, "ok", "WRONG") << "\n";
+    out << "Vertex cache, ACMR/ATVR";
+    for (const Cache &cache : caches) {
+      out << "  " << cache.Name;
+    }
+    out << "\n";
+    for (const Mesh &mesh : meshes) {
+      GeometryGenerator generator;
+      generator.SetOptimizeVertexCache(false);
+      GeometryGenerator::MeshData rows = mesh.Create(generator);
+      vector<uint32_t> optimized = rows.Indices32;
+      const int reps = 10;
+      auto start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        optimized = rows.Indices32;
+        VertexCache::Optimize(optimized.data(), optimized.size(), rows.Vertices.size());
+      }
+      double seconds = SecondsSince(start) / reps;
+      GeometryGenerator optimizing;
+      bool generated = mesh.Create(optimizing).Indices32 == optimized;
+      bool same = SortedTriangles(rows.Indices32) == SortedTriangles(optimized);
+
+      out << "  " << left << setw(15) << mesh.Name << right << setw(7) << rows.Indices32.size() / 3 << " triangles\n";
+      const vector<uint32_t> *orders[] = { &rows.Indices32, &optimized };
+      for (int o = 0; o < 2; o++) {
+        out << "    " << (o == 0 ? "rows     " : "optimized");
+        for (const Cache &cache : caches) {
+          VertexCache::Stats stats = VertexCache::Simulate(orders[o]->data(), orders[o]->size(), cache.Size, cache.Policy);
+          out << "  " << fixed << setprecision(3) << stats.Acmr() << "/" << stats.Atvr();
+        }
+        if (o == 1) {
+          out << "  optimize ms " << setprecision(2) << 1000.0 * seconds
+              << "  Mtris/s " << rows.Indices32.size() / 3 / seconds / 1e6
+              << "  " << Check(same, "same triangles", "TRIANGLES CHANGED")
+              << Check(generated, "", "  GENERATOR NOT OPTIMIZED");
+        }
+        out << "\n";
+      }
+    }
+  }
+  // Vertex cache ordering leaves triangles in whatever depth order the cache
+  // walk produced; OptimizeOverdraw() moves outer clusters first. Meshes are
+  // concave ones, since convex ones never overdraw with back-face culling.
+  void BenchmarkOverdraw(ostream &out) {
+    struct Mesh {
+      const char *Name;
+      function<GeometryGenerator::MeshData()> Create;
+    };
+    const Mesh meshes[] = {
+      { "bumpy geosphere 6", [] {
+        GeometryGenerator::MeshData mesh = GeometryGenerator().CreateGeosphere(1.0f, 6);
+        for (GeometryGenerator::Vertex &v : mesh.Vertices) {
+          XMFLOAT3 &p = v.Position;
+          float bump = 1.0f + 0.3f * sinf(7.0f * p.x) * sinf(7.0f * p.y) * sinf(7.0f * p.z);
+          p = XMFLOAT3(p.x * bump, p.y * bump, p.z * bump);
+        }
+        return mesh;
+      } },
+      { "city 400 boxes", [] {
+        GeometryGenerator::MeshData city;
+        GeometryGenerator::MeshData box = GeometryGenerator().CreateBox(1.0f, 1.0f, 1.0f, 0);
+        mt19937 rng(25);
+        uniform_real_distribution<float> position(-10.0f, 10.0f), size(0.5f, 2.0f), height(1.0f, 8.0f);
+        for (int b = 0; b < 400; b++) {
+          XMFLOAT3 scale(size(rng), height(rng), size(rng));
+          XMFLOAT3 offset(position(rng), 0.5f * scale.y, position(rng));
+          uint32_t base = static_cast<uint32_t>(city.Vertices.size());
+          for (GeometryGenerator::Vertex v : box.Vertices) {
+            v.Position = XMFLOAT3(v.Position.x * scale.x + offset.x, v.Position.y * scale.y + offset.y,
+                                  v.Position.z * scale.z + offset.z);
+            city.Vertices.push_back(v);
+          }
+          for (uint32_t i : box.Indices32) {
+            city.Indices32.push_back(base + i);
+          }
+        }
+        return city;
+      } },
+    };
+
+    OverdrawSimulator simulator(256, 32);
+    out << "Overdraw, " << simulator.ViewCount() << " views at 256x256, shaded/covered pixels\n";
+    for (const Mesh &mesh : meshes) {
+      GeometryGenerator::MeshData data = mesh.Create();
+      vector<uint32_t> cached = data.Indices32;
+      VertexCache::Optimize(cached.data(), cached.size(), data.Vertices.size());
+      vector<uint32_t> sorted = cached;
+      const int reps = 10;
+      auto start = Clock::now();
+      for (int r = 0; r < reps; r++) {
+        sorted = cached;
+        VertexCache::OptimizeOverdraw(sorted.data(), sorted.size(), &data.Vertices[0].Position.x,
+                                      sizeof(GeometryGenerator::Vertex), data.Vertices.size());
+      }
+      double seconds = SecondsSince(start) / reps;
+      bool same = SortedTriangles(cached) == SortedTriangles(sorted);
+
+      out << "  " << left << setw(18) << mesh.Name << right << setw(7) << cached.size() / 3 << " triangles\n";
+      const vector<uint32_t> *orders[] = { &cached, &sorted };
+      for (int o = 0; o < 2; o++) {
+        OverdrawSimulator::Stats stats = simulator.Measure(data.Vertices.data(), sizeof(GeometryGenerator::Vertex),
+                                                           orders[o]->data(), false,
+                                                           static_cast<unsigned int>(orders[o]->size()));
+        VertexCache::Stats cache = VertexCache::Simulate(orders[o]->data(), orders[o]->size(), 32, VertexCache::Policy::Fifo);
+        out << "    " << (o == 0 ? "vertex cache" : "overdraw    ") << "  overdraw " << fixed << setprecision(3)
+            << stats.Overdraw() << "  fifo32 ACMR " << cache.Acmr();
+        if (o == 1) {
+          out << "  optimize ms " << setprecision(2) << 1000.0 * seconds
+              << "  " << Check(same, "same triangles", "TRIANGLES CHANGED");
+        }
+        out << "\n";
+      }
+    }
+  }
+}
+
+int RunBenchmarks(ostream &out) {
+  failedChecks = 0;
+  BenchmarkCoverageKernels(out);
+  BenchmarkSoftwareRasterizer(out);
+  BenchmarkHiZ(out);
+  BenchmarkFrustumCulling(out);
+  BenchmarkOcclusionCulling(out);
+  BenchmarkFramePacing(out);
+  BenchmarkUploadRing(out);
+  BenchmarkUploadPlanner(out);
+  BenchmarkRangeAllocator(out);
+  BenchmarkDrawListBuild(out);
+  BenchmarkCommandRecording(out);
+  BenchmarkJobSystem(out);
+  BenchmarkInstancePacking(out);
+  BenchmarkDrawSort(out);
+  BenchmarkStateFilter(out);
+  BenchmarkShaderCache(out);
+  BenchmarkShaderPermutations(out);
+  BenchmarkPipelineKeys(out);
+  BenchmarkQueues(out);
+  BenchmarkSubdivide(out);
+  BenchmarkGeosphere(out);
+  BenchmarkMeshStreams(out);
+  BenchmarkVertexCache(out);
+  BenchmarkOverdraw(out);
+  if (failedChecks) {
+    out << failedChecks << " check(s) FAILED\n";
+  }
+  return failedChecks;
+}
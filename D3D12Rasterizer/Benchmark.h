@@ -0,0 +1,9 @@
+#pragma once
+#include <ostream>
+
+// CPU-only benchmarks, run with -bench. None of them create a D3D12 device, so
+// they run on Windows machines without a GPU, but they only build as part of
+// the Windows app: Rasterizer.h and Camera.h, which the shared types and the
+// frustum culler come from, include windows.h. Returns the number of
+// correctness checks that failed, so -bench can gate a build.
+int RunBenchmarks(std::ostream &out);
@@ -0,0 +1,46 @@
+#include "D3D12CommandRecorder.h"
+
+void D3D12CommandRecorder::SetRootSignature(uint64_t rootSignature) {
+  mCmdList->SetGraphicsRootSignature(reinterpret_cast<ID3D12RootSignature*>(rootSignature));
+}
+
+void D3D12CommandRecorder::SetPipelineState(uint64_t pipeline) {
+  mCmdList->SetPipelineState(reinterpret_cast<ID3D12PipelineState*>(pipeline));
+}
+
+void D3D12CommandRecorder::SetPrimitiveTopology(uint32_t topology) {
+  mCmdList->IASetPrimitiveTopology(static_cast<D3D12_PRIMITIVE_TOPOLOGY>(topology));
+}
+
+void D3D12CommandRecorder::SetViewport(const Viewport &viewport) {
+  D3D12_VIEWPORT vp = { viewport.X, viewport.Y, viewport.Width, viewport.Height, viewport.MinDepth, viewport.MaxDepth };
+  mCmdList->RSSetViewports(1, &vp);
+}
+
+void D3D12CommandRecorder::SetScissorRect(const ScissorRect &rect) {
+  D3D12_RECT r = { rect.Left, rect.Top, rect.Right, rect.Bottom };
+  mCmdList->RSSetScissorRects(1, &r);
+}
+
+void D3D12CommandRecorder::SetVertexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t stride) {
+  D3D12_VERTEX_BUFFER_VIEW vbv = { address, sizeInBytes, stride };
+  mCmdList->IASetVertexBuffers(0, 1, &vbv);
+}
+
+void D3D12CommandRecorder::SetIndexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t indexSize) {
+  D3D12_INDEX_BUFFER_VIEW ibv = { address, sizeInBytes, indexSize == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT };
+  mCmdList->IASetIndexBuffer(&ibv);
+}
+
+void D3D12CommandRecorder::SetConstantBuffer(uint32_t slot, uint64_t address) {
+  mCmdList->SetGraphicsRootConstantBufferView(slot, address);
+}
+
+void D3D12CommandRecorder::SetShaderResource(uint32_t slot, uint64_t address) {
+  mCmdList->SetGraphicsRootShaderResourceView(slot, address);
+}
+
+void D3D12CommandRecorder::DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                                       int32_t baseVertex, uint32_t startInstance) {
+  mCmdList->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
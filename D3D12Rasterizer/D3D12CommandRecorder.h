@@ -0,0 +1,25 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/CommandRecorder.h"
+
+// Forwards CommandRecorder calls to a graphics command list that the caller
+// has reset and set up for the pass.
+class D3D12CommandRecorder : public CommandRecorder {
+public:
+  explicit D3D12CommandRecorder(ID3D12GraphicsCommandList *cmdList) : mCmdList(cmdList) {}
+
+  void SetRootSignature(uint64_t rootSignature) override;
+  void SetPipelineState(uint64_t pipeline) override;
+  void SetPrimitiveTopology(uint32_t topology) override;
+  void SetViewport(const Viewport &viewport) override;
+  void SetScissorRect(const ScissorRect &rect) override;
+  void SetVertexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t stride) override;
+  void SetIndexBuffer(uint64_t address, uint32_t sizeInBytes, uint32_t indexSize) override;
+  void SetConstantBuffer(uint32_t slot, uint64_t address) override;
+  void SetShaderResource(uint32_t slot, uint64_t address) override;
+  void DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                   int32_t baseVertex, uint32_t startInstance) override;
+
+private:
+  ID3D12GraphicsCommandList *mCmdList;
+};
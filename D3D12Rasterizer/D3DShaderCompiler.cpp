@@ -0,0 +1,42 @@
+#include "D3DShaderCompiler.h"
+#include <cstring>
+using Microsoft::WRL::ComPtr;
+
+uint32_t D3DShaderCompiler::DefaultFlags() {
+#if defined(DEBUG) || defined(_DEBUG)
+  return D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+  return 0;
+#endif
+}
+
+std::string D3DShaderCompiler::Version() const {
+  return "d3dcompiler_" + std::to_string(D3D_COMPILER_VERSION);
+}
+
+std::vector<uint8_t> D3DShaderCompiler::Compile(const ShaderDesc &desc) {
+  std::vector<D3D_SHADER_MACRO> macros;
+  for (const ShaderDefine &define : desc.Defines) {
+    macros.push_back({ define.Name.c_str(), define.Value.c_str() });
+  }
+  macros.push_back({ nullptr, nullptr });
+
+  ComPtr<ID3DBlob> byteCode;
+  ComPtr<ID3DBlob> errors;
+  HRESULT hr = D3DCompileFromFile(AnsiToWString(desc.Path).c_str(), macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE,
+    desc.EntryPoint.c_str(), desc.Target.c_str(), desc.Flags, 0, &byteCode, &errors);
+  if (errors) {
+    OutputDebugStringA(reinterpret_cast<char*>(errors->GetBufferPointer()));
+  }
+  ThrowIfFailed(hr);
+
+  const uint8_t *bytes = static_cast<const uint8_t*>(byteCode->GetBufferPointer());
+  return std::vector<uint8_t>(bytes, bytes + byteCode->GetBufferSize());
+}
+
+ComPtr<ID3DBlob> D3DShaderCompiler::ToBlob(const std::vector<uint8_t> &bytecode) {
+  ComPtr<ID3DBlob> blob;
+  ThrowIfFailed(D3DCreateBlob(bytecode.size(), blob.GetAddressOf()));
+  memcpy(blob->GetBufferPointer(), bytecode.data(), bytecode.size());
+  return blob;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/ShaderCache.h"
+
+// Compiles with D3DCompileFromFile and the standard file include handler.
+class D3DShaderCompiler : public ShaderCompiler {
+public:
+  // Debug info and no optimization in debug builds, as d3dUtil::CompileShader.
+  static uint32_t DefaultFlags();
+
+  std::string Version() const override;
+  std::vector<uint8_t> Compile(const ShaderDesc &desc) override;
+
+  // Copies bytecode into a blob for pipeline descs.
+  static Microsoft::WRL::ComPtr<ID3DBlob> ToBlob(const std::vector<uint8_t> &bytecode);
+};
@@ -0,0 +1,35 @@
+#include "FrameResource.h"
+
+const int gNumFrameResources = 3;
+
+FrameResource::FrameResource(ID3D12Device *device, unsigned int chunkCount) : ChunkAllocs(chunkCount) {
+  ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+  for (auto &alloc : ChunkAllocs) {
+    ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(alloc.GetAddressOf())));
+  }
+}
+
+D3D12FenceQueue::D3D12FenceQueue(ID3D12Device *device, ID3D12CommandQueue *queue) : mQueue(queue) {
+  ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(mFence.GetAddressOf())));
+  mEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+}
+
+D3D12FenceQueue::~D3D12FenceQueue() {
+  CloseHandle(mEvent);
+}
+
+uint64_t D3D12FenceQueue::Signal() {
+  ThrowIfFailed(mQueue->Signal(mFence.Get(), ++mLastSignaled));
+  return mLastSignaled;
+}
+
+uint64_t D3D12FenceQueue::CompletedValue() const {
+  return mFence->GetCompletedValue();
+}
+
+void D3D12FenceQueue::WaitFor(uint64_t value) {
+  if (mFence->GetCompletedValue() < value) {
+    ThrowIfFailed(mFence->SetEventOnCompletion(value, mEvent));
+    WaitForSingleObject(mEvent, INFINITE);
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/FrameRing.h"
+#include "../Common/MathHelper.h"
+
+struct ObjectConstants {
+  DirectX::XMFLOAT4X4 WorldViewProj = MathHelper::Identity4x4();
+};
+
+// cbPass of the instanced color.hlsl; worlds come from the instance buffer.
+struct PassConstants {
+  DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
+};
+
+// Everything the CPU writes for one frame. The GPU may still be reading the
+// resources of the previous gNumFrameResources - 1 frames, so each frame gets
+// its own allocators, recycled through a FrameRing. Constants live in the
+// shared UploadRing.
+struct FrameResource {
+  FrameResource(ID3D12Device *device, unsigned int chunkCount);
+  FrameResource(const FrameResource &rhs) = delete;
+  FrameResource &operator=(const FrameResource &rhs) = delete;
+
+  // Frame setup and present.
+  Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+  // One per draw chunk, since chunks are recorded concurrently.
+  std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> ChunkAllocs;
+};
+
+// IFenceQueue over a direct command queue and one ID3D12Fence.
+class D3D12FenceQueue : public IFenceQueue {
+public:
+  D3D12FenceQueue(ID3D12Device *device, ID3D12CommandQueue *queue);
+  ~D3D12FenceQueue();
+  D3D12FenceQueue(const D3D12FenceQueue &rhs) = delete;
+  D3D12FenceQueue &operator=(const D3D12FenceQueue &rhs) = delete;
+
+  uint64_t Signal() override;
+  uint64_t CompletedValue() const override;
+  void WaitFor(uint64_t value) override;
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+  ID3D12CommandQueue *mQueue;
+  uint64_t mLastSignaled = 0;
+  HANDLE mEvent;
+};
@@ -0,0 +1,148 @@
+#include "FrustumCuller.h"
+#include "../Common/Camera.h"
+#include <cmath>
+#include <immintrin.h>
+#include <limits>
+using namespace DirectX;
+
+namespace {
+  const size_t BatchPadding = 8;
+}
+
+void FrustumCuller::BoundsSoA::Clear() {
+  CenterX.clear(); CenterY.clear(); CenterZ.clear();
+  ExtentX.clear(); ExtentY.clear(); ExtentZ.clear();
+  mCount = 0;
+}
+
+void FrustumCuller::BoundsSoA::Add(const BoundingBox &bounds, const XMFLOAT4X4 &world) {
+  // Drop the previous padding, append, then pad again with NaN centers, which
+  // fail every plane comparison.
+  CenterX.resize(mCount); CenterY.resize(mCount); CenterZ.resize(mCount);
+  ExtentX.resize(mCount); ExtentY.resize(mCount); ExtentZ.resize(mCount);
+
+  XMFLOAT3 center;
+  XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&bounds.Center), XMLoadFloat4x4(&world)));
+  const XMFLOAT3 &e = bounds.Extents;
+  CenterX.push_back(center.x);
+  CenterY.push_back(center.y);
+  CenterZ.push_back(center.z);
+  ExtentX.push_back(std::fabs(world(0, 0)) * e.x + std::fabs(world(1, 0)) * e.y + std::fabs(world(2, 0)) * e.z);
+  ExtentY.push_back(std::fabs(world(0, 1)) * e.x + std::fabs(world(1, 1)) * e.y + std::fabs(world(2, 1)) * e.z);
+  ExtentZ.push_back(std::fabs(world(0, 2)) * e.x + std::fabs(world(1, 2)) * e.y + std::fabs(world(2, 2)) * e.z);
+  mCount++;
+
+  size_t padded = (mCount + BatchPadding - 1) / BatchPadding * BatchPadding;
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  CenterX.resize(padded, nan); CenterY.resize(padded, nan); CenterZ.resize(padded, nan);
+  ExtentX.resize(padded, 0.0f); ExtentY.resize(padded, 0.0f); ExtentZ.resize(padded, 0.0f);
+}
+
+void FrustumCuller::SetFrustum(const XMFLOAT4X4 &m) {
+  // Gribb/Hartmann: with clip = p * M, each plane is a sum or difference of
+  // the columns of M.
+  XMVECTOR col[4];
+  for (int c = 0; c < 4; c++) {
+    col[c] = XMVectorSet(m(0, c), m(1, c), m(2, c), m(3, c));
+  }
+  XMVECTOR planes[6] = {
+    XMVectorAdd(col[3], col[0]),       // left
+    XMVectorSubtract(col[3], col[0]),  // right
+    XMVectorAdd(col[3], col[1]),       // bottom
+    XMVectorSubtract(col[3], col[1]),  // top
+    col[2],                            // near, z >= 0
+    XMVectorSubtract(col[3], col[2])   // far
+  };
+  for (int i = 0; i < 6; i++) {
+    XMStoreFloat4(&mPlanes[i], XMPlaneNormalize(planes[i]));
+  }
+}
+
+void FrustumCuller::SetFrustum(const Camera &camera) {
+  XMFLOAT4X4 viewProj;
+  XMStoreFloat4x4(&viewProj, XMMatrixMultiply(camera.GetView(), camera.GetProj()));
+  SetFrustum(viewProj);
+}
+
+size_t FrustumCuller::Cull(const BoundsSoA &bounds, std::vector<uint32_t> &visible) {
+  visible.resize(bounds.CenterX.size());
+  size_t count;
+  switch (mIsa) {
+    case RasterKernels::Isa::AVX2:
+      count = CullAVX2(bounds, visible.data());
+      break;
+    case RasterKernels::Isa::SSE:
+      count = CullSSE(bounds, visible.data());
+      break;
+    default:
+      count = CullScalar(bounds, visible.data());
+      break;
+  }
+  visible.resize(count);
+  mStats.Tested += bounds.Size();
+  mStats.Visible += count;
+  return count;
+}
+
+// A box is outside a plane when even its corner furthest along the normal,
+// center + |n| . extents, is behind it.
+size_t FrustumCuller::CullScalar(const BoundsSoA &bounds, uint32_t *visible) const {
+  size_t count = 0;
+  for (size_t i = 0; i < bounds.Size(); i++) {
+    bool inside = true;
+    for (int p = 0; p < 6 && inside; p++) {
+      const XMFLOAT4 &n = mPlanes[p];
+      float d = n.x * bounds.CenterX[i] + n.y * bounds.CenterY[i] + n.z * bounds.CenterZ[i] + n.w;
+      float r = std::fabs(n.x) * bounds.ExtentX[i] + std::fabs(n.y) * bounds.ExtentY[i] + std::fabs(n.z) * bounds.ExtentZ[i];
+      inside = d + r >= 0.0f;
+    }
+    visible[count] = static_cast<uint32_t>(i);
+    count += inside;
+  }
+  return count;
+}
+
+size_t FrustumCuller::CullSSE(const BoundsSoA &bounds, uint32_t *visible) const {
+  const __m128 zero = _mm_setzero_ps();
+  size_t count = 0;
+  for (size_t i = 0; i < bounds.Size(); i += 4) {
+    __m128 cx = _mm_loadu_ps(&bounds.CenterX[i]), cy = _mm_loadu_ps(&bounds.CenterY[i]), cz = _mm_loadu_ps(&bounds.CenterZ[i]);
+    __m128 ex = _mm_loadu_ps(&bounds.ExtentX[i]), ey = _mm_loadu_ps(&bounds.ExtentY[i]), ez = _mm_loadu_ps(&bounds.ExtentZ[i]);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      const XMFLOAT4 &n = mPlanes[p];
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(n.x), cx), _mm_mul_ps(_mm_set1_ps(n.y), cy)),
+        _mm_mul_ps(_mm_set1_ps(n.z), cz)), _mm_set1_ps(n.w));
+      __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(n.x)), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(n.y)), ey)),
+        _mm_mul_ps(_mm_set1_ps(std::fabs(n.z)), ez));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+    }
+    for (unsigned int mask = _mm_movemask_ps(inside); mask; mask &= mask - 1) {
+      visible[count++] = static_cast<uint32_t>(i + RasterKernels::LowestBit(mask));
+    }
+  }
+  return count;
+}
+
+RASTER_TARGET_AVX2
+size_t FrustumCuller::CullAVX2(const BoundsSoA &bounds, uint32_t *visible) const {
+  const __m256 zero = _mm256_setzero_ps();
+  size_t count = 0;
+  for (size_t i = 0; i < bounds.Size(); i += 8) {
+    __m256 cx = _mm256_loadu_ps(&bounds.CenterX[i]), cy = _mm256_loadu_ps(&bounds.CenterY[i]), cz = _mm256_loadu_ps(&bounds.CenterZ[i]);
+    __m256 ex = _mm256_loadu_ps(&bounds.ExtentX[i]), ey = _mm256_loadu_ps(&bounds.ExtentY[i]), ez = _mm256_loadu_ps(&bounds.ExtentZ[i]);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      const XMFLOAT4 &n = mPlanes[p];
+      __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(n.x), cx), _mm256_mul_ps(_mm256_set1_ps(n.y), cy)),
+        _mm256_mul_ps(_mm256_set1_ps(n.z), cz)), _mm256_set1_ps(n.w));
+      __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(n.x)), ex), _mm256_mul_ps(_mm256_set1_ps(std::fabs(n.y)), ey)),
+        _mm256_mul_ps(_mm256_set1_ps(std::fabs(n.z)), ez));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+    }
+    for (unsigned int mask = _mm256_movemask_ps(inside); mask; mask &= mask - 1) {
+      visible[count++] = static_cast<uint32_t>(i + RasterKernels::LowestBit(mask));
+    }
+  }
+  return count;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "RasterKernels.h"
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+class Camera;
+
+// View-frustum culling of world-space bounding boxes. Boxes are stored as
+// structure-of-arrays so the plane tests run on 4 (SSE) or 8 (AVX2) boxes per
+// instruction; the surviving indices are written to a compact visible list.
+// Every variant evaluates the planes with the same operation order, so the
+// SIMD results are identical to the scalar reference.
+class FrustumCuller {
+public:
+  // World-space AABBs. Padded with NaN-centered boxes to a multiple of 8 so
+  // the wide kernels never need a remainder loop; every plane compare fails
+  // on NaN, so padding is never reported visible.
+  struct BoundsSoA {
+    std::vector<float> CenterX, CenterY, CenterZ;
+    std::vector<float> ExtentX, ExtentY, ExtentZ;
+
+    void Clear();
+    // Adds the object-space bounds transformed by the (row-vector) world matrix.
+    void Add(const DirectX::BoundingBox &bounds, const DirectX::XMFLOAT4X4 &world);
+    size_t Size() const { return mCount; }
+
+  private:
+    friend class FrustumCuller;
+    size_t mCount = 0;
+  };
+
+  struct Stats {
+    uint64_t Tested = 0;
+    uint64_t Visible = 0;
+  };
+
+  FrustumCuller() : mIsa(RasterKernels::DetectIsa()) {}
+
+  // Planes face inwards and are normalized. viewProj is row-vector like
+  // Rasterizer::mView * mProj, with D3D clip depth 0 <= z <= w.
+  void SetFrustum(const DirectX::XMFLOAT4X4 &viewProj);
+  void SetFrustum(const Camera &camera);
+  const DirectX::XMFLOAT4 *Planes() const { return mPlanes; }
+
+  // Replaces visible with the indices of the boxes intersecting the frustum,
+  // in increasing order. Returns the number of visible boxes.
+  size_t Cull(const BoundsSoA &bounds, std::vector<uint32_t> &visible);
+
+  RasterKernels::Isa KernelIsa() const { return mIsa; }
+  // Overrides the detected kernel, e.g. to compare against the scalar reference.
+  void SetIsa(RasterKernels::Isa isa) { mIsa = isa; }
+
+  const Stats &GetStats() const { return mStats; }
+  void ResetStats() { mStats = Stats(); }
+
+private:
+  size_t CullScalar(const BoundsSoA &bounds, uint32_t *visible) const;
+  size_t CullSSE(const BoundsSoA &bounds, uint32_t *visible) const;
+  size_t CullAVX2(const BoundsSoA &bounds, uint32_t *visible) const;
+
+  DirectX::XMFLOAT4 mPlanes[6];
+  RasterKernels::Isa mIsa;
+  Stats mStats;
+};
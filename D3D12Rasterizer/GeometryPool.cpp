@@ -0,0 +1,126 @@
+#include "GeometryPool.h"
+
+using Microsoft::WRL::ComPtr;
+
+GeometryPool::GeometryPool(ID3D12Device *device, UINT vertexStride, UINT64 vertexCapacity, UINT64 indexCapacity,
+                           DXGI_FORMAT indexFormat)
+  : mDevice(device), mIndexFormat(indexFormat),
+    mVertices(vertexStride, vertexCapacity),
+    mIndices(indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4, indexCapacity) {
+  mVertices.Buffer = CreateArenaBuffer(mVertices);
+  mIndices.Buffer = CreateArenaBuffer(mIndices);
+}
+
+ComPtr<ID3D12Resource> GeometryPool::CreateArenaBuffer(const Arena &arena) {
+  ComPtr<ID3D12Resource> buffer;
+  ThrowIfFailed(mDevice->CreateCommittedResource(
+    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+    D3D12_HEAP_FLAG_NONE,
+    &CD3DX12_RESOURCE_DESC::Buffer(arena.Ranges.Capacity() * arena.ElementSize),
+    D3D12_RESOURCE_STATE_COMMON,
+    nullptr,
+    IID_PPV_ARGS(buffer.GetAddressOf())));
+  return buffer;
+}
+
+GeometryPool::MeshHandle GeometryPool::Add(UploadBatcher &batcher, const void *vertices, UINT vertexCount,
+                                           const void *indices, UINT indexCount) {
+  Mesh mesh;
+  mesh.Vertices = mVertices.Ranges.Allocate(vertexCount);
+  if (mesh.Vertices == RangeAllocator::InvalidHandle) {
+    return InvalidMesh;
+  }
+  mesh.Indices = mIndices.Ranges.Allocate(indexCount);
+  if (mesh.Indices == RangeAllocator::InvalidHandle) {
+    mVertices.Ranges.Free(mesh.Vertices);
+    return InvalidMesh;
+  }
+
+  auto enqueue = [&batcher](Arena &arena, RangeAllocator::Handle range, const void *data) {
+    batcher.Enqueue(arena.Buffer.Get(), arena.Ranges.Offset(range) * arena.ElementSize,
+      data, arena.Ranges.Size(range) * arena.ElementSize, arena.State);
+    // The batcher leaves every destination readable once recorded.
+    arena.State = D3D12_RESOURCE_STATE_GENERIC_READ;
+  };
+  enqueue(mVertices, mesh.Vertices, vertices);
+  enqueue(mIndices, mesh.Indices, indices);
+
+  MeshHandle handle;
+  if (!mFreeMeshes.empty()) {
+    handle = mFreeMeshes.back();
+    mFreeMeshes.pop_back();
+    mMeshes[handle] = mesh;
+  } else {
+    handle = static_cast<MeshHandle>(mMeshes.size());
+    mMeshes.push_back(mesh);
+  }
+  return handle;
+}
+
+void GeometryPool::Remove(MeshHandle mesh) {
+  mVertices.Ranges.Free(mMeshes[mesh].Vertices);
+  mIndices.Ranges.Free(mMeshes[mesh].Indices);
+  mFreeMeshes.push_back(mesh);
+}
+
+SubmeshGeometry GeometryPool::Place(MeshHandle mesh, const SubmeshGeometry &local) const {
+  SubmeshGeometry placed = local;
+  placed.BaseVertexLocation += static_cast<INT>(mVertices.Ranges.Offset(mMeshes[mesh].Vertices));
+  placed.StartIndexLocation += static_cast<UINT>(mIndices.Ranges.Offset(mMeshes[mesh].Indices));
+  return placed;
+}
+
+bool GeometryPool::Defragment(ID3D12GraphicsCommandList *cmdList) {
+  bool vertexMoved = Relocate(mVertices, cmdList);
+  bool indexMoved = Relocate(mIndices, cmdList);
+  return vertexMoved || indexMoved;
+}
+
+bool GeometryPool::Relocate(Arena &arena, ID3D12GraphicsCommandList *cmdList) {
+  std::vector<RangeAllocator::Move> moves = arena.Ranges.Defragment();
+  if (moves.empty()) {
+    return false;
+  }
+  // Copying within one buffer would overlap, so compact into a fresh one.
+  ComPtr<ID3D12Resource> compacted = CreateArenaBuffer(arena);
+  D3D12_RESOURCE_BARRIER barriers[] = {
+    CD3DX12_RESOURCE_BARRIER::Transition(arena.Buffer.Get(), arena.State, D3D12_RESOURCE_STATE_COPY_SOURCE),
+    CD3DX12_RESOURCE_BARRIER::Transition(compacted.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST)
+  };
+  cmdList->ResourceBarrier(_countof(barriers), barriers);
+  // Everything before the first gap stays put; everything after it moved.
+  UINT64 stride = arena.ElementSize;
+  if (moves.front().To > 0) {
+    cmdList->CopyBufferRegion(compacted.Get(), 0, arena.Buffer.Get(), 0, moves.front().To * stride);
+  }
+  for (const RangeAllocator::Move &move : moves) {
+    cmdList->CopyBufferRegion(compacted.Get(), move.To * stride, arena.Buffer.Get(), move.From * stride, move.Size * stride);
+  }
+  cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(compacted.Get(), D3D12_RESOURCE_STATE_COPY_DEST,
+    D3D12_RESOURCE_STATE_GENERIC_READ));
+
+  mRetired.push_back(arena.Buffer);
+  arena.Buffer = compacted;
+  arena.State = D3D12_RESOURCE_STATE_GENERIC_READ;
+  return true;
+}
+
+void GeometryPool::ReleaseRetired() {
+  mRetired.clear();
+}
+
+D3D12_VERTEX_BUFFER_VIEW GeometryPool::VertexBufferView() const {
+  D3D12_VERTEX_BUFFER_VIEW vbv;
+  vbv.BufferLocation = mVertices.Buffer->GetGPUVirtualAddress();
+  vbv.StrideInBytes = mVertices.ElementSize;
+  vbv.SizeInBytes = static_cast<UINT>(mVertices.Ranges.Capacity() * mVertices.ElementSize);
+  return vbv;
+}
+
+D3D12_INDEX_BUFFER_VIEW GeometryPool::IndexBufferView() const {
+  D3D12_INDEX_BUFFER_VIEW ibv;
+  ibv.BufferLocation = mIndices.Buffer->GetGPUVirtualAddress();
+  ibv.Format = mIndexFormat;
+  ibv.SizeInBytes = static_cast<UINT>(mIndices.Ranges.Capacity() * mIndices.ElementSize);
+  return ibv;
+}
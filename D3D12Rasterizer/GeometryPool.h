@@ -0,0 +1,63 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/RangeAllocator.h"
+#include "UploadBatcher.h"
+
+// Places every mesh into one shared vertex arena and one shared index arena,
+// so a frame binds a single vertex and index buffer and each draw only passes
+// its offsets. Ranges come from a RangeAllocator per arena, in vertices and in
+// indices, which makes them valid BaseVertexLocation/StartIndexLocation values.
+class GeometryPool {
+public:
+  typedef uint32_t MeshHandle;
+  static const MeshHandle InvalidMesh = ~0u;
+
+  GeometryPool(ID3D12Device *device, UINT vertexStride, UINT64 vertexCapacity, UINT64 indexCapacity,
+               DXGI_FORMAT indexFormat = DXGI_FORMAT_R16_UINT);
+
+  // Reserves room for the mesh and queues its data on batcher; indices are
+  // relative to the mesh's first vertex. Returns InvalidMesh if either arena
+  // has no contiguous range left, in which case Defragment() may help.
+  MeshHandle Add(UploadBatcher &batcher, const void *vertices, UINT vertexCount, const void *indices, UINT indexCount);
+  void Remove(MeshHandle mesh);
+
+  // Turns a submesh relative to the mesh into one relative to the arenas.
+  // Handles stay valid across Defragment(), so resolve at draw time.
+  SubmeshGeometry Place(MeshHandle mesh, const SubmeshGeometry &local) const;
+
+  // Compacts both arenas into new buffers and records the copies. Uploads
+  // queued for the pool must be recorded first. The old buffers are kept
+  // until ReleaseRetired(), once the copies have executed. Returns false if
+  // nothing had to move.
+  bool Defragment(ID3D12GraphicsCommandList *cmdList);
+  void ReleaseRetired();
+
+  D3D12_VERTEX_BUFFER_VIEW VertexBufferView() const;
+  D3D12_INDEX_BUFFER_VIEW IndexBufferView() const;
+
+  const RangeAllocator &Vertices() const { return mVertices.Ranges; }
+  const RangeAllocator &Indices() const { return mIndices.Ranges; }
+
+private:
+  struct Arena {
+    Arena(UINT elementSize, UINT64 capacity) : ElementSize(elementSize), Ranges(capacity) {}
+    UINT ElementSize;
+    RangeAllocator Ranges;
+    Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+    D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+  };
+
+  struct Mesh {
+    RangeAllocator::Handle Vertices, Indices;
+  };
+
+  Microsoft::WRL::ComPtr<ID3D12Resource> CreateArenaBuffer(const Arena &arena);
+  bool Relocate(Arena &arena, ID3D12GraphicsCommandList *cmdList);
+
+  ID3D12Device *mDevice;
+  DXGI_FORMAT mIndexFormat;
+  Arena mVertices, mIndices;
+  std::vector<Mesh> mMeshes;
+  std::vector<MeshHandle> mFreeMeshes;
+  std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mRetired;
+};
@@ -0,0 +1,349 @@
+#include "MeshStreams.h"
+#include <cmath>
+#include <immintrin.h>
+using namespace DirectX;
+
+namespace {
+  const size_t BatchPadding = 8;
+
+  // Every variant scales by 1 / |v| as x / sqrt((x*x + y*y) + z*z) and,
+  // like XMVector3Normalize, leaves zero vectors zero.
+  inline void ToUnitLength(float &x, float &y, float &z) {
+    float length = std::sqrt((x * x + y * y) + z * z);
+    x = length > 0.0f ? x / length : 0.0f;
+    y = length > 0.0f ? y / length : 0.0f;
+    z = length > 0.0f ? z / length : 0.0f;
+  }
+
+  inline void ToUnitLength(__m128 &x, __m128 &y, __m128 &z) {
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+    __m128 nonZero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+    x = _mm_and_ps(_mm_div_ps(x, length), nonZero);
+    y = _mm_and_ps(_mm_div_ps(y, length), nonZero);
+    z = _mm_and_ps(_mm_div_ps(z, length), nonZero);
+  }
+
+  RASTER_TARGET_AVX2
+  inline void ToUnitLength(__m256 &x, __m256 &y, __m256 &z) {
+    __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+    __m256 nonZero = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+    x = _mm256_and_ps(_mm256_div_ps(x, length), nonZero);
+    y = _mm256_and_ps(_mm256_div_ps(y, length), nonZero);
+    z = _mm256_and_ps(_mm256_div_ps(z, length), nonZero);
+  }
+
+  inline __m128 MidpointSSE(const float *s, const uint32_t *a, const uint32_t *b, __m128 half) {
+    __m128 va = _mm_setr_ps(s[a[0]], s[a[1]], s[a[2]], s[a[3]]);
+    __m128 vb = _mm_setr_ps(s[b[0]], s[b[1]], s[b[2]], s[b[3]]);
+    return _mm_mul_ps(_mm_add_ps(va, vb), half);
+  }
+
+  RASTER_TARGET_AVX2
+  inline __m256 MidpointAVX2(const float *s, __m256i a, __m256i b, __m256 half) {
+    return _mm256_mul_ps(_mm256_add_ps(_mm256_i32gather_ps(s, a, 4), _mm256_i32gather_ps(s, b, 4)), half);
+  }
+}
+
+MeshStreams::MeshStreams(const GeometryGenerator::MeshData &mesh) : mIsa(RasterKernels::DetectIsa()) {
+  Resize(mesh.Vertices.size());
+  for (size_t i = 0; i < mCount; i++) {
+    const GeometryGenerator::Vertex &v = mesh.Vertices[i];
+    PositionX[i] = v.Position.x; PositionY[i] = v.Position.y; PositionZ[i] = v.Position.z;
+    NormalX[i] = v.Normal.x; NormalY[i] = v.Normal.y; NormalZ[i] = v.Normal.z;
+    TangentX[i] = v.TangentU.x; TangentY[i] = v.TangentU.y; TangentZ[i] = v.TangentU.z;
+    TexU[i] = v.TexC.x; TexV[i] = v.TexC.y;
+  }
+  Indices32 = mesh.Indices32;
+}
+
+void MeshStreams::Resize(size_t count) {
+  size_t padded = (count + BatchPadding - 1) / BatchPadding * BatchPadding;
+  for (Stream *stream : { &PositionX, &PositionY, &PositionZ, &NormalX, &NormalY, &NormalZ,
+                          &TangentX, &TangentY, &TangentZ, &TexU, &TexV }) {
+    stream->resize(padded);
+  }
+  mCount = count;
+}
+
+void MeshStreams::Interleave(GeometryGenerator::Vertex *vertices) const {
+  for (size_t i = 0; i < mCount; i++) {
+    GeometryGenerator::Vertex &v = vertices[i];
+    v.Position = XMFLOAT3(PositionX[i], PositionY[i], PositionZ[i]);
+    v.Normal = XMFLOAT3(NormalX[i], NormalY[i], NormalZ[i]);
+    v.TangentU = XMFLOAT3(TangentX[i], TangentY[i], TangentZ[i]);
+    v.TexC = XMFLOAT2(TexU[i], TexV[i]);
+  }
+}
+
+GeometryGenerator::MeshData MeshStreams::ToMeshData() const {
+  GeometryGenerator::MeshData mesh;
+  mesh.Vertices.resize(mCount);
+  Interleave(mesh.Vertices.data());
+  mesh.Indices32 = Indices32;
+  return mesh;
+}
+
+void MeshStreams::Transform(const XMFLOAT4X4 &world) {
+  // Normals stay perpendicular to the surface under non-uniform scale only
+  // when multiplied by the inverse transpose.
+  XMMATRIX linear = XMLoadFloat4x4(&world);
+  linear.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+  XMFLOAT4X4 normal;
+  XMStoreFloat4x4(&normal, XMMatrixTranspose(XMMatrixInverse(nullptr, linear)));
+
+  Transforms m;
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 3; c++) {
+      m.Position[r][c] = world(r, c);
+      if (r < 3) {
+        m.Tangent[r][c] = world(r, c);
+        m.Normal[r][c] = normal(r, c);
+      }
+    }
+  }
+  switch (mIsa) {
+    case RasterKernels::Isa::AVX2:
+      TransformAVX2(m);
+      break;
+    case RasterKernels::Isa::SSE:
+      TransformSSE(m);
+      break;
+    default:
+      TransformScalar(m);
+      break;
+  }
+}
+
+void MeshStreams::Normalize() {
+  switch (mIsa) {
+    case RasterKernels::Isa::AVX2:
+      NormalizeAVX2();
+      break;
+    case RasterKernels::Isa::SSE:
+      NormalizeSSE();
+      break;
+    default:
+      NormalizeScalar();
+      break;
+  }
+}
+
+void MeshStreams::Midpoints(const uint32_t *first, const uint32_t *second, size_t count, MeshStreams &out) const {
+  out.Resize(count);
+  size_t done;
+  // The AVX2 gathers take signed 32-bit indices, so meshes with 2^31 or more
+  // vertices use the SSE kernel, which loads lane by lane.
+  RasterKernels::Isa isa = mIsa;
+  if (isa == RasterKernels::Isa::AVX2 && mCount > static_cast<size_t>(INT32_MAX)) {
+    isa = RasterKernels::Isa::SSE;
+  }
+  switch (isa) {
+    case RasterKernels::Isa::AVX2:
+      done = MidpointsAVX2(first, second, count, out);
+      break;
+    case RasterKernels::Isa::SSE:
+      done = MidpointsSSE(first, second, count, out);
+      break;
+    default:
+      done = 0;
+      break;
+  }
+  // The index arrays are not padded, so the last few are done one by one.
+  MidpointsScalar(first, second, done, count, out);
+}
+
+// Row-vector products: v' = x*row0 + y*row1 + z*row2 (+ row3 for points).
+void MeshStreams::TransformScalar(const Transforms &m) {
+  for (size_t i = 0; i < mCount; i++) {
+    float x = PositionX[i], y = PositionY[i], z = PositionZ[i];
+    PositionX[i] = ((x * m.Position[0][0] + y * m.Position[1][0]) + z * m.Position[2][0]) + m.Position[3][0];
+    PositionY[i] = ((x * m.Position[0][1] + y * m.Position[1][1]) + z * m.Position[2][1]) + m.Position[3][1];
+    PositionZ[i] = ((x * m.Position[0][2] + y * m.Position[1][2]) + z * m.Position[2][2]) + m.Position[3][2];
+
+    x = TangentX[i]; y = TangentY[i]; z = TangentZ[i];
+    float tx = (x * m.Tangent[0][0] + y * m.Tangent[1][0]) + z * m.Tangent[2][0];
+    float ty = (x * m.Tangent[0][1] + y * m.Tangent[1][1]) + z * m.Tangent[2][1];
+    float tz = (x * m.Tangent[0][2] + y * m.Tangent[1][2]) + z * m.Tangent[2][2];
+    ToUnitLength(tx, ty, tz);
+    TangentX[i] = tx; TangentY[i] = ty; TangentZ[i] = tz;
+
+    x = NormalX[i]; y = NormalY[i]; z = NormalZ[i];
+    float nx = (x * m.Normal[0][0] + y * m.Normal[1][0]) + z * m.Normal[2][0];
+    float ny = (x * m.Normal[0][1] + y * m.Normal[1][1]) + z * m.Normal[2][1];
+    float nz = (x * m.Normal[0][2] + y * m.Normal[1][2]) + z * m.Normal[2][2];
+    ToUnitLength(nx, ny, nz);
+    NormalX[i] = nx; NormalY[i] = ny; NormalZ[i] = nz;
+  }
+}
+
+void MeshStreams::TransformSSE(const Transforms &m) {
+  __m128 p[4][3], t[3][3], n[3][3];
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 3; c++) {
+      p[r][c] = _mm_set1_ps(m.Position[r][c]);
+      if (r < 3) {
+        t[r][c] = _mm_set1_ps(m.Tangent[r][c]);
+        n[r][c] = _mm_set1_ps(m.Normal[r][c]);
+      }
+    }
+  }
+  for (size_t i = 0; i < mCount; i += 4) {
+    __m128 x = _mm_load_ps(&PositionX[i]), y = _mm_load_ps(&PositionY[i]), z = _mm_load_ps(&PositionZ[i]);
+    __m128 out[3];
+    for (int c = 0; c < 3; c++) {
+      out[c] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, p[0][c]), _mm_mul_ps(y, p[1][c])), _mm_mul_ps(z, p[2][c])), p[3][c]);
+    }
+    _mm_store_ps(&PositionX[i], out[0]); _mm_store_ps(&PositionY[i], out[1]); _mm_store_ps(&PositionZ[i], out[2]);
+
+    x = _mm_load_ps(&TangentX[i]); y = _mm_load_ps(&TangentY[i]); z = _mm_load_ps(&TangentZ[i]);
+    for (int c = 0; c < 3; c++) {
+      out[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, t[0][c]), _mm_mul_ps(y, t[1][c])), _mm_mul_ps(z, t[2][c]));
+    }
+    ToUnitLength(out[0], out[1], out[2]);
+    _mm_store_ps(&TangentX[i], out[0]); _mm_store_ps(&TangentY[i], out[1]); _mm_store_ps(&TangentZ[i], out[2]);
+
+    x = _mm_load_ps(&NormalX[i]); y = _mm_load_ps(&NormalY[i]); z = _mm_load_ps(&NormalZ[i]);
+    for (int c = 0; c < 3; c++) {
+      out[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, n[0][c]), _mm_mul_ps(y, n[1][c])), _mm_mul_ps(z, n[2][c]));
+    }
+    ToUnitLength(out[0], out[1], out[2]);
+    _mm_store_ps(&NormalX[i], out[0]); _mm_store_ps(&NormalY[i], out[1]); _mm_store_ps(&NormalZ[i], out[2]);
+  }
+}
+
+RASTER_TARGET_AVX2
+void MeshStreams::TransformAVX2(const Transforms &m) {
+  __m256 p[4][3], t[3][3], n[3][3];
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 3; c++) {
+      p[r][c] = _mm256_set1_ps(m.Position[r][c]);
+      if (r < 3) {
+        t[r][c] = _mm256_set1_ps(m.Tangent[r][c]);
+        n[r][c] = _mm256_set1_ps(m.Normal[r][c]);
+      }
+    }
+  }
+  for (size_t i = 0; i < mCount; i += 8) {
+    __m256 x = _mm256_load_ps(&PositionX[i]), y = _mm256_load_ps(&PositionY[i]), z = _mm256_load_ps(&PositionZ[i]);
+    __m256 out[3];
+    for (int c = 0; c < 3; c++) {
+      out[c] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, p[0][c]), _mm256_mul_ps(y, p[1][c])),
+        _mm256_mul_ps(z, p[2][c])), p[3][c]);
+    }
+    _mm256_store_ps(&PositionX[i], out[0]); _mm256_store_ps(&PositionY[i], out[1]); _mm256_store_ps(&PositionZ[i], out[2]);
+
+    x = _mm256_load_ps(&TangentX[i]); y = _mm256_load_ps(&TangentY[i]); z = _mm256_load_ps(&TangentZ[i]);
+    for (int c = 0; c < 3; c++) {
+      out[c] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, t[0][c]), _mm256_mul_ps(y, t[1][c])), _mm256_mul_ps(z, t[2][c]));
+    }
+    ToUnitLength(out[0], out[1], out[2]);
+    _mm256_store_ps(&TangentX[i], out[0]); _mm256_store_ps(&TangentY[i], out[1]); _mm256_store_ps(&TangentZ[i], out[2]);
+
+    x = _mm256_load_ps(&NormalX[i]); y = _mm256_load_ps(&NormalY[i]); z = _mm256_load_ps(&NormalZ[i]);
+    for (int c = 0; c < 3; c++) {
+      out[c] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, n[0][c]), _mm256_mul_ps(y, n[1][c])), _mm256_mul_ps(z, n[2][c]));
+    }
+    ToUnitLength(out[0], out[1], out[2]);
+    _mm256_store_ps(&NormalX[i], out[0]); _mm256_store_ps(&NormalY[i], out[1]); _mm256_store_ps(&NormalZ[i], out[2]);
+  }
+}
+
+void MeshStreams::NormalizeScalar() {
+  for (size_t i = 0; i < mCount; i++) {
+    ToUnitLength(NormalX[i], NormalY[i], NormalZ[i]);
+    ToUnitLength(TangentX[i], TangentY[i], TangentZ[i]);
+  }
+}
+
+void MeshStreams::NormalizeSSE() {
+  for (size_t i = 0; i < mCount; i += 4) {
+    __m128 x = _mm_load_ps(&NormalX[i]), y = _mm_load_ps(&NormalY[i]), z = _mm_load_ps(&NormalZ[i]);
+    ToUnitLength(x, y, z);
+    _mm_store_ps(&NormalX[i], x); _mm_store_ps(&NormalY[i], y); _mm_store_ps(&NormalZ[i], z);
+    x = _mm_load_ps(&TangentX[i]); y = _mm_load_ps(&TangentY[i]); z = _mm_load_ps(&TangentZ[i]);
+    ToUnitLength(x, y, z);
+    _mm_store_ps(&TangentX[i], x); _mm_store_ps(&TangentY[i], y); _mm_store_ps(&TangentZ[i], z);
+  }
+}
+
+RASTER_TARGET_AVX2
+void MeshStreams::NormalizeAVX2() {
+  for (size_t i = 0; i < mCount; i += 8) {
+    __m256 x = _mm256_load_ps(&NormalX[i]), y = _mm256_load_ps(&NormalY[i]), z = _mm256_load_ps(&NormalZ[i]);
+    ToUnitLength(x, y, z);
+    _mm256_store_ps(&NormalX[i], x); _mm256_store_ps(&NormalY[i], y); _mm256_store_ps(&NormalZ[i], z);
+    x = _mm256_load_ps(&TangentX[i]); y = _mm256_load_ps(&TangentY[i]); z = _mm256_load_ps(&TangentZ[i]);
+    ToUnitLength(x, y, z);
+    _mm256_store_ps(&TangentX[i], x); _mm256_store_ps(&TangentY[i], y); _mm256_store_ps(&TangentZ[i], z);
+  }
+}
+
+// Midpoints gather their two vertices from every stream; the SIMD variants
+// do as many whole batches as fit in count and return how many that was.
+void MeshStreams::MidpointsScalar(const uint32_t *first, const uint32_t *second, size_t begin, size_t end,
+                                  MeshStreams &out) const {
+  for (size_t i = begin; i < end; i++) {
+    uint32_t a = first[i], b = second[i];
+    out.PositionX[i] = (PositionX[a] + PositionX[b]) * 0.5f;
+    out.PositionY[i] = (PositionY[a] + PositionY[b]) * 0.5f;
+    out.PositionZ[i] = (PositionZ[a] + PositionZ[b]) * 0.5f;
+    float nx = (NormalX[a] + NormalX[b]) * 0.5f, ny = (NormalY[a] + NormalY[b]) * 0.5f, nz = (NormalZ[a] + NormalZ[b]) * 0.5f;
+    ToUnitLength(nx, ny, nz);
+    out.NormalX[i] = nx; out.NormalY[i] = ny; out.NormalZ[i] = nz;
+    float tx = (TangentX[a] + TangentX[b]) * 0.5f, ty = (TangentY[a] + TangentY[b]) * 0.5f, tz = (TangentZ[a] + TangentZ[b]) * 0.5f;
+    ToUnitLength(tx, ty, tz);
+    out.TangentX[i] = tx; out.TangentY[i] = ty; out.TangentZ[i] = tz;
+    out.TexU[i] = (TexU[a] + TexU[b]) * 0.5f;
+    out.TexV[i] = (TexV[a] + TexV[b]) * 0.5f;
+  }
+}
+
+size_t MeshStreams::MidpointsSSE(const uint32_t *first, const uint32_t *second, size_t count, MeshStreams &out) const {
+  const __m128 half = _mm_set1_ps(0.5f);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const uint32_t *a = first + i, *b = second + i;
+    _mm_store_ps(&out.PositionX[i], MidpointSSE(PositionX.data(), a, b, half));
+    _mm_store_ps(&out.PositionY[i], MidpointSSE(PositionY.data(), a, b, half));
+    _mm_store_ps(&out.PositionZ[i], MidpointSSE(PositionZ.data(), a, b, half));
+    __m128 x = MidpointSSE(NormalX.data(), a, b, half);
+    __m128 y = MidpointSSE(NormalY.data(), a, b, half);
+    __m128 z = MidpointSSE(NormalZ.data(), a, b, half);
+    ToUnitLength(x, y, z);
+    _mm_store_ps(&out.NormalX[i], x); _mm_store_ps(&out.NormalY[i], y); _mm_store_ps(&out.NormalZ[i], z);
+    x = MidpointSSE(TangentX.data(), a, b, half);
+    y = MidpointSSE(TangentY.data(), a, b, half);
+    z = MidpointSSE(TangentZ.data(), a, b, half);
+    ToUnitLength(x, y, z);
+    _mm_store_ps(&out.TangentX[i], x); _mm_store_ps(&out.TangentY[i], y); _mm_store_ps(&out.TangentZ[i], z);
+    _mm_store_ps(&out.TexU[i], MidpointSSE(TexU.data(), a, b, half));
+    _mm_store_ps(&out.TexV[i], MidpointSSE(TexV.data(), a, b, half));
+  }
+  return i;
+}
+
+RASTER_TARGET_AVX2
+size_t MeshStreams::MidpointsAVX2(const uint32_t *first, const uint32_t *second, size_t count, MeshStreams &out) const {
+  const __m256 half = _mm256_set1_ps(0.5f);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + i));
+    _mm256_store_ps(&out.PositionX[i], MidpointAVX2(PositionX.data(), a, b, half));
+    _mm256_store_ps(&out.PositionY[i], MidpointAVX2(PositionY.data(), a, b, half));
+    _mm256_store_ps(&out.PositionZ[i], MidpointAVX2(PositionZ.data(), a, b, half));
+    __m256 x = MidpointAVX2(NormalX.data(), a, b, half);
+    __m256 y = MidpointAVX2(NormalY.data(), a, b, half);
+    __m256 z = MidpointAVX2(NormalZ.data(), a, b, half);
+    ToUnitLength(x, y, z);
+    _mm256_store_ps(&out.NormalX[i], x); _mm256_store_ps(&out.NormalY[i], y); _mm256_store_ps(&out.NormalZ[i], z);
+    x = MidpointAVX2(TangentX.data(), a, b, half);
+    y = MidpointAVX2(TangentY.data(), a, b, half);
+    z = MidpointAVX2(TangentZ.data(), a, b, half);
+    ToUnitLength(x, y, z);
+    _mm256_store_ps(&out.TangentX[i], x); _mm256_store_ps(&out.TangentY[i], y); _mm256_store_ps(&out.TangentZ[i], z);
+    _mm256_store_ps(&out.TexU[i], MidpointAVX2(TexU.data(), a, b, half));
+    _mm256_store_ps(&out.TexV[i], MidpointAVX2(TexV.data(), a, b, half));
+  }
+  return i;
+}
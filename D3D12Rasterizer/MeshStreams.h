@@ -0,0 +1,72 @@
+#pragma once
+#include "RasterKernels.h"
+#include "../Common/AlignedAllocator.h"
+#include "../Common/GeometryGenerator.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// GeometryGenerator::MeshData as structure-of-arrays: each component of each
+// vertex attribute is its own 32-byte aligned stream, so bulk passes over
+// one attribute (transforming positions, renormalizing normals) touch only
+// that attribute and run on 4 (SSE) or 8 (AVX2) vertices per instruction.
+// Streams are padded to a multiple of 8, so the wide kernels never need a
+// remainder loop; the padding's values are meaningless. Every variant uses
+// the same operation order, so the SIMD results are identical to the scalar
+// reference. Interleave() converts back to the vertex layout for upload.
+class MeshStreams {
+public:
+  typedef std::vector<float, AlignedAllocator<float>> Stream;
+
+  Stream PositionX, PositionY, PositionZ;
+  Stream NormalX, NormalY, NormalZ;
+  Stream TangentX, TangentY, TangentZ;
+  Stream TexU, TexV;
+  std::vector<uint32_t> Indices32;
+
+  MeshStreams() : mIsa(RasterKernels::DetectIsa()) {}
+  explicit MeshStreams(const GeometryGenerator::MeshData &mesh);
+
+  size_t Size() const { return mCount; }
+  void Resize(size_t count);
+
+  // Writes Size() vertices to vertices.
+  void Interleave(GeometryGenerator::Vertex *vertices) const;
+  GeometryGenerator::MeshData ToMeshData() const;
+
+  // Transforms positions by the (row-vector) world matrix, tangents by its
+  // upper 3x3 and normals by that one's inverse transpose, then renormalizes
+  // normals and tangents.
+  void Transform(const DirectX::XMFLOAT4X4 &world);
+  // Rescales normals and tangents to unit length; zero ones stay zero.
+  void Normalize();
+  // Makes out[i] the midpoint of vertices first[i] and second[i], like
+  // GeometryGenerator::MidPoint: positions and texture coordinates averaged,
+  // normals and tangents averaged and renormalized. out must not be this.
+  void Midpoints(const uint32_t *first, const uint32_t *second, size_t count, MeshStreams &out) const;
+
+  RasterKernels::Isa KernelIsa() const { return mIsa; }
+  // Overrides the detected kernel, e.g. to compare against the scalar reference.
+  void SetIsa(RasterKernels::Isa isa) { mIsa = isa; }
+
+private:
+  // Rows of the matrices the directions are multiplied by.
+  struct Transforms {
+    float Position[4][3];
+    float Tangent[3][3];
+    float Normal[3][3];
+  };
+
+  void TransformScalar(const Transforms &m);
+  void TransformSSE(const Transforms &m);
+  void TransformAVX2(const Transforms &m);
+  void NormalizeScalar();
+  void NormalizeSSE();
+  void NormalizeAVX2();
+  void MidpointsScalar(const uint32_t *first, const uint32_t *second, size_t begin, size_t end, MeshStreams &out) const;
+  size_t MidpointsSSE(const uint32_t *first, const uint32_t *second, size_t count, MeshStreams &out) const;
+  size_t MidpointsAVX2(const uint32_t *first, const uint32_t *second, size_t count, MeshStreams &out) const;
+
+  size_t mCount = 0;
+  RasterKernels::Isa mIsa;
+};
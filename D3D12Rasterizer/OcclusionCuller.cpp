@@ -0,0 +1,154 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+using namespace DirectX;
+
+namespace {
+  // Covers the few ulps by which the software rasterizer's barycentric depth
+  // can differ from the plane equation evaluated here.
+  const float DepthBias = 1.0e-6f;
+
+  XMFLOAT3 LoadPosition(const unsigned char *vertices, unsigned int stride, int index) {
+    XMFLOAT3 pos;
+    memcpy(&pos, vertices + static_cast<size_t>(index) * stride, sizeof pos);
+    return pos;
+  }
+
+  // Clamps before converting so far guard-band coordinates cannot overflow int.
+  int ClampToPixel(float v, int size) {
+    return static_cast<int>(std::min(std::max(v, 0.0f), static_cast<float>(size - 1)));
+  }
+}
+
+OcclusionCuller::OcclusionCuller()
+  : mCoverage(RasterKernels::SelectCoverage(RasterKernels::DetectIsa())), mDepth(Width * Height, 1.0f) {
+  XMStoreFloat4x4(&mViewProj, XMMatrixIdentity());
+}
+
+void OcclusionCuller::BeginFrame(const XMFLOAT4X4 &viewProj) {
+  mViewProj = viewProj;
+  std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+}
+
+void OcclusionCuller::ResetStats() {
+  mOccluderTriangles = 0;
+  mTested = 0;
+  mCulled = 0;
+}
+
+void OcclusionCuller::AddOccluder(const void *vertices, unsigned int vertexStride,
+                                  const void *indices, bool indices16,
+                                  unsigned int indexCount, unsigned int startIndex, int baseVertex,
+                                  const XMFLOAT4X4 &world) {
+  XMMATRIX worldViewProj = XMLoadFloat4x4(&world) * XMLoadFloat4x4(&mViewProj);
+  const unsigned char *src = static_cast<const unsigned char*>(vertices);
+  for (unsigned int i = 0; i + 3 <= indexCount; i += 3) {
+    XMFLOAT4 clip[3];
+    for (unsigned int k = 0; k < 3; k++) {
+      unsigned int index = indices16 ? static_cast<const uint16_t*>(indices)[startIndex + i + k]
+                                     : static_cast<const uint32_t*>(indices)[startIndex + i + k];
+      XMFLOAT3 pos = LoadPosition(src, vertexStride, static_cast<int>(index) + baseVertex);
+      XMStoreFloat4(&clip[k], XMVector3Transform(XMLoadFloat3(&pos), worldViewProj));
+    }
+    if (clip[0].z < 0.0f || clip[1].z < 0.0f || clip[2].z < 0.0f) {
+      continue;
+    }
+    RasterizeOccluder(clip);
+  }
+}
+
+void OcclusionCuller::RasterizeOccluder(const XMFLOAT4 clip[3]) {
+  float x[3], y[3], z[3];
+  for (int i = 0; i < 3; i++) {
+    float invW = 1.0f / clip[i].w;
+    x[i] = (clip[i].x * invW * 0.5f + 0.5f) * Width;
+    y[i] = (0.5f - clip[i].y * invW * 0.5f) * Height;
+    z[i] = clip[i].z * invW;
+  }
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  float maxZ = std::max({ z[0], z[1], z[2] });
+  if (!(area > 0.0f) || maxZ > 1.0f) {
+    return;
+  }
+  float left = std::min({ x[0], x[1], x[2] }), right = std::max({ x[0], x[1], x[2] });
+  float top = std::min({ y[0], y[1], y[2] }), bottom = std::max({ y[0], y[1], y[2] });
+  if (right <= 0.0f || left >= Width || bottom <= 0.0f || top >= Height) {
+    return;
+  }
+  int minX = ClampToPixel(std::floor(left), Width), maxX = ClampToPixel(std::ceil(right), Width);
+  int minY = ClampToPixel(std::floor(top), Height), maxY = ClampToPixel(std::ceil(bottom), Height);
+  mOccluderTriangles++;
+
+  // Moving every edge inwards by half a pixel along both axes makes the
+  // pixel-center coverage kernels report only fully covered pixels.
+  RasterKernels::EdgeFunctions edges = RasterKernels::SetupEdges(x, y);
+  RasterKernels::EdgeFunctions inner = edges;
+  for (int i = 0; i < 3; i++) {
+    inner.C[i] -= 0.5f * (std::fabs(edges.A[i]) + std::fabs(edges.B[i]));
+    inner.TopLeft[i] = 0;
+  }
+
+  // Depth is affine in screen space; its maximum over a pixel is at a corner.
+  float invArea = 1.0f / area;
+  float dzdx = (edges.A[0] * z[0] + edges.A[1] * z[1] + edges.A[2] * z[2]) * invArea;
+  float dzdy = (edges.B[0] * z[0] + edges.B[1] * z[1] + edges.B[2] * z[2]) * invArea;
+  float z0 = (edges.C[0] * z[0] + edges.C[1] * z[1] + edges.C[2] * z[2]) * invArea;
+  float cornerOffset = 0.5f * (std::fabs(dzdx) + std::fabs(dzdy)) + DepthBias;
+
+  for (int py = minY; py <= maxY; py++) {
+    float *row = &mDepth[py * Width];
+    float cy = py + 0.5f;
+    for (int spanX = minX; spanX <= maxX; spanX += 64) {
+      int count = std::min(64, maxX - spanX + 1);
+      for (uint64_t mask = mCoverage(inner, spanX, py, count); mask; mask &= mask - 1) {
+        int px = spanX + RasterKernels::LowestBit(mask);
+        float depth = std::min(z0 + dzdx * (px + 0.5f) + dzdy * cy + cornerOffset, maxZ);
+        row[px] = std::min(row[px], depth);
+      }
+    }
+  }
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox &bounds, const XMFLOAT4X4 &world) {
+  mTested.fetch_add(1, std::memory_order_relaxed);
+  XMMATRIX worldViewProj = XMLoadFloat4x4(&world) * XMLoadFloat4x4(&mViewProj);
+  XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+  bounds.GetCorners(corners);
+
+  // The projected box is convex, so its screen extent and nearest depth are
+  // reached at the corners.
+  float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+  for (const XMFLOAT3 &corner : corners) {
+    XMFLOAT4 clip;
+    XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corner), worldViewProj));
+    if (clip.z < 0.0f) {
+      // Crosses the near plane: the occluders cannot be in front of all of it.
+      return true;
+    }
+    float invW = 1.0f / clip.w;
+    float sx = (clip.x * invW * 0.5f + 0.5f) * Width;
+    float sy = (0.5f - clip.y * invW * 0.5f) * Height;
+    minX = std::min(minX, sx);
+    maxX = std::max(maxX, sx);
+    minY = std::min(minY, sy);
+    maxY = std::max(maxY, sy);
+    minZ = std::min(minZ, clip.z * invW);
+  }
+
+  int x0 = ClampToPixel(std::floor(minX), Width), x1 = ClampToPixel(std::ceil(maxX), Width);
+  int y0 = ClampToPixel(std::floor(minY), Height), y1 = ClampToPixel(std::ceil(maxY), Height);
+  if (maxX > 0.0f && minX < Width && maxY > 0.0f && minY < Height && minZ <= 1.0f) {
+    for (int py = y0; py <= y1; py++) {
+      const float *row = &mDepth[py * Width];
+      for (int px = x0; px <= x1; px++) {
+        if (minZ < row[px]) {
+          return true;
+        }
+      }
+    }
+  }
+  mCulled.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
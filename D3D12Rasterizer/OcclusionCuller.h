@@ -0,0 +1,61 @@
+#pragma once
+#include "RasterKernels.h"
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Object-level occlusion culling against a small CPU depth buffer. A few large
+// occluders are rasterized each frame, then the screen rectangle and nearest
+// depth of each object's bounding box are tested against it before the object
+// is submitted.
+//
+// The test is conservative: occluders only write pixels they cover entirely,
+// with the farthest depth of the triangle over that pixel, so an object is
+// culled only if every pixel it could touch at full resolution is behind an
+// occluder. Matrices are row-vector (not transposed) like Rasterizer::mView.
+class OcclusionCuller {
+public:
+  static const int Width = 256;
+  static const int Height = 128;
+
+  struct Stats {
+    uint64_t OccluderTriangles = 0;  // occluder triangles rasterized
+    uint64_t Tested = 0;             // IsVisible calls
+    uint64_t Culled = 0;             // IsVisible calls that returned false
+  };
+
+  OcclusionCuller();
+
+  // Clears the depth buffer to the far plane and sets the camera for the frame.
+  void BeginFrame(const DirectX::XMFLOAT4X4 &viewProj);
+
+  // vertices start with a float3 position; the rest of the stride is ignored.
+  // Triangles crossing the near plane are skipped, which only weakens occlusion.
+  void AddOccluder(const void *vertices, unsigned int vertexStride,
+                   const void *indices, bool indices16,
+                   unsigned int indexCount, unsigned int startIndex, int baseVertex,
+                   const DirectX::XMFLOAT4X4 &world);
+
+  // False if the object-space box transformed by world is hidden by the
+  // occluders added since BeginFrame, or lies entirely off screen. Only reads
+  // the depth buffer, so several threads may call it at once once the
+  // frame's occluders are added.
+  bool IsVisible(const DirectX::BoundingBox &bounds, const DirectX::XMFLOAT4X4 &world);
+
+  // Width*Height depths, row-major, for debugging and validation.
+  const float *Depth() const { return mDepth.data(); }
+
+  Stats GetStats() const { return { mOccluderTriangles, mTested.load(), mCulled.load() }; }
+  void ResetStats();
+
+private:
+  void RasterizeOccluder(const DirectX::XMFLOAT4 clip[3]);
+
+  RasterKernels::CoverageFn mCoverage;
+  DirectX::XMFLOAT4X4 mViewProj;
+  std::vector<float> mDepth;
+  uint64_t mOccluderTriangles = 0;
+  std::atomic<uint64_t> mTested{ 0 }, mCulled{ 0 };
+};
@@ -0,0 +1,61 @@
+#include "OverdrawSimulator.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+using namespace DirectX;
+
+OverdrawSimulator::OverdrawSimulator(int resolution, unsigned int viewCount, unsigned int threadCount)
+  : mRasterizer(threadCount) {
+  // Fibonacci sphere: equal-area bands, each point turned by the golden angle.
+  const float goldenAngle = XM_PI * (3.0f - std::sqrt(5.0f));
+  for (unsigned int i = 0; i < viewCount; i++) {
+    float y = 1.0f - 2.0f * (i + 0.5f) / viewCount;
+    float r = std::sqrt(1.0f - y * y);
+    float phi = goldenAngle * i;
+    mDirections.push_back(XMFLOAT3(r * std::cos(phi), y, r * std::sin(phi)));
+  }
+  mRasterizer.Resize(resolution, resolution);
+  mDepth.resize(static_cast<size_t>(resolution) * resolution);
+}
+
+OverdrawSimulator::Stats OverdrawSimulator::Measure(const void *vertices, unsigned int vertexStride, const void *indices,
+                                                    bool indices16, unsigned int indexCount, unsigned int startIndex,
+                                                    int baseVertex) {
+  Stats stats;
+  if (indexCount == 0) {
+    return stats;
+  }
+  XMVECTOR lo = XMVectorReplicate(FLT_MAX), hi = XMVectorReplicate(-FLT_MAX);
+  for (unsigned int i = startIndex; i < startIndex + indexCount; i++) {
+    uint32_t index = indices16 ? static_cast<const uint16_t*>(indices)[i] : static_cast<const uint32_t*>(indices)[i];
+    XMFLOAT3 p;
+    memcpy(&p, static_cast<const unsigned char*>(vertices) + static_cast<size_t>(index + baseVertex) * vertexStride, sizeof p);
+    lo = XMVectorMin(lo, XMLoadFloat3(&p));
+    hi = XMVectorMax(hi, XMLoadFloat3(&p));
+  }
+  XMVECTOR center = 0.5f * (lo + hi);
+  float radius = std::max(0.5f * XMVectorGetX(XMVector3Length(hi - lo)), 1e-3f);
+
+  // Each camera looks at the center from just far enough away to see the
+  // whole bounding sphere.
+  const float fov = 0.25f * XM_PI;
+  float distance = radius / std::sin(0.5f * fov);
+  XMMATRIX proj = XMMatrixPerspectiveFovLH(fov, 1.0f, std::max(distance - radius, 0.01f * radius), distance + radius);
+  const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+  for (const XMFLOAT3 &direction : mDirections) {
+    XMVECTOR eye = center + distance * XMLoadFloat3(&direction);
+    XMVECTOR up = std::fabs(direction.y) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    XMFLOAT4X4 worldViewProj;
+    XMStoreFloat4x4(&worldViewProj, XMMatrixTranspose(XMMatrixLookAtLH(eye, center, up) * proj));
+
+    mRasterizer.Clear(clearColor, 1.0f);
+    mRasterizer.ResetStats();
+    mRasterizer.DrawIndexed(vertices, vertexStride, indices, indices16, indexCount, startIndex, baseVertex, worldViewProj);
+    mRasterizer.Flush();
+    stats.Shaded += mRasterizer.GetStats().Pixels;
+    mRasterizer.ResolveDepth(mDepth.data());
+    stats.Covered += std::count_if(mDepth.begin(), mDepth.end(), [](float depth) { return depth < 1.0f; });
+  }
+  return stats;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "SoftwareRasterizer.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// Measures how often a mesh shades each pixel it covers. The mesh is drawn
+// on the SoftwareRasterizer, with back-face culling and early depth testing
+// like an opaque D3D12 draw, from viewpoints spread evenly around its bounds.
+// Shaded pixels are the ones that passed the depth test, i.e. pixel shader
+// invocations, so triangle order matters: nearer surfaces drawn first hide
+// the ones behind them.
+class OverdrawSimulator {
+public:
+  struct Stats {
+    uint64_t Covered = 0; // pixels the mesh covers, summed over views
+    uint64_t Shaded = 0;  // pixels shaded, summed over views
+
+    // Shaded per covered pixel, 1 at best.
+    double Overdraw() const { return Covered ? static_cast<double>(Shaded) / Covered : 0.0; }
+  };
+
+  // threadCount == 0 uses every hardware thread.
+  explicit OverdrawSimulator(int resolution = 256, unsigned int viewCount = 32, unsigned int threadCount = 0);
+
+  // Arguments as for SoftwareRasterizer::DrawIndexed, e.g. a MeshGeometry's
+  // CPU buffers and one of its submeshes; positions are in object space.
+  Stats Measure(const void *vertices, unsigned int vertexStride, const void *indices, bool indices16,
+                unsigned int indexCount, unsigned int startIndex = 0, int baseVertex = 0);
+
+  unsigned int ViewCount() const { return static_cast<unsigned int>(mDirections.size()); }
+
+private:
+  // Unit vectors from the mesh towards each camera.
+  std::vector<DirectX::XMFLOAT3> mDirections;
+  SoftwareRasterizer mRasterizer;
+  std::vector<float> mDepth;
+};
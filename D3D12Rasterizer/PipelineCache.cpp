@@ -0,0 +1,135 @@
+#include "PipelineCache.h"
+#include "../Common/Hash.h"
+#include <cassert>
+#include <cstring>
+using Microsoft::WRL::ComPtr;
+
+namespace {
+  uint64_t ShaderHash(const D3D12_SHADER_BYTECODE &shader) {
+    return shader.pShaderBytecode && shader.BytecodeLength ? Fnv1a::Hash(shader.pShaderBytecode, shader.BytecodeLength) : 0;
+  }
+
+  PipelineDesc::StencilOps Stencil(const D3D12_DEPTH_STENCILOP_DESC &ops) {
+    return { static_cast<uint32_t>(ops.StencilFailOp), static_cast<uint32_t>(ops.StencilDepthFailOp),
+             static_cast<uint32_t>(ops.StencilPassOp), static_cast<uint32_t>(ops.StencilFunc) };
+  }
+}
+
+ID3D12PipelineState *PipelineCache::Get(const D3D12_GRAPHICS_PIPELINE_STATE_DESC &desc, uint64_t rootSignature) {
+  PipelineKey key(Describe(desc, rootSignature));
+  auto found = mPipelines.find(key);
+  if (found != mPipelines.end()) {
+    mStats.MemoryHits++;
+    return found->second.Get();
+  }
+  ComPtr<ID3D12PipelineState> pipeline = Create(key, desc);
+  return mPipelines.emplace(key, pipeline).first->second.Get();
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::Create(const PipelineKey &key, const D3D12_GRAPHICS_PIPELINE_STATE_DESC &desc) {
+  // A stored entry is the key's word count and words, then the driver blob.
+  ComPtr<ID3D12PipelineState> pipeline;
+  std::vector<uint8_t> entry;
+  const std::vector<uint32_t> &words = key.Words();
+  size_t wordBytes = sizeof(uint32_t) * (words.size() + 1);
+  if (mStore.Read(key.Hash(), entry) && entry.size() > wordBytes) {
+    uint32_t count;
+    memcpy(&count, entry.data(), sizeof(count));
+    if (count == words.size() && memcmp(entry.data() + sizeof(count), words.data(), count * sizeof(uint32_t)) == 0) {
+      D3D12_GRAPHICS_PIPELINE_STATE_DESC cached = desc;
+      cached.CachedPSO = { entry.data() + wordBytes, entry.size() - wordBytes };
+      if (SUCCEEDED(mDevice->CreateGraphicsPipelineState(&cached, IID_PPV_ARGS(pipeline.GetAddressOf())))) {
+        mStats.DiskHits++;
+        return pipeline;
+      }
+      // D3D12_ERROR_DRIVER_VERSION_MISMATCH or ADAPTER_NOT_FOUND: compile anew.
+      // The stale blob goes now, so it is not offered again even if the new
+      // one cannot be stored.
+      mStats.Rejected++;
+      mStore.Remove(key.Hash());
+    }
+  }
+  ThrowIfFailed(mDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(pipeline.GetAddressOf())));
+  mStats.Created++;
+  Store(key, pipeline.Get());
+  return pipeline;
+}
+
+void PipelineCache::Store(const PipelineKey &key, ID3D12PipelineState *pipeline) {
+  ComPtr<ID3DBlob> blob;
+  if (FAILED(pipeline->GetCachedBlob(blob.GetAddressOf()))) {
+    return;
+  }
+  const std::vector<uint32_t> &words = key.Words();
+  uint32_t count = static_cast<uint32_t>(words.size());
+  std::vector<uint8_t> entry(sizeof(count) + count * sizeof(uint32_t) + blob->GetBufferSize());
+  memcpy(entry.data(), &count, sizeof(count));
+  memcpy(entry.data() + sizeof(count), words.data(), count * sizeof(uint32_t));
+  memcpy(entry.data() + sizeof(count) + count * sizeof(uint32_t), blob->GetBufferPointer(), blob->GetBufferSize());
+  mStore.Write(key.Hash(), entry.data(), entry.size());
+}
+
+PipelineDesc PipelineCache::Describe(const D3D12_GRAPHICS_PIPELINE_STATE_DESC &desc, uint64_t rootSignature) {
+  // Stream output is not part of the key.
+  assert(desc.StreamOutput.NumEntries == 0);
+  PipelineDesc d;
+  d.RootSignature = rootSignature;
+  d.Shaders[PipelineDesc::VS] = ShaderHash(desc.VS);
+  d.Shaders[PipelineDesc::PS] = ShaderHash(desc.PS);
+  d.Shaders[PipelineDesc::DS] = ShaderHash(desc.DS);
+  d.Shaders[PipelineDesc::HS] = ShaderHash(desc.HS);
+  d.Shaders[PipelineDesc::GS] = ShaderHash(desc.GS);
+
+  for (UINT i = 0; i < desc.InputLayout.NumElements; i++) {
+    const D3D12_INPUT_ELEMENT_DESC &e = desc.InputLayout.pInputElementDescs[i];
+    d.InputLayout.push_back({ e.SemanticName, e.SemanticIndex, static_cast<uint32_t>(e.Format), e.InputSlot,
+      e.AlignedByteOffset, static_cast<uint32_t>(e.InputSlotClass), e.InstanceDataStepRate });
+  }
+
+  const D3D12_RASTERIZER_DESC &r = desc.RasterizerState;
+  d.FillMode = r.FillMode;
+  d.CullMode = r.CullMode;
+  d.FrontCounterClockwise = r.FrontCounterClockwise;
+  d.DepthBias = r.DepthBias;
+  d.DepthBiasClamp = r.DepthBiasClamp;
+  d.SlopeScaledDepthBias = r.SlopeScaledDepthBias;
+  d.DepthClipEnable = r.DepthClipEnable;
+  d.MultisampleEnable = r.MultisampleEnable;
+  d.AntialiasedLineEnable = r.AntialiasedLineEnable;
+  d.ForcedSampleCount = r.ForcedSampleCount;
+  d.ConservativeRaster = r.ConservativeRaster;
+
+  d.AlphaToCoverageEnable = desc.BlendState.AlphaToCoverageEnable;
+  d.IndependentBlendEnable = desc.BlendState.IndependentBlendEnable;
+  for (int i = 0; i < PipelineDesc::MaxRenderTargets; i++) {
+    const D3D12_RENDER_TARGET_BLEND_DESC &b = desc.BlendState.RenderTarget[i];
+    d.Blend[i] = { static_cast<uint32_t>(b.BlendEnable), static_cast<uint32_t>(b.LogicOpEnable),
+      static_cast<uint32_t>(b.SrcBlend), static_cast<uint32_t>(b.DestBlend), static_cast<uint32_t>(b.BlendOp),
+      static_cast<uint32_t>(b.SrcBlendAlpha), static_cast<uint32_t>(b.DestBlendAlpha), static_cast<uint32_t>(b.BlendOpAlpha),
+      static_cast<uint32_t>(b.LogicOp), b.RenderTargetWriteMask };
+  }
+  d.SampleMask = desc.SampleMask;
+
+  const D3D12_DEPTH_STENCIL_DESC &ds = desc.DepthStencilState;
+  d.DepthEnable = ds.DepthEnable;
+  d.DepthWriteMask = ds.DepthWriteMask;
+  d.DepthFunc = ds.DepthFunc;
+  d.StencilEnable = ds.StencilEnable;
+  d.StencilReadMask = ds.StencilReadMask;
+  d.StencilWriteMask = ds.StencilWriteMask;
+  d.FrontFace = Stencil(ds.FrontFace);
+  d.BackFace = Stencil(ds.BackFace);
+
+  d.IBStripCutValue = desc.IBStripCutValue;
+  d.PrimitiveTopologyType = desc.PrimitiveTopologyType;
+  d.NumRenderTargets = desc.NumRenderTargets;
+  for (int i = 0; i < PipelineDesc::MaxRenderTargets; i++) {
+    d.RTVFormats[i] = desc.RTVFormats[i];
+  }
+  d.DSVFormat = desc.DSVFormat;
+  d.SampleCount = desc.SampleDesc.Count;
+  d.SampleQuality = desc.SampleDesc.Quality;
+  d.NodeMask = desc.NodeMask;
+  d.Flags = desc.Flags;
+  return d;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/BlobStore.h"
+#include "../Common/PipelineKey.h"
+#include <unordered_map>
+
+// Graphics pipelines by canonical desc. Each pipeline is created once per
+// run; its driver blob (GetCachedBlob) is kept in a BlobStore and passed
+// back as CachedPSO on the next run, which lets the driver skip compiling
+// it. Blobs the driver rejects, e.g. after a driver update, are replaced.
+class PipelineCache {
+public:
+  struct Stats {
+    uint64_t MemoryHits, DiskHits, Created, Rejected;
+  };
+
+  // The directory must exist.
+  PipelineCache(ID3D12Device *device, const std::string &directory) : mDevice(device), mStore(directory, ".pso") {}
+
+  // rootSignature identifies desc.pRootSignature across runs, e.g. a hash of
+  // its serialized blob. The pipeline lives as long as the cache.
+  ID3D12PipelineState *Get(const D3D12_GRAPHICS_PIPELINE_STATE_DESC &desc, uint64_t rootSignature);
+
+  static PipelineDesc Describe(const D3D12_GRAPHICS_PIPELINE_STATE_DESC &desc, uint64_t rootSignature);
+
+  const Stats &GetStats() const { return mStats; }
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12PipelineState> Create(const PipelineKey &key, const D3D12_GRAPHICS_PIPELINE_STATE_DESC &desc);
+  void Store(const PipelineKey &key, ID3D12PipelineState *pipeline);
+
+  ID3D12Device *mDevice;
+  BlobStore mStore;
+  std::unordered_map<PipelineKey, Microsoft::WRL::ComPtr<ID3D12PipelineState>, PipelineKey::Hasher> mPipelines;
+  Stats mStats = {};
+};
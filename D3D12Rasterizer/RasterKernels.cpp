@@ -0,0 +1,162 @@
+#include "RasterKernels.h"
+#include <immintrin.h>
+#if !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace RasterKernels {
+  namespace {
+    void CpuId(int leaf, int subLeaf, int regs[4]) {
+#if defined(_MSC_VER)
+      __cpuidex(regs, leaf, subLeaf);
+#else
+      unsigned int a, b, c, d;
+      __cpuid_count(leaf, subLeaf, a, b, c, d);
+      regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+    }
+
+    unsigned long long ReadXcr0() {
+#if defined(_MSC_VER)
+      return _xgetbv(0);
+#else
+      unsigned int lo, hi;
+      __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+      return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+    }
+
+    uint64_t CountMask(int count) {
+      return count >= 64 ? ~0ull : (1ull << count) - 1;
+    }
+  }
+
+  EdgeFunctions SetupEdges(const float x[3], const float y[3]) {
+    EdgeFunctions edges;
+    for (int i = 0; i < 3; i++) {
+      int j = (i + 1) % 3, k = (i + 2) % 3;
+      edges.A[i] = y[j] - y[k];
+      edges.B[i] = x[k] - x[j];
+      edges.C[i] = x[j] * y[k] - x[k] * y[j];
+      // Left edges have the interior to their right, top edges are horizontal
+      // with the interior below.
+      edges.TopLeft[i] = edges.A[i] > 0.0f || (edges.A[i] == 0.0f && edges.B[i] > 0.0f);
+    }
+    return edges;
+  }
+
+  uint64_t CoverageScalar(const EdgeFunctions &edges, int x, int y, int count) {
+    float cy = y + 0.5f;
+    uint64_t mask = 0;
+    for (int i = 0; i < count; i++) {
+      float cx = (x + i) + 0.5f;
+      bool inside = true;
+      for (int e = 0; e < 3 && inside; e++) {
+        float value = edges.A[e] * cx + edges.B[e] * cy + edges.C[e];
+        inside = value > 0.0f || (value == 0.0f && edges.TopLeft[e]);
+      }
+      if (inside) {
+        mask |= 1ull << i;
+      }
+    }
+    return mask;
+  }
+
+  uint64_t CoverageSSE(const EdgeFunctions &edges, int x, int y, int count) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 cy = _mm_set1_ps(y + 0.5f);
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 a[3], by[3], c[3], topLeft[3];
+    for (int e = 0; e < 3; e++) {
+      a[e] = _mm_set1_ps(edges.A[e]);
+      by[e] = _mm_mul_ps(_mm_set1_ps(edges.B[e]), cy);
+      c[e] = _mm_set1_ps(edges.C[e]);
+      topLeft[e] = _mm_castsi128_ps(_mm_set1_epi32(edges.TopLeft[e] ? -1 : 0));
+    }
+
+    uint64_t mask = 0;
+    for (int i = 0; i < count; i += 4) {
+      // x + i is exact in float for any realistic target size, so adding the
+      // lane offset before the 0.5 matches the scalar (x + i) + 0.5.
+      __m128 cx = _mm_add_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x + i)), lane), _mm_set1_ps(0.5f));
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int e = 0; e < 3; e++) {
+        __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[e], cx), by[e]), c[e]);
+        __m128 edgeInside = _mm_or_ps(_mm_cmpgt_ps(value, zero), _mm_and_ps(_mm_cmpeq_ps(value, zero), topLeft[e]));
+        inside = _mm_and_ps(inside, edgeInside);
+      }
+      mask |= static_cast<uint64_t>(_mm_movemask_ps(inside)) << i;
+    }
+    return mask & CountMask(count);
+  }
+
+  RASTER_TARGET_AVX2
+  uint64_t CoverageAVX2(const EdgeFunctions &edges, int x, int y, int count) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 cy = _mm256_set1_ps(y + 0.5f);
+    const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    __m256 a[3], by[3], c[3], topLeft[3];
+    for (int e = 0; e < 3; e++) {
+      a[e] = _mm256_set1_ps(edges.A[e]);
+      by[e] = _mm256_mul_ps(_mm256_set1_ps(edges.B[e]), cy);
+      c[e] = _mm256_set1_ps(edges.C[e]);
+      topLeft[e] = _mm256_castsi256_ps(_mm256_set1_epi32(edges.TopLeft[e] ? -1 : 0));
+    }
+
+    uint64_t mask = 0;
+    for (int i = 0; i < count; i += 8) {
+      __m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(x + i)), lane), _mm256_set1_ps(0.5f));
+      __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+      for (int e = 0; e < 3; e++) {
+        __m256 value = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[e], cx), by[e]), c[e]);
+        __m256 edgeInside = _mm256_or_ps(_mm256_cmp_ps(value, zero, _CMP_GT_OQ),
+          _mm256_and_ps(_mm256_cmp_ps(value, zero, _CMP_EQ_OQ), topLeft[e]));
+        inside = _mm256_and_ps(inside, edgeInside);
+      }
+      mask |= static_cast<uint64_t>(_mm256_movemask_ps(inside)) << i;
+    }
+    return mask & CountMask(count);
+  }
+
+  Isa DetectIsa() {
+    int regs[4];
+    CpuId(0, 0, regs);
+    int maxLeaf = regs[0];
+    CpuId(1, 0, regs);
+    bool sse2 = (regs[3] & (1 << 26)) != 0;
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7) {
+      CpuId(7, 0, regs);
+      avx2 = (regs[1] & (1 << 5)) != 0;
+    }
+    // The OS must also save the YMM state on context switches.
+    if (osxsave && avx && avx2 && (ReadXcr0() & 0x6) == 0x6) {
+      return Isa::AVX2;
+    }
+    return sse2 ? Isa::SSE : Isa::Scalar;
+  }
+
+  CoverageFn SelectCoverage(Isa isa) {
+    switch (isa) {
+      case Isa::AVX2:
+        return CoverageAVX2;
+      case Isa::SSE:
+        return CoverageSSE;
+      default:
+        return CoverageScalar;
+    }
+  }
+
+  const char *IsaName(Isa isa) {
+    switch (isa) {
+      case Isa::AVX2:
+        return "AVX2";
+      case Isa::SSE:
+        return "SSE";
+      default:
+        return "Scalar";
+    }
+  }
+}
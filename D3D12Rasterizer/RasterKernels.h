@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// MSVC emits AVX2 intrinsics without /arch:AVX2; GCC and Clang need the
+// function to opt in. Either way the kernel is only called after DetectIsa().
+#if defined(_MSC_VER)
+#define RASTER_TARGET_AVX2
+#else
+#define RASTER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Half-space coverage kernels for the software rasterizer. Every kernel
+// evaluates E_i(x, y) = A_i*x + B_i*y + C_i with the same operation order, so
+// the SIMD variants are bit-identical to the scalar reference.
+namespace RasterKernels {
+  enum class Isa { Scalar, SSE, AVX2 };
+
+  // Edge i is positive inside the triangle. TopLeft[i] != 0 marks edges that
+  // own pixels whose centers lie exactly on them (D3D top-left rule).
+  struct EdgeFunctions {
+    float A[3], B[3], C[3];
+    uint32_t TopLeft[3];
+  };
+
+  // Builds the edges of the screen-space triangle (x[i], y[i]). The triangle
+  // must be clockwise in y-down coordinates (positive area), i.e. front facing.
+  EdgeFunctions SetupEdges(const float x[3], const float y[3]);
+
+  // Tests the pixel centers (x + i + 0.5, y + 0.5) for i in [0, count) and
+  // returns bit i set when that pixel is covered. count must be <= 64.
+  typedef uint64_t (*CoverageFn)(const EdgeFunctions &edges, int x, int y, int count);
+
+  uint64_t CoverageScalar(const EdgeFunctions &edges, int x, int y, int count);
+  uint64_t CoverageSSE(const EdgeFunctions &edges, int x, int y, int count);
+  uint64_t CoverageAVX2(const EdgeFunctions &edges, int x, int y, int count);
+
+  // Widest instruction set supported by both the CPU and the OS.
+  Isa DetectIsa();
+  CoverageFn SelectCoverage(Isa isa);
+  const char *IsaName(Isa isa);
+
+  // Index of the lowest set bit; mask must be non-zero.
+  inline int LowestBit(uint64_t mask) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(mask))) {
+      return static_cast<int>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(mask);
+#endif
+  }
+}
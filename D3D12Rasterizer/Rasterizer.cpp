@@ -3,10 +3,25 @@
 #include <WinUser.h>
 #include <windowsx.h>
 #include <string>
+#include <cstdio>
 using namespace std;
 using namespace DirectX::Colors;
 
+Rasterizer::~Rasterizer() {
+  // Frames may still be in flight and reference our resources.
+  if (mFenceQueue) {
+    FlushCommandQueue();
+  }
+}
+
 void Rasterizer::Initialize() {
+  mJobs = make_unique<JobSystem>();
+  mRenderPackets = make_unique<MpscQueue<RenderPacket>>(64);
+  mFrameReports = make_unique<SpscQueue<StateFilterRecorder::Stats>>(mMaxFramesAhead + 1);
+  if (mBackend == Backend::Software) {
+    InitializeSoftware();
+    return;
+  }
   ThrowIfFailed(InitMainWindow());
   ThrowIfFailed(InitializeD3D());
   CreateCommandLineObjects();
@@ -15,20 +30,29 @@ void Rasterizer::Initialize() {
   OnResize();
 
   ThrowIfFailed(mCommandList->Reset(mCommandAlloc.Get(), nullptr));
-  BuildDescriptorHeap();
-  BuildConstantBuffers();
+  mUploadBatcher = make_unique<UploadBatcher>(mDevice.Get());
+  mGeometryPool = make_unique<GeometryPool>(mDevice.Get(), sizeof(Vertex), mPoolVertexCapacity, mPoolIndexCapacity);
+  BuildGeometry();
+  BuildRenderItems();
+  BuildFrameResources();
   BuildRootSignature();
   BuildShaderAndInputLayouts();
-  BuildGeometry();
   BuildPSO();
+  mUploadBatcher->Record(mCommandList.Get());
 
   ThrowIfFailed(mCommandList->Close());
   ID3D12CommandList *lists[] = { mCommandList.Get() };
   mCommandQueue->ExecuteCommandLists(1, lists);
   FlushCommandQueue();
+  mUploadBatcher->Reset();
 }
 
 void Rasterizer::Run() {
+  if (mBackend == Backend::Software) {
+    RunHeadless();
+    return;
+  }
+  mRenderThread = std::thread(&Rasterizer::RenderLoop, this);
   MSG msg = { 0 };
   mTimer.Reset();
   while (msg.message != WM_QUIT) {
@@ -37,15 +61,94 @@ void Rasterizer::Run() {
       DispatchMessage(&msg);
     } else {
       mTimer.Tick();
-      if (!mPaused) {
-        CalculateFrameStats();
-        Update(mTimer);
-        Draw(mTimer);
-      } else {
+      StateFilterRecorder::Stats report;
+      while (mFrameReports->TryPop(report)) {
+        mFramesAhead--;
+        CalculateFrameStats(report);
+      }
+      if (mPaused) {
         Sleep(100);
+      } else if (mFramesAhead < mMaxFramesAhead) {
+        RenderPacket packet = { RenderPacket::Type::Frame };
+        packet.Frame = Simulate();
+        PostRenderPacket(packet);
+        mFramesAhead++;
+      } else {
+        // The render thread is behind; keep input responsive meanwhile.
+        std::this_thread::yield();
       }
     }
   }
+  PostRenderPacket({ RenderPacket::Type::Quit });
+  mRenderThread.join();
+  if (mRenderError) {
+    rethrow_exception(mRenderError);
+  }
+}
+
+void Rasterizer::RenderLoop() {
+  try {
+    for (;;) {
+      RenderPacket packet;
+      WaitForRenderPacket(packet);
+      switch (packet.Kind) {
+        case RenderPacket::Type::Frame:
+          Update(packet.Frame);
+          Draw();
+          while (!mFrameReports->TryPush(mFrameFilterStats)) {
+            std::this_thread::yield();
+          }
+          mFrameFilterStats = {};
+          break;
+        case RenderPacket::Type::Resize:
+          mClientWidth = packet.Width;
+          mClientHeight = packet.Height;
+          OnResize();
+          break;
+        case RenderPacket::Type::ShaderReady:
+          BuildVariantPSOs();
+          break;
+        case RenderPacket::Type::Quit:
+          return;
+      }
+    }
+  } catch (...) {
+    mRenderError = current_exception();
+    mRenderFailed = true;
+    PostMessage(mHwnd, WM_CLOSE, 0, 0);
+  }
+}
+
+void Rasterizer::PostRenderPacket(const RenderPacket &packet) {
+  if (mRenderFailed) {
+    return;
+  }
+  // Frames are bounded by mMaxFramesAhead, so the queue is only ever full
+  // briefly, after a burst of resizes.
+  while (!mRenderPackets->TryPush(packet)) {
+    std::this_thread::yield();
+  }
+  // Orders the push before the check, against the render thread going to
+  // sleep between its last look at the queue and its wait.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mRenderSleeping.load()) {
+    { std::lock_guard<std::mutex> lock(mRenderMutex); }
+    mRenderWake.notify_one();
+  }
+}
+
+void Rasterizer::WaitForRenderPacket(RenderPacket &packet) {
+  // Packets usually come every frame, so spin a little before sleeping.
+  for (int i = 0; i < 64; i++) {
+    if (mRenderPackets->TryPop(packet)) {
+      return;
+    }
+    std::this_thread::yield();
+  }
+  std::unique_lock<std::mutex> lock(mRenderMutex);
+  mRenderSleeping = true;
+  mRenderWake.wait(lock, [&] { return mRenderPackets->TryPop(packet); });
+  mRenderSleeping = false;
 }
 
 LRESULT CALLBACK Rasterizer::MsgProc(HWND hwnd, unsigned int msg, WPARAM wparam, LPARAM lparam) {
@@ -58,36 +161,43 @@ LRESULT CALLBACK Rasterizer::MsgProc(HWND hwnd, unsigned int msg, WPARAM wparam,
         mTimer.Start();
       }
       return 0;
-    case WM_SIZE:
-      mClientWidth = LOWORD(lparam);
-      mClientHeight = HIWORD(lparam);
-      if (mDevice) {
-        switch (wparam) {
-          case SIZE_MINIMIZED:
-            mPaused = true;
-            mMinimized = true;
-            mMaximized = false;
-            break;
-          case SIZE_MAXIMIZED:
+    case WM_SIZE: {
+      if (!mRenderThread.joinable()) {
+        // Initialize() creates the buffers at this size.
+        mClientWidth = LOWORD(lparam);
+        mClientHeight = HIWORD(lparam);
+        return 0;
+      }
+      // The render thread owns the swap chain, so it resizes.
+      RenderPacket resize = { RenderPacket::Type::Resize };
+      resize.Width = LOWORD(lparam);
+      resize.Height = HIWORD(lparam);
+      switch (wparam) {
+        case SIZE_MINIMIZED:
+          mPaused = true;
+          mMinimized = true;
+          mMaximized = false;
+          break;
+        case SIZE_MAXIMIZED:
+          mPaused = false;
+          mMinimized = false;
+          mMaximized = true;
+          PostRenderPacket(resize);
+          break;
+        case SIZE_RESTORED:
+          if (mMinimized) {
             mPaused = false;
             mMinimized = false;
-            mMaximized = true;
-            OnResize();
-            break;
-          case SIZE_RESTORED:
-            if (mMinimized) {
-              mPaused = false;
-              mMinimized = false;
-              OnResize();
-            } else if (mMaximized) {
-              mPaused = false;
-              mMaximized = false;
-              OnResize();
-            } else
-              OnResize();
-        }
+            PostRenderPacket(resize);
+          } else if (mMaximized) {
+            mPaused = false;
+            mMaximized = false;
+            PostRenderPacket(resize);
+          } else
+            PostRenderPacket(resize);
       }
       return 0;
+    }
       // The WM_MENUCHAR message is sent when a menu is active and the user presses 
       // a key that does not correspond to any mnemonic or accelerator key. 
     case WM_MENUCHAR:
@@ -169,7 +279,6 @@ bool Rasterizer::InitializeD3D() {
     ThrowIfFailed(mFactory->EnumWarpAdapter(IID_PPV_ARGS(pWarpAdaptor.GetAddressOf())));
     ThrowIfFailed(D3D12CreateDevice(pWarpAdaptor.Get(), D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(mDevice.GetAddressOf())));
   }
-  ThrowIfFailed(mDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(mFence.GetAddressOf())));
 
   mRtvDescriptorSize = mDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
   mDsvDescriptorSize = mDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
@@ -192,6 +301,7 @@ void Rasterizer::CreateCommandLineObjects() {
   queue.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
   queue.NodeMask = queue.Priority = 0;
   ThrowIfFailed(mDevice->CreateCommandQueue(&queue, IID_PPV_ARGS(mCommandQueue.GetAddressOf())));
+  mFenceQueue = make_unique<D3D12FenceQueue>(mDevice.Get(), mCommandQueue.Get());
 
   ThrowIfFailed(mDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(mCommandAlloc.GetAddressOf())));
 
@@ -234,31 +344,34 @@ void Rasterizer::CreateRtvAndDsvDescriptorHeaps() {
   ThrowIfFailed(mDevice->CreateDescriptorHeap(&ds, IID_PPV_ARGS(mDsvHeap.GetAddressOf())));
 }
 
-void Rasterizer::BuildDescriptorHeap() {
-  D3D12_DESCRIPTOR_HEAP_DESC desc;
-  desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-  desc.NumDescriptors = 1;
-  desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-  desc.NodeMask = 0;
-  ThrowIfFailed(mDevice->CreateDescriptorHeap(&desc, IID_PPV_ARGS(mCbvHeap.GetAddressOf())));
-}
-
-void Rasterizer::BuildConstantBuffers() {
-  mObjectCB = make_unique<UploadBuffer<ObjectConstants>>(mDevice.Get(), 1, true);
-  unsigned int byteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-  D3D12_GPU_VIRTUAL_ADDRESS cbAddr = mObjectCB->Resource()->GetGPUVirtualAddress();
-  D3D12_CONSTANT_BUFFER_VIEW_DESC desc;
-  desc.BufferLocation = cbAddr;
-  desc.SizeInBytes = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-  mDevice->CreateConstantBufferView(&desc, mCbvHeap->GetCPUDescriptorHandleForHeapStart());
+void Rasterizer::BuildFrameResources() {
+  mParallelRecorder = make_unique<ParallelRecorder>(*mJobs, mMinDrawsPerChunk);
+  unsigned int chunkCount = mJobs->ThreadCount();
+  for (int frame = 0; frame < gNumFrameResources; frame++) {
+    mFrameResources.push_back(make_unique<FrameResource>(mDevice.Get(), chunkCount));
+  }
+  // Lists only need an allocator to be created; each frame resets them with its own.
+  mChunkLists.resize(chunkCount);
+  mChunkFilterStats.resize(chunkCount);
+  for (auto &list : mChunkLists) {
+    ThrowIfFailed(mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+      mCommandAlloc.Get(), nullptr, IID_PPV_ARGS(list.GetAddressOf())));
+    ThrowIfFailed(list->Close());
+  }
+  ThrowIfFailed(mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+    mCommandAlloc.Get(), nullptr, IID_PPV_ARGS(mPostCommandList.GetAddressOf())));
+  ThrowIfFailed(mPostCommandList->Close());
+  mFrameRing = make_unique<FrameRing>(*mFenceQueue, gNumFrameResources);
+  mUploadRing = make_unique<UploadRing>(mDevice.Get(), *mFenceQueue, mUploadRingSize);
 }
 
 void Rasterizer::BuildRootSignature() {
-  CD3DX12_ROOT_PARAMETER param[1];
-  CD3DX12_DESCRIPTOR_RANGE range;
-  range.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
-  param[0].InitAsDescriptorTable(1, &range);
-  CD3DX12_ROOT_SIGNATURE_DESC desc(1, param, 0, nullptr,
+  // cbPerObject (or cbPass) and the instance buffer are bound directly by GPU
+  // address, so no descriptor heap is needed.
+  CD3DX12_ROOT_PARAMETER param[2];
+  param[0].InitAsConstantBufferView(0);
+  param[1].InitAsShaderResourceView(0);
+  CD3DX12_ROOT_SIGNATURE_DESC desc(2, param, 0, nullptr,
     D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
   ComPtr<ID3DBlob> serialized = nullptr;
@@ -270,11 +383,32 @@ void Rasterizer::BuildRootSignature() {
   ThrowIfFailed(hr);
   ThrowIfFailed(mDevice->CreateRootSignature(
     0, serialized->GetBufferPointer(), serialized->GetBufferSize(), IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+  mRootSignatureHash = Fnv1a::Hash(serialized->GetBufferPointer(), serialized->GetBufferSize());
 }
 
 void Rasterizer::BuildShaderAndInputLayouts() {
-  mVS = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_0");
-  mPS = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_0");
+  // Fails harmlessly if the directory already exists.
+  CreateDirectoryA("ShaderCache", nullptr);
+  mShaderCache = make_unique<ShaderCache>(mShaderCompiler, "ShaderCache");
+  ShaderDesc desc;
+  desc.Path = "Shaders\\color.hlsl";
+  desc.Flags = D3DShaderCompiler::DefaultFlags();
+  desc.EntryPoint = "VS";
+  desc.Target = "vs_5_0";
+  mVertexShaders = make_unique<ShaderPermutations>(*mShaderCache, *mJobs, desc, vector<string>{ "INSTANCED" });
+  desc.EntryPoint = "PS";
+  desc.Target = "ps_5_0";
+  mPixelShaders = make_unique<ShaderPermutations>(*mShaderCache, *mJobs, desc, vector<string>());
+  // Queued first so the workers pick it up while this thread loads the
+  // variants it cannot start without. The render thread builds its PSO when
+  // told it has loaded.
+  mVertexShaders->Request(mVertexShaders->Feature("INSTANCED"), [this] {
+    PostRenderPacket({ RenderPacket::Type::ShaderReady });
+  });
+  mVS = D3DShaderCompiler::ToBlob(mVertexShaders->Get(0));
+  mPS = D3DShaderCompiler::ToBlob(mPixelShaders->Get(0));
+  ShaderCache::Stats stats = mShaderCache->GetStats();
+  OutputDebugStringA(("Shader cache: " + to_string(stats.Hits) + " hits, " + to_string(stats.Misses) + " compiled\n").c_str());
   mInputLayouts = {
     { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
@@ -333,11 +467,15 @@ void Rasterizer::BuildGeometry() {
   ThrowIfFailed(D3DCreateBlob(ibByteSize, &mBoxGeo->IndexBufferCPU));
   CopyMemory(mBoxGeo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-  mBoxGeo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(mDevice.Get(),
-    mCommandList.Get(), vertices.data(), vbByteSize, mBoxGeo->VertexBufferUploader);
-
-  mBoxGeo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(mDevice.Get(),
-    mCommandList.Get(), indices.data(), ibByteSize, mBoxGeo->IndexBufferUploader);
+  // Staged from the CPU copies, which outlive the batched upload, into the
+  // shared arenas rather than buffers of its own.
+  if (mDevice) {
+    mBoxMesh = mGeometryPool->Add(*mUploadBatcher, mBoxGeo->VertexBufferCPU->GetBufferPointer(), (UINT)vertices.size(),
+      mBoxGeo->IndexBufferCPU->GetBufferPointer(), (UINT)indices.size());
+    if (mBoxMesh == GeometryPool::InvalidMesh) {
+      ThrowIfFailed(E_OUTOFMEMORY);
+    }
+  }
 
   mBoxGeo->VertexByteStride = sizeof(Vertex);
   mBoxGeo->VertexBufferByteSize = vbByteSize;
@@ -348,16 +486,42 @@ void Rasterizer::BuildGeometry() {
   submesh.IndexCount = (UINT)indices.size();
   submesh.StartIndexLocation = 0;
   submesh.BaseVertexLocation = 0;
+  BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
-  mBoxGeo->DrawArgs["box"] = submesh;
+  mBoxGeo->AddSubmesh("box", submesh);
 }
 
-void Rasterizer::BuildPSO() {
+void Rasterizer::BuildRenderItems() {
+  RenderItem box;
+  box.Geo = mBoxGeo.get();
+  box.Mesh = mBoxMesh;
+  box.Submesh = mBoxGeo->FindSubmesh("box");
+  // The box is static and fills much of the view, so it hides whatever is
+  // added behind it.
+  box.Occluder = true;
+  box.InstanceKey = InstanceKey(box);
+  mRenderItems.push_back(box);
+}
+
+uint32_t Rasterizer::InstanceKey(const RenderItem &item) {
+  for (uint32_t key = 0; key < mInstanceGeometry.size(); key++) {
+    const InstanceGeometry &g = mInstanceGeometry[key];
+    if (g.Geo == item.Geo && g.Mesh == item.Mesh && g.Submesh == item.Submesh) {
+      return key;
+    }
+  }
+  // The key is also the draw sort key's mesh field.
+  assert(mInstanceGeometry.size() < (1u << DrawSortKey::MeshBits) && "Too many distinct meshes for the sort key.");
+  mInstanceGeometry.push_back({ item.Geo, item.Mesh, item.Submesh });
+  return static_cast<uint32_t>(mInstanceGeometry.size() - 1);
+}
+
+D3D12_GRAPHICS_PIPELINE_STATE_DESC Rasterizer::PipelineStateDesc(ID3DBlob *vs, ID3DBlob *ps) {
   D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = { 0 };
   desc.InputLayout = { mInputLayouts.data(), static_cast<unsigned int>(mInputLayouts.size()) };
   desc.pRootSignature = mRootSignature.Get();
-  desc.VS = { reinterpret_cast<BYTE*>(mVS->GetBufferPointer()), mVS->GetBufferSize() };
-  desc.PS = { reinterpret_cast<BYTE*>(mPS->GetBufferPointer()), mPS->GetBufferSize() };
+  desc.VS = { reinterpret_cast<BYTE*>(vs->GetBufferPointer()), vs->GetBufferSize() };
+  desc.PS = { reinterpret_cast<BYTE*>(ps->GetBufferPointer()), ps->GetBufferSize() };
   desc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
   desc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
   desc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
@@ -368,21 +532,86 @@ void Rasterizer::BuildPSO() {
   desc.SampleDesc.Count = m4xMSAA > 1 ? 4 : 1;
   desc.SampleDesc.Quality = m4xMSAA > 1 ? (m4xMSAA - 1) : 0;
   desc.DSVFormat = mDepthStencilFormat;
-  ThrowIfFailed(mDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(mPSO.GetAddressOf())));
+  return desc;
 }
 
-void Rasterizer::FlushCommandQueue() {
-  mCurrentFence++;
-  ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
-  if (mFence->GetCompletedValue() < mCurrentFence) {
-    HANDLE event = CreateEvent(0, 0, 0, 0);
-    ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, event));
-    WaitForSingleObject(event, INFINITE);
-    CloseHandle(event);
+void Rasterizer::BuildPSO() {
+  // Fails harmlessly if the directory already exists.
+  CreateDirectoryA("PipelineCache", nullptr);
+  mPipelineCache = make_unique<PipelineCache>(mDevice.Get(), "PipelineCache");
+  D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = PipelineStateDesc(mVS.Get(), mPS.Get());
+  mPSO = mPipelineCache->Get(desc, mRootSignatureHash);
+}
+
+void Rasterizer::BuildVariantPSOs() {
+  ShaderPermutations::Mask instanced = mVertexShaders->Feature("INSTANCED");
+  if (mInstancedPSO || mInstancedFailed || !mVertexShaders->Ready(instanced)) {
+    return;
+  }
+  // The base pipeline keeps drawing if the variant does not compile; the
+  // compiler already logged its errors.
+  try {
+    mInstancedVS = D3DShaderCompiler::ToBlob(mVertexShaders->Get(instanced));
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = PipelineStateDesc(mInstancedVS.Get(), mPS.Get());
+    mInstancedPSO = mPipelineCache->Get(desc, mRootSignatureHash);
+  } catch (DxException &e) {
+    mInstancedFailed = true;
+    mInstancedVS = nullptr;
+    OutputDebugStringA("INSTANCED variant failed, drawing without instancing: ");
+    OutputDebugStringW((e.ToString() + L"\n").c_str());
+  } catch (std::exception &e) {
+    mInstancedFailed = true;
+    mInstancedVS = nullptr;
+    OutputDebugStringA(("INSTANCED variant failed, drawing without instancing: " + string(e.what()) + "\n").c_str());
+  }
+}
+
+void Rasterizer::InitializeSoftware() {
+  mSoftware = make_unique<SoftwareRasterizer>();
+  OnResize();
+  BuildGeometry();
+  BuildRenderItems();
+}
+
+void Rasterizer::RunHeadless() {
+  mTimer.Reset();
+  for (int i = 0; i < mHeadlessFrameCount; i++) {
+    mTimer.Tick();
+    Update(Simulate());
+    Draw();
   }
+  mTimer.Tick();
+
+  const SoftwareRasterizer::Stats &stats = mSoftware->GetStats();
+  float seconds = mTimer.TotalTime();
+  string report = "Software backend " + to_string(mClientWidth) + "x" + to_string(mClientHeight) +
+    "    threads: " + to_string(mSoftware->ThreadCount()) +
+    "    frames: " + to_string(mHeadlessFrameCount) +
+    "   mspf: " + to_string(1000.0f * seconds / mHeadlessFrameCount) +
+    "   tris/s: " + to_string(stats.Triangles / seconds) +
+    "   pixels/s: " + to_string(stats.Pixels / seconds) +
+    "   depth tests: " + to_string(stats.DepthTests) +
+    "   tile rejects: " + to_string(stats.TileTrianglesRejected) +
+    "   block rejects: " + to_string(stats.BlocksRejected) +
+    "   frustum culled: " + to_string(mFrustum.GetStats().Tested - mFrustum.GetStats().Visible) +
+    "   occlusion culled: " + to_string(mOcclusion.GetStats().Culled) + "\n";
+  OutputDebugStringA(report.c_str());
+  fputs(report.c_str(), stdout);
+}
+
+void Rasterizer::FlushCommandQueue() {
+  mFenceQueue->WaitFor(mFenceQueue->Signal());
 }
 
 void Rasterizer::OnResize() {
+  XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, static_cast<float>(mClientWidth) / mClientHeight, mNearZ, mFarZ);
+  XMStoreFloat4x4(&mProj, P);
+
+  if (mBackend == Backend::Software) {
+    mSoftware->Resize(mClientWidth, mClientHeight);
+    return;
+  }
+
   FlushCommandQueue();
   ThrowIfFailed(mCommandList->Reset(mCommandAlloc.Get(), nullptr));
   for (int i = 0; i <mSwapChainBufferCount; i++) {
@@ -450,12 +679,9 @@ void Rasterizer::OnResize() {
   mViewport.MaxDepth = 1.0f;
 
   mScissorRect = { 0, 0, mClientWidth, mClientHeight };
-
-  XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, static_cast<float>(mClientWidth) / mClientHeight, 1.0f, 1000.0f);
-  XMStoreFloat4x4(&mProj, P);
 }
 
-void Rasterizer::Update(const GameTimer & gt) {
+FramePacket Rasterizer::Simulate() {
   // Convert Spherical to Cartesian coordinates.
   float x = mRadius*sinf(mPhi)*cosf(mTheta);
   float z = mRadius*sinf(mPhi)*sinf(mTheta);
@@ -466,45 +692,225 @@ void Rasterizer::Update(const GameTimer & gt) {
   XMVECTOR target = XMVectorZero();
   XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 
-  XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
-  XMStoreFloat4x4(&mView, view);
+  FramePacket frame;
+  XMStoreFloat4x4(&frame.View, XMMatrixLookAtLH(pos, target, up));
+  return frame;
+}
 
-  XMMATRIX world = XMLoadFloat4x4(&mWorld);
+void Rasterizer::Update(const FramePacket &frame) {
+  // Move to the next frame resource, waiting only if the GPU still uses it.
+  if (mFrameRing) {
+    mCurrFrameResource = mFrameResources[mFrameRing->BeginFrame()].get();
+    mUploadRing->Retire();
+  }
+
+  mView = frame.View;
+  XMMATRIX view = XMLoadFloat4x4(&mView);
   XMMATRIX proj = XMLoadFloat4x4(&mProj);
-  XMMATRIX worldViewProj = world*view*proj;
+  XMMATRIX viewProj = view*proj;
+  XMFLOAT4X4 viewProjF;
+  XMStoreFloat4x4(&viewProjF, viewProj);
+  CullRenderItems(viewProjF);
+  SortVisibleItems(viewProjF);
+
+  if (Instanced()) {
+    // Group the surviving items by geometry into one contiguous instance array.
+    // This keeps the sorted order: the sort key only varies by mesh (the
+    // instance key) and depth, and the packer emits keys in increasing order
+    // and is stable within a key, so batches come out in key order with their
+    // instances still front to back. Once pipelines or materials vary, the
+    // batches would have to be formed from runs of equal state instead.
+    mInstancePacker.Clear();
+    for (const RenderItem *item : mVisibleItems) {
+      mInstancePacker.Add(item->InstanceKey, item->World);
+    }
+    if (mInstancePacker.InstanceCount() > 0) {
+      UploadRing::Allocation instances = mUploadRing->Allocate(mInstancePacker.InstanceCount() * sizeof(InstanceData), sizeof(InstanceData));
+      mInstancePacker.Pack(static_cast<InstanceData*>(instances.Cpu));
+      mInstanceAddress = instances.Gpu;
+    }
+    PassConstants pass;
+    XMStoreFloat4x4(&pass.ViewProj, XMMatrixTranspose(viewProj));
+    mPassCBAddress = mUploadRing->PushConstants(pass);
+    return;
+  }
+
+  // Update the constant buffers of the surviving items with their worldViewProj
+  // matrix: computed in parallel, then pushed in order since the ring is serial.
+  mJobs->ParallelFor(static_cast<unsigned int>(mVisibleItems.size()), mConstantsPerJob, [&](unsigned int i) {
+    RenderItem *item = mVisibleItems[i];
+    XMMATRIX worldViewProj = XMLoadFloat4x4(&item->World)*viewProj;
+    XMStoreFloat4x4(&item->Constants.WorldViewProj, XMMatrixTranspose(worldViewProj));
+  });
+  if (mUploadRing) {
+    for (RenderItem *item : mVisibleItems) {
+      item->ObjectCBAddress = mUploadRing->PushConstants(item->Constants);
+    }
+  }
+}
+
+void Rasterizer::CullRenderItems(const XMFLOAT4X4 &viewProj) {
+  mItemBounds.Clear();
+  for (const RenderItem &item : mRenderItems) {
+    mItemBounds.Add(item.Geo->Submesh(item.Submesh).Bounds, item.World);
+  }
+  mFrustum.SetFrustum(viewProj);
+  mFrustum.Cull(mItemBounds, mInFrustum);
+
+  mOcclusion.BeginFrame(viewProj);
+  for (const RenderItem &item : mRenderItems) {
+    if (item.Occluder) {
+      const SubmeshGeometry &sub = item.Geo->Submesh(item.Submesh);
+      mOcclusion.AddOccluder(item.Geo->VertexBufferCPU->GetBufferPointer(), item.Geo->VertexByteStride,
+        item.Geo->IndexBufferCPU->GetBufferPointer(), item.Geo->IndexFormat == DXGI_FORMAT_R16_UINT,
+        sub.IndexCount, sub.StartIndexLocation, sub.BaseVertexLocation, item.World);
+    }
+  }
+  // The tests only read the occlusion buffer, so they run in parallel; the
+  // survivors are then gathered in frustum order.
+  mOccluded.resize(mInFrustum.size());
+  mJobs->ParallelFor(static_cast<unsigned int>(mInFrustum.size()), mCullsPerJob, [&](unsigned int i) {
+    const RenderItem &item = mRenderItems[mInFrustum[i]];
+    mOccluded[i] = !item.Occluder && !mOcclusion.IsVisible(item.Geo->Submesh(item.Submesh).Bounds, item.World);
+  });
+  mVisibleItems.clear();
+  for (size_t i = 0; i < mInFrustum.size(); i++) {
+    if (!mOccluded[i]) {
+      mVisibleItems.push_back(&mRenderItems[mInFrustum[i]]);
+    }
+  }
+}
+
+void Rasterizer::SortVisibleItems(const XMFLOAT4X4 &viewProj) {
+  // There is one root signature, pipeline and material so far, so the key
+  // groups items by geometry and orders each group front to back.
+  XMMATRIX vp = XMLoadFloat4x4(&viewProj);
+  mDrawKeys.clear();
+  for (uint32_t i = 0; i < mVisibleItems.size(); i++) {
+    const RenderItem *item = mVisibleItems[i];
+    XMVECTOR center = XMVector3Transform(XMLoadFloat3(&item->Geo->Submesh(item->Submesh).Bounds.Center),
+      XMLoadFloat4x4(&item->World));
+    float viewDepth = XMVectorGetW(XMVector4Transform(center, vp));
+    mDrawKeys.push_back({ DrawSortKey::Make(0, 0, item->InstanceKey, 0, viewDepth / mFarZ), i });
+  }
+  mDrawSorter.Sort(mDrawKeys);
+  mSortedItems.clear();
+  for (const RadixSorter::Item &key : mDrawKeys) {
+    mSortedItems.push_back(mVisibleItems[key.Value]);
+  }
+  mVisibleItems.swap(mSortedItems);
+}
+
+void Rasterizer::BeginPass(ID3D12GraphicsCommandList *cmdList, CommandRecorder &recorder) {
+  cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+  recorder.SetRootSignature(reinterpret_cast<uint64_t>(mRootSignature.Get()));
+  recorder.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  recorder.SetViewport({ mViewport.TopLeftX, mViewport.TopLeftY, mViewport.Width, mViewport.Height,
+    mViewport.MinDepth, mViewport.MaxDepth });
+  recorder.SetScissorRect({ mScissorRect.left, mScissorRect.top, mScissorRect.right, mScissorRect.bottom });
+}
 
-  // Update the constant buffer with the latest worldViewProj matrix.
-  ObjectConstants objConstants;
-  XMStoreFloat4x4(&objConstants.WorldViewProj, XMMatrixTranspose(worldViewProj));
-  mObjectCB->CopyData(0, objConstants);
+// Both record every draw with all the state it needs; the StateFilterRecorder
+// they write to drops whatever is already set.
+void Rasterizer::RecordDraws(CommandRecorder &recorder, unsigned int first, unsigned int count) {
+  D3D12_VERTEX_BUFFER_VIEW vbv = mGeometryPool->VertexBufferView();
+  D3D12_INDEX_BUFFER_VIEW ibv = mGeometryPool->IndexBufferView();
+  for (unsigned int i = first; i < first + count; i++) {
+    const RenderItem *item = mVisibleItems[i];
+    SubmeshGeometry sub = mGeometryPool->Place(item->Mesh, item->Geo->Submesh(item->Submesh));
+    recorder.SetPipelineState(reinterpret_cast<uint64_t>(mPSO.Get()));
+    recorder.SetVertexBuffer(vbv.BufferLocation, vbv.SizeInBytes, vbv.StrideInBytes);
+    recorder.SetIndexBuffer(ibv.BufferLocation, ibv.SizeInBytes, ibv.Format == DXGI_FORMAT_R16_UINT ? 2 : 4);
+    recorder.SetConstantBuffer(0, item->ObjectCBAddress);
+    recorder.DrawIndexed(sub.IndexCount, 1, sub.StartIndexLocation, sub.BaseVertexLocation, 0);
+  }
 }
 
-void Rasterizer::Draw(const GameTimer & gt) {
-  ThrowIfFailed(mCommandAlloc->Reset());
-  ThrowIfFailed(mCommandList->Reset(mCommandAlloc.Get(), mPSO.Get()));
+void Rasterizer::RecordInstancedDraws(CommandRecorder &recorder, unsigned int first, unsigned int count) {
+  D3D12_VERTEX_BUFFER_VIEW vbv = mGeometryPool->VertexBufferView();
+  D3D12_INDEX_BUFFER_VIEW ibv = mGeometryPool->IndexBufferView();
+  const std::vector<InstancePacker::Batch> &batches = mInstancePacker.Batches();
+  for (unsigned int i = first; i < first + count; i++) {
+    const InstancePacker::Batch &batch = batches[i];
+    const InstanceGeometry &g = mInstanceGeometry[batch.Key];
+    SubmeshGeometry sub = mGeometryPool->Place(g.Mesh, g.Geo->Submesh(g.Submesh));
+    recorder.SetPipelineState(reinterpret_cast<uint64_t>(mInstancedPSO.Get()));
+    recorder.SetVertexBuffer(vbv.BufferLocation, vbv.SizeInBytes, vbv.StrideInBytes);
+    recorder.SetIndexBuffer(ibv.BufferLocation, ibv.SizeInBytes, ibv.Format == DXGI_FORMAT_R16_UINT ? 2 : 4);
+    recorder.SetConstantBuffer(0, mPassCBAddress);
+    // SV_InstanceID starts at 0 whatever the start instance, so offset the buffer instead.
+    recorder.SetShaderResource(1, mInstanceAddress + batch.FirstInstance * sizeof(InstanceData));
+    recorder.DrawIndexed(sub.IndexCount, batch.InstanceCount, sub.StartIndexLocation, sub.BaseVertexLocation, 0);
+  }
+}
+
+void Rasterizer::Draw() {
+  if (mBackend == Backend::Software) {
+    DrawSoftware();
+    return;
+  }
+  // Update() already waited until the GPU was done with this frame resource.
+  ID3D12CommandAllocator *alloc = mCurrFrameResource->CmdListAlloc.Get();
+  ThrowIfFailed(alloc->Reset());
+  ThrowIfFailed(mCommandList->Reset(alloc, nullptr));
   mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT,
     D3D12_RESOURCE_STATE_RENDER_TARGET));
-  mCommandList->RSSetScissorRects(1, &mScissorRect);
-  mCommandList->RSSetViewports(1, &mViewport);
   mCommandList->ClearRenderTargetView(CurrentBackBufferView(), DirectX::Colors::Navy, 0, nullptr);
   mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-  mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-  ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvHeap.Get() };
-  mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-  mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-  mCommandList->IASetVertexBuffers(0, 1, &mBoxGeo->VertexBufferView());
-  mCommandList->IASetIndexBuffer(&mBoxGeo->IndexBufferView());
-  mCommandList->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-  mCommandList->SetGraphicsRootDescriptorTable(0, mCbvHeap->GetGPUDescriptorHandleForHeapStart());
-  mCommandList->DrawIndexedInstanced(mBoxGeo->DrawArgs["box"].IndexCount, 1, 0, 0, 0);
-  mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET,
-    D3D12_RESOURCE_STATE_PRESENT));
   ThrowIfFailed(mCommandList->Close());
-  ID3D12CommandList *lists[] = { mCommandList.Get() };
-  mCommandQueue->ExecuteCommandLists(_countof(lists), lists);
+
+  size_t drawCount = Instanced() ? mInstancePacker.Batches().size() : mVisibleItems.size();
+  const std::vector<ParallelRecorder::Chunk> &chunks = mParallelRecorder->Record(
+    static_cast<unsigned int>(drawCount), static_cast<unsigned int>(mChunkLists.size()),
+    [this](unsigned int index, const ParallelRecorder::Chunk &chunk) {
+      ID3D12CommandAllocator *chunkAlloc = mCurrFrameResource->ChunkAllocs[index].Get();
+      ID3D12GraphicsCommandList *list = mChunkLists[index].Get();
+      ThrowIfFailed(chunkAlloc->Reset());
+      ThrowIfFailed(list->Reset(chunkAlloc, nullptr));
+      D3D12CommandRecorder d3dRecorder(list);
+      StateFilterRecorder recorder(d3dRecorder);
+      BeginPass(list, recorder);
+      if (Instanced()) {
+        RecordInstancedDraws(recorder, chunk.First, chunk.Count);
+      } else {
+        RecordDraws(recorder, chunk.First, chunk.Count);
+      }
+      ThrowIfFailed(list->Close());
+      mChunkFilterStats[index] = recorder.GetStats();
+    });
+  for (size_t i = 0; i < chunks.size(); i++) {
+    mFrameFilterStats += mChunkFilterStats[i];
+  }
+
+  // The setup list is closed, so the frame allocator can record the present barrier.
+  ThrowIfFailed(mPostCommandList->Reset(alloc, nullptr));
+  mPostCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET,
+    D3D12_RESOURCE_STATE_PRESENT));
+  ThrowIfFailed(mPostCommandList->Close());
+
+  // Chunks are submitted in draw order, all in one call.
+  std::vector<ID3D12CommandList*> lists;
+  lists.push_back(mCommandList.Get());
+  for (size_t i = 0; i < chunks.size(); i++) {
+    lists.push_back(mChunkLists[i].Get());
+  }
+  lists.push_back(mPostCommandList.Get());
+  mCommandQueue->ExecuteCommandLists(static_cast<UINT>(lists.size()), lists.data());
   mSwapChain->Present(0, 0);
   mCurrentBackBuffer = (mCurrentBackBuffer + 1) % mSwapChainBufferCount;
-  FlushCommandQueue();
+  mFrameRing->EndFrame();
+  mUploadRing->FinishFrame(mFrameRing->Fence(mFrameRing->Current()));
+}
+
+void Rasterizer::DrawSoftware() {
+  mSoftware->Clear(DirectX::Colors::Navy, 1.0f);
+  for (const RenderItem *item : mVisibleItems) {
+    const SubmeshGeometry &sub = item->Geo->Submesh(item->Submesh);
+    mSoftware->DrawIndexed(item->Geo->VertexBufferCPU->GetBufferPointer(), item->Geo->VertexByteStride,
+      item->Geo->IndexBufferCPU->GetBufferPointer(), item->Geo->IndexFormat == DXGI_FORMAT_R16_UINT,
+      sub.IndexCount, sub.StartIndexLocation, sub.BaseVertexLocation, item->Constants.WorldViewProj);
+  }
+  mSoftware->Flush();
 }
 
 void Rasterizer::OnMouseDown(WPARAM btnState, int x, int y) {
@@ -558,7 +964,7 @@ D3D12_CPU_DESCRIPTOR_HANDLE Rasterizer::DepthStencilView() const {
   return mDsvHeap->GetCPUDescriptorHandleForHeapStart();
 }
 
-void Rasterizer::CalculateFrameStats() {
+void Rasterizer::CalculateFrameStats(const StateFilterRecorder::Stats &frame) {
   // Code computes the average frames per second, and also the 
   // average time it takes to render one frame.  These stats 
   // are appended to the window caption bar.
@@ -567,6 +973,7 @@ void Rasterizer::CalculateFrameStats() {
   static float timeElapsed = 0.0f;
 
   frameCnt++;
+  mShownFilterStats += frame;
 
   // Compute averages over one second period.
   if ((mTimer.TotalTime() - timeElapsed) >= 1.0f) {
@@ -576,9 +983,13 @@ void Rasterizer::CalculateFrameStats() {
     string fpsStr = to_string(fps);
     string mspfStr = to_string(mspf);
 
+    // Commands recorded and redundant ones dropped, per frame.
     string windowText = "D3D12 Demo"
       "    fps: " + fpsStr +
-      "   mspf: " + mspfStr;
+      "   mspf: " + mspfStr +
+      "   commands: " + to_string(mShownFilterStats.TotalIssued() / frameCnt) +
+      "   redundant: " + to_string(mShownFilterStats.TotalFiltered() / frameCnt);
+    mShownFilterStats = {};
 
     SetWindowTextA(mHwnd, windowText.c_str());
 
@@ -1,8 +1,30 @@
 #pragma once
 #include "../Common/d3dUtil.h"
 #include "../Common/GameTimer.h"
-#include "../Common/UploadBuffer.h"
 #include "../Common/MathHelper.h"
+#include "FrameResource.h"
+#include "UploadRing.h"
+#include "UploadBatcher.h"
+#include "GeometryPool.h"
+#include "D3D12CommandRecorder.h"
+#include "D3DShaderCompiler.h"
+#include "PipelineCache.h"
+#include "../Common/Hash.h"
+#include "../Common/StateFilterRecorder.h"
+#include "../Common/ParallelRecorder.h"
+#include "../Common/ShaderPermutations.h"
+#include "../Common/SpscQueue.h"
+#include "../Common/MpscQueue.h"
+#include "../Common/InstancePacker.h"
+#include "../Common/DrawSortKey.h"
+#include "../Common/RadixSort.h"
+#include "SoftwareRasterizer.h"
+#include "OcclusionCuller.h"
+#include "FrustumCuller.h"
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -17,14 +39,39 @@ struct Vertex {
   XMFLOAT4 Color;
 };
 
-struct ObjectConstants {
-  DirectX::XMFLOAT4X4 WorldViewProj = MathHelper::Identity4x4();
+// One draw of a submesh with its own world matrix.
+struct RenderItem {
+  XMFLOAT4X4 World = MathHelper::Identity4x4();
+  // Geo holds the CPU copy; on the GPU the mesh lives in the geometry pool and
+  // Geo's submeshes are relative to it.
+  MeshGeometry *Geo = nullptr;
+  GeometryPool::MeshHandle Mesh = GeometryPool::InvalidMesh;
+  MeshGeometry::SubmeshHandle Submesh = MeshGeometry::InvalidSubmesh;
+  // This frame's ObjectConstants in the upload ring.
+  D3D12_GPU_VIRTUAL_ADDRESS ObjectCBAddress = 0;
+  // Occluders are always drawn and are rasterized into the occlusion buffer
+  // that every other item is tested against.
+  bool Occluder = false;
+  // Items with the same key share Mesh and Submesh and are drawn instanced.
+  uint32_t InstanceKey = 0;
+  ObjectConstants Constants;
+};
+
+// What the game thread hands the render thread for one frame.
+struct FramePacket {
+  XMFLOAT4X4 View;
 };
 
 class Rasterizer {
 public:
-  Rasterizer(HINSTANCE hinst) : mHinst(hinst), self(this) {}
-  ~Rasterizer() = default;
+  // Software renders headless on the CPU instead of creating a window and device.
+  // It is still part of the Windows app (WinMain, GameTimer's QPC clock and
+  // the D3DCreateBlob-backed MeshGeometry); only SoftwareRasterizer itself is
+  // portable.
+  enum class Backend { D3D12, Software };
+
+  Rasterizer(HINSTANCE hinst, Backend backend = Backend::D3D12) : mHinst(hinst), mBackend(backend), self(this) {}
+  ~Rasterizer();
   
   void Initialize();
   void Run();
@@ -38,18 +85,32 @@ private:
   void  CreateCommandLineObjects();
   void CreateSwapChain();
   void CreateRtvAndDsvDescriptorHeaps();
-  void BuildDescriptorHeap();
-  void BuildConstantBuffers();
+  void BuildFrameResources();
   void BuildRootSignature();
   void BuildShaderAndInputLayouts();
   void BuildGeometry();
+  void BuildRenderItems();
+  uint32_t InstanceKey(const RenderItem &item);
+  D3D12_GRAPHICS_PIPELINE_STATE_DESC PipelineStateDesc(ID3DBlob *vs, ID3DBlob *ps);
   void BuildPSO();
+  void BuildVariantPSOs();
+
+  void CullRenderItems(const XMFLOAT4X4 &viewProj);
+  void SortVisibleItems(const XMFLOAT4X4 &viewProj);
+  void BeginPass(ID3D12GraphicsCommandList *cmdList, CommandRecorder &recorder);
+  void RecordDraws(CommandRecorder &recorder, unsigned int first, unsigned int count);
+  void RecordInstancedDraws(CommandRecorder &recorder, unsigned int first, unsigned int count);
+
+  void InitializeSoftware();
+  void RunHeadless();
+  void DrawSoftware();
 
   void FlushCommandQueue();
 
   void OnResize();
-  void Update(const GameTimer& gt);
-  void Draw(const GameTimer& gt);
+  FramePacket Simulate();
+  void Update(const FramePacket &frame);
+  void Draw();
 
   void OnMouseDown(WPARAM btnState, int x, int y);
   void OnMouseUp(WPARAM btnState, int x, int y);
@@ -59,11 +120,40 @@ private:
   D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView() const;
   D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView() const;
 
-  void CalculateFrameStats();
+  // The render thread's work, from the game thread or from jobs.
+  struct RenderPacket {
+    enum class Type { Frame, Resize, ShaderReady, Quit };
+    Type Kind;
+    FramePacket Frame;
+    long Width, Height;
+  };
+  void RenderLoop();
+  void PostRenderPacket(const RenderPacket &packet);
+  void WaitForRenderPacket(RenderPacket &packet);
+
+  void CalculateFrameStats(const StateFilterRecorder::Stats &frame);
 
   Rasterizer *self;
   HINSTANCE mHinst;
+  Backend mBackend;
   GameTimer mTimer;
+  // Shared by every parallel part of a frame.
+  std::unique_ptr<JobSystem> mJobs;
+  // From Run() on, the window's thread only handles input and simulates, and
+  // a render thread owns the device. Frames reach it through mRenderPackets,
+  // at most mMaxFramesAhead ahead of the ones it has reported back through
+  // mFrameReports, so the next frame is simulated while this one is drawn.
+  static const int mMaxFramesAhead = 2;
+  std::thread mRenderThread;
+  std::unique_ptr<MpscQueue<RenderPacket>> mRenderPackets;
+  std::unique_ptr<SpscQueue<StateFilterRecorder::Stats>> mFrameReports;
+  int mFramesAhead = 0;
+  std::atomic<bool> mRenderSleeping{ false };
+  std::mutex mRenderMutex;
+  std::condition_variable mRenderWake;
+  // Set if the render thread failed; Run() rethrows it.
+  std::exception_ptr mRenderError;
+  std::atomic<bool> mRenderFailed{ false };
   bool mPaused, mMinimized, mMaximized, mResizing;
   HWND mHwnd;
   long mClientWidth = 1024, mClientHeight = 768;
@@ -79,14 +169,10 @@ private:
   unsigned int mDsvDescriptorSize;
   unsigned int mCbvSrvUavDescriptorSize;
 
-  unsigned long long mCurrentFence = 0;
-
   ComPtr<IDXGIFactory4> mFactory;
   ComPtr<ID3D12Device> mDevice;
-  ComPtr<ID3D12Fence> mFence;
   ComPtr<ID3D12DescriptorHeap> mRtvHeap;
   ComPtr<ID3D12DescriptorHeap> mDsvHeap;
-  ComPtr<ID3D12DescriptorHeap> mCbvHeap;
   ComPtr<ID3D12CommandQueue> mCommandQueue;
   ComPtr<ID3D12CommandAllocator> mCommandAlloc;
   ComPtr<ID3D12GraphicsCommandList> mCommandList;
@@ -94,23 +180,92 @@ private:
   ComPtr<ID3D12Resource> mSwapChainBuffer[mSwapChainBufferCount];
   ComPtr<ID3D12Resource> mDepthStencilBuffer;
   ComPtr<ID3D12RootSignature> mRootSignature;
+  // Hash of the serialized root signature, which names it in mPipelineCache.
+  uint64_t mRootSignatureHash = 0;
   ComPtr<ID3DBlob> mVS;
   ComPtr<ID3DBlob> mPS;
   ComPtr<ID3D12PipelineState> mPSO;
+  ComPtr<ID3DBlob> mInstancedVS;
+  ComPtr<ID3D12PipelineState> mInstancedPSO;
+  // Set if the INSTANCED variant failed to compile; it is not retried.
+  bool mInstancedFailed = false;
+  // Compiled shaders are kept next to the executable's working directory and
+  // only recompiled when a source, define or the compiler changes.
+  D3DShaderCompiler mShaderCompiler;
+  std::unique_ptr<ShaderCache> mShaderCache;
+  // color.hlsl's variants. The plain ones are loaded before the first frame;
+  // the instanced PSO is built once its vertex shader has loaded in the
+  // background, and draws are not instanced until then.
+  std::unique_ptr<ShaderPermutations> mVertexShaders;
+  std::unique_ptr<ShaderPermutations> mPixelShaders;
+  std::unique_ptr<PipelineCache> mPipelineCache;
 
   D3D12_VIEWPORT mViewport;
   RECT mScissorRect;
 
-  std::unique_ptr<UploadBuffer<ObjectConstants>> mObjectCB;
+  std::unique_ptr<D3D12FenceQueue> mFenceQueue;
+  std::vector<std::unique_ptr<FrameResource>> mFrameResources;
+  std::unique_ptr<FrameRing> mFrameRing;
+  static const UINT64 mUploadRingSize = 8 * 1024 * 1024;
+  std::unique_ptr<UploadRing> mUploadRing;
+  FrameResource *mCurrFrameResource = nullptr;
+  // Visible draws are recorded in chunks on mJobs, one list per chunk,
+  // between mCommandList (frame setup) and mPostCommandList (present).
+  static const unsigned int mMinDrawsPerChunk = 256;
+  std::unique_ptr<ParallelRecorder> mParallelRecorder;
+  std::vector<ComPtr<ID3D12GraphicsCommandList>> mChunkLists;
+  // Redundant state dropped while recording each chunk, summed per frame.
+  std::vector<StateFilterRecorder::Stats> mChunkFilterStats;
+  StateFilterRecorder::Stats mFrameFilterStats = {};
+  // Game thread: frames reported since the title was last updated.
+  StateFilterRecorder::Stats mShownFilterStats = {};
+  ComPtr<ID3D12GraphicsCommandList> mPostCommandList;
   std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayouts;
+  std::unique_ptr<UploadBatcher> mUploadBatcher;
+  static const UINT64 mPoolVertexCapacity = 64 * 1024;
+  static const UINT64 mPoolIndexCapacity = 192 * 1024;
+  std::unique_ptr<GeometryPool> mGeometryPool;
   std::unique_ptr<MeshGeometry> mBoxGeo;
+  GeometryPool::MeshHandle mBoxMesh = GeometryPool::InvalidMesh;
+  std::vector<RenderItem> mRenderItems;
+  // Items that survived culling this frame, in DrawSortKey order.
+  std::vector<RenderItem*> mVisibleItems;
+  std::vector<RenderItem*> mSortedItems;
+  std::vector<RadixSorter::Item> mDrawKeys;
+  RadixSorter mDrawSorter;
+  static const unsigned int mConstantsPerJob = 512;
+  // Draws visible items of the same geometry with one instanced draw instead
+  // of one draw with its own constants each.
+  bool mInstancing = true;
+  bool Instanced() const { return mInstancing && mInstancedPSO; }
+  // The geometry each instance key draws.
+  struct InstanceGeometry {
+    MeshGeometry *Geo;
+    GeometryPool::MeshHandle Mesh;
+    MeshGeometry::SubmeshHandle Submesh;
+  };
+  std::vector<InstanceGeometry> mInstanceGeometry;
+  InstancePacker mInstancePacker;
+  D3D12_GPU_VIRTUAL_ADDRESS mInstanceAddress = 0;
+  D3D12_GPU_VIRTUAL_ADDRESS mPassCBAddress = 0;
+  FrustumCuller mFrustum;
+  FrustumCuller::BoundsSoA mItemBounds;
+  std::vector<uint32_t> mInFrustum;
+  OcclusionCuller mOcclusion;
+  // Per mInFrustum entry: 1 if the occlusion test rejected it.
+  std::vector<uint8_t> mOccluded;
+  static const unsigned int mCullsPerJob = 256;
 
   float mTheta = 1.5f*XM_PI;
   float mPhi = XM_PIDIV4;
   float mRadius = 5.0f;
   POINT mLastMousePos;
 
-  XMFLOAT4X4 mWorld = MathHelper::Identity4x4();
   XMFLOAT4X4 mView = MathHelper::Identity4x4();
   XMFLOAT4X4 mProj = MathHelper::Identity4x4();
+  static constexpr float mNearZ = 1.0f;
+  static constexpr float mFarZ = 1000.0f;
+
+  static const int mHeadlessFrameCount = 500;
+  std::unique_ptr<SoftwareRasterizer> mSoftware;
 };
\ No newline at end of file
@@ -0,0 +1,447 @@
+#include "SoftwareRasterizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+using namespace DirectX;
+
+namespace {
+  // Triangles per setup job and vertices per transform job.
+  const unsigned int SetupBatchSize = 1024;
+  const unsigned int TransformBatchSize = 4096;
+
+  uint32_t PackColor(float r, float g, float b, float a) {
+    auto toByte = [](float c) {
+      c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+      return static_cast<uint32_t>(c * 255.0f + 0.5f);
+    };
+    // DXGI_FORMAT_R8G8B8A8_UNORM, little endian.
+    return toByte(r) | (toByte(g) << 8) | (toByte(b) << 16) | (toByte(a) << 24);
+  }
+
+  // Pixel bound of a screen coordinate, clamped to one pixel outside
+  // [0, size) first: only the near plane is clipped, so far off-screen
+  // vertices would overflow the conversion. NaN clamps to -1.
+  int ClampToGuardBand(float v, int size) {
+    return static_cast<int>(v > -1.0f ? std::min(v, static_cast<float>(size)) : -1.0f);
+  }
+
+  // Clip-space outcodes, D3D convention: -w <= x,y <= w and 0 <= z <= w.
+  unsigned int OutCode(const XMFLOAT4 &p) {
+    unsigned int code = 0;
+    if (p.x < -p.w) code |= 1;
+    if (p.x > p.w) code |= 2;
+    if (p.y < -p.w) code |= 4;
+    if (p.y > p.w) code |= 8;
+    if (p.z < 0.0f) code |= 16;
+    if (p.z > p.w) code |= 32;
+    return code;
+  }
+}
+
+void SoftwareRasterizer::Resize(int width, int height) {
+  mDraws.clear();
+  mWidth = width;
+  mHeight = height;
+  mTilesX = (width + TileSize - 1) / TileSize;
+  mTilesY = (height + TileSize - 1) / TileSize;
+  mTiles.resize(static_cast<size_t>(mTilesX) * mTilesY);
+  for (int ty = 0; ty < mTilesY; ty++) {
+    for (int tx = 0; tx < mTilesX; tx++) {
+      Tile &tile = mTiles[ty * mTilesX + tx];
+      tile.X = tx * TileSize;
+      tile.Y = ty * TileSize;
+      tile.Width = std::min(TileSize, width - tile.X);
+      tile.Height = std::min(TileSize, height - tile.Y);
+      tile.MaxZ = 1.0f;
+    }
+  }
+  mColor.assign(mTiles.size() * TileSize * TileSize, 0);
+  mDepth.assign(mTiles.size() * TileSize * TileSize, 1.0f);
+  mHiZMin.assign(mTiles.size() * HiZBlocksPerTile, 1.0f);
+  mHiZMax.assign(mTiles.size() * HiZBlocksPerTile, 1.0f);
+}
+
+void SoftwareRasterizer::Clear(const float color[4], float depth) {
+  Flush();
+  uint32_t packed = PackColor(color[0], color[1], color[2], color[3]);
+  mPool.ParallelFor(static_cast<unsigned int>(mTiles.size()), [&](unsigned int t) {
+    std::fill_n(TileColor(t), TileSize * TileSize, packed);
+    std::fill_n(TileDepth(t), TileSize * TileSize, depth);
+    std::fill_n(TileHiZMin(t), HiZBlocksPerTile, depth);
+    std::fill_n(TileHiZMax(t), HiZBlocksPerTile, depth);
+    mTiles[t].MaxZ = depth;
+  });
+}
+
+void SoftwareRasterizer::DrawIndexed(const void *vertices, unsigned int vertexStride,
+                                     const void *indices, bool indices16,
+                                     unsigned int indexCount, unsigned int startIndex, int baseVertex,
+                                     const XMFLOAT4X4 &worldViewProj) {
+  if (indexCount < 3 || mTiles.empty()) {
+    return;
+  }
+  DrawCall draw;
+  draw.Vertices = static_cast<const unsigned char*>(vertices);
+  draw.VertexStride = vertexStride;
+  draw.Indices = indices;
+  draw.Indices16 = indices16;
+  draw.IndexCount = indexCount;
+  draw.StartIndex = startIndex;
+  draw.BaseVertex = baseVertex;
+  draw.WorldViewProj = worldViewProj;
+  mDraws.push_back(draw);
+}
+
+void SoftwareRasterizer::Flush() {
+  if (mDraws.empty()) {
+    return;
+  }
+
+  // Run the "vertex shader" once per referenced vertex rather than per triangle corner.
+  size_t transformedCount = 0;
+  for (DrawCall &draw : mDraws) {
+    if (draw.Indices16) {
+      auto range = std::minmax_element(static_cast<const uint16_t*>(draw.Indices) + draw.StartIndex,
+        static_cast<const uint16_t*>(draw.Indices) + draw.StartIndex + draw.IndexCount);
+      draw.MinIndex = *range.first + draw.BaseVertex;
+      draw.MaxIndex = *range.second + draw.BaseVertex;
+    } else {
+      auto range = std::minmax_element(static_cast<const uint32_t*>(draw.Indices) + draw.StartIndex,
+        static_cast<const uint32_t*>(draw.Indices) + draw.StartIndex + draw.IndexCount);
+      draw.MinIndex = static_cast<int>(*range.first) + draw.BaseVertex;
+      draw.MaxIndex = static_cast<int>(*range.second) + draw.BaseVertex;
+    }
+    draw.TransformedOffset = transformedCount;
+    transformedCount += draw.MaxIndex - draw.MinIndex + 1;
+  }
+  mTransformed.resize(transformedCount);
+
+  unsigned int transformJobs = static_cast<unsigned int>((transformedCount + TransformBatchSize - 1) / TransformBatchSize);
+  mPool.ParallelFor(transformJobs, [&](unsigned int job) {
+    size_t begin = static_cast<size_t>(job) * TransformBatchSize;
+    size_t end = std::min(transformedCount, begin + TransformBatchSize);
+    auto drawIt = std::upper_bound(mDraws.begin(), mDraws.end(), begin,
+      [](size_t offset, const DrawCall &d) { return offset < d.TransformedOffset; }) - 1;
+    while (begin < end) {
+      const DrawCall &draw = *drawIt;
+      size_t drawEnd = std::min(end, draw.TransformedOffset + (draw.MaxIndex - draw.MinIndex + 1));
+      XMMATRIX wvp = XMMatrixTranspose(XMLoadFloat4x4(&draw.WorldViewProj));
+      for (size_t i = begin; i < drawEnd; i++) {
+        int vertex = draw.MinIndex + static_cast<int>(i - draw.TransformedOffset);
+        const unsigned char *src = draw.Vertices + static_cast<size_t>(vertex) * draw.VertexStride;
+        XMFLOAT3 pos;
+        ClipVertex &out = mTransformed[i];
+        memcpy(&pos, src, sizeof pos);
+        memcpy(&out.Color, src + sizeof pos, sizeof out.Color);
+        XMStoreFloat4(&out.Pos, XMVector3Transform(XMLoadFloat3(&pos), wvp));
+      }
+      begin = drawEnd;
+      ++drawIt;
+    }
+  });
+
+  // Split every draw into fixed-size batches so setup parallelizes inside large meshes.
+  mJobCount = 0;
+  for (unsigned int d = 0; d < mDraws.size(); d++) {
+    unsigned int triangles = mDraws[d].IndexCount / 3;
+    for (unsigned int first = 0; first < triangles; first += SetupBatchSize) {
+      if (mJobCount == mJobs.size()) {
+        mJobs.emplace_back();
+      }
+      SetupJob &job = mJobs[mJobCount++];
+      job.Draw = d;
+      job.FirstTriangle = first;
+      job.TriangleCount = std::min(SetupBatchSize, triangles - first);
+    }
+  }
+  mPool.ParallelFor(mJobCount, [&](unsigned int j) { SetupTriangles(mJobs[j]); });
+
+  mPool.ParallelFor(static_cast<unsigned int>(mTiles.size()), [&](unsigned int t) { RasterizeTile(t); });
+
+  for (unsigned int j = 0; j < mJobCount; j++) {
+    mStats.Triangles += mJobs[j].Submitted;
+    mStats.TrianglesRasterized += mJobs[j].Rasterized;
+  }
+  for (const Tile &tile : mTiles) {
+    mStats.Pixels += tile.Pixels;
+    mStats.DepthTests += tile.DepthTests;
+    mStats.TileTrianglesRejected += tile.TrianglesRejected;
+    mStats.BlocksRejected += tile.BlocksRejected;
+    mStats.BlocksAccepted += tile.BlocksAccepted;
+  }
+  mDraws.clear();
+}
+
+void SoftwareRasterizer::ResolveColor(uint32_t *dst) const {
+  for (size_t t = 0; t < mTiles.size(); t++) {
+    const Tile &tile = mTiles[t];
+    const uint32_t *src = &mColor[t * TileSize * TileSize];
+    for (int y = 0; y < tile.Height; y++) {
+      memcpy(dst + static_cast<size_t>(tile.Y + y) * mWidth + tile.X, src + y * TileSize, tile.Width * sizeof(uint32_t));
+    }
+  }
+}
+
+void SoftwareRasterizer::ResolveDepth(float *dst) const {
+  for (size_t t = 0; t < mTiles.size(); t++) {
+    const Tile &tile = mTiles[t];
+    const float *src = &mDepth[t * TileSize * TileSize];
+    for (int y = 0; y < tile.Height; y++) {
+      memcpy(dst + static_cast<size_t>(tile.Y + y) * mWidth + tile.X, src + y * TileSize, tile.Width * sizeof(float));
+    }
+  }
+}
+
+void SoftwareRasterizer::SetupTriangles(SetupJob &job) {
+  const DrawCall &draw = mDraws[job.Draw];
+  job.Triangles.clear();
+  job.Bins.resize(mTiles.size());
+  for (std::vector<uint32_t> &bin : job.Bins) {
+    bin.clear();
+  }
+  job.Submitted = job.TriangleCount;
+  job.Rasterized = 0;
+
+  auto fetch = [&](unsigned int i) -> const ClipVertex& {
+    unsigned int index = draw.Indices16 ? static_cast<const uint16_t*>(draw.Indices)[draw.StartIndex + i]
+                                        : static_cast<const uint32_t*>(draw.Indices)[draw.StartIndex + i];
+    return mTransformed[draw.TransformedOffset + (static_cast<int>(index) + draw.BaseVertex - draw.MinIndex)];
+  };
+  for (unsigned int t = job.FirstTriangle; t < job.FirstTriangle + job.TriangleCount; t++) {
+    ClipTriangle(fetch(t * 3), fetch(t * 3 + 1), fetch(t * 3 + 2), job);
+  }
+}
+
+void SoftwareRasterizer::ClipTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, SetupJob &job) {
+  unsigned int c0 = OutCode(v0.Pos), c1 = OutCode(v1.Pos), c2 = OutCode(v2.Pos);
+  if (c0 & c1 & c2) {
+    return;
+  }
+  // Only the near plane needs real clipping: it keeps w positive. The other
+  // planes are handled by the screen-space bounding box (guard band) and the
+  // per-pixel depth range test.
+  if (!((c0 | c1 | c2) & 16)) {
+    SetupTriangle(v0, v1, v2, job);
+    return;
+  }
+
+  const ClipVertex *in[3] = { &v0, &v1, &v2 };
+  ClipVertex out[4];
+  int count = 0;
+  for (int i = 0; i < 3; i++) {
+    const ClipVertex &a = *in[i];
+    const ClipVertex &b = *in[(i + 1) % 3];
+    bool aInside = a.Pos.z >= 0.0f, bInside = b.Pos.z >= 0.0f;
+    if (aInside) {
+      out[count++] = a;
+    }
+    if (aInside != bInside) {
+      float t = a.Pos.z / (a.Pos.z - b.Pos.z);
+      ClipVertex &v = out[count++];
+      XMStoreFloat4(&v.Pos, XMVectorLerp(XMLoadFloat4(&a.Pos), XMLoadFloat4(&b.Pos), t));
+      XMStoreFloat4(&v.Color, XMVectorLerp(XMLoadFloat4(&a.Color), XMLoadFloat4(&b.Color), t));
+    }
+  }
+  for (int i = 1; i + 1 < count; i++) {
+    SetupTriangle(out[0], out[i], out[i + 1], job);
+  }
+}
+
+void SoftwareRasterizer::SetupTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, SetupJob &job) {
+  const ClipVertex *v[3] = { &v0, &v1, &v2 };
+  Triangle tri;
+  float x[3], y[3];
+  for (int i = 0; i < 3; i++) {
+    tri.InvW[i] = 1.0f / v[i]->Pos.w;
+    x[i] = (v[i]->Pos.x * tri.InvW[i] * 0.5f + 0.5f) * mWidth;
+    y[i] = (0.5f - v[i]->Pos.y * tri.InvW[i] * 0.5f) * mHeight;
+    tri.Z[i] = v[i]->Pos.z * tri.InvW[i];
+    XMStoreFloat4(&tri.Color[i], XMVectorScale(XMLoadFloat4(&v[i]->Color), tri.InvW[i]));
+  }
+  tri.MinZ = std::min({ tri.Z[0], tri.Z[1], tri.Z[2] });
+  tri.MaxZ = std::max({ tri.Z[0], tri.Z[1], tri.Z[2] });
+
+  // Clockwise is front facing (FrontCounterClockwise = FALSE, CULL_MODE_BACK).
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (!(area > 0.0f)) {
+    return;
+  }
+
+  tri.MinX = std::max(0, ClampToGuardBand(std::floor(std::min({ x[0], x[1], x[2] })), mWidth));
+  tri.MaxX = std::min(mWidth - 1, ClampToGuardBand(std::ceil(std::max({ x[0], x[1], x[2] })), mWidth));
+  tri.MinY = std::max(0, ClampToGuardBand(std::floor(std::min({ y[0], y[1], y[2] })), mHeight));
+  tri.MaxY = std::min(mHeight - 1, ClampToGuardBand(std::ceil(std::max({ y[0], y[1], y[2] })), mHeight));
+  if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY) {
+    return;
+  }
+
+  tri.Edges = RasterKernels::SetupEdges(x, y);
+  tri.InvArea = 1.0f / area;
+
+  job.Rasterized++;
+  job.Triangles.push_back(tri);
+  BinTriangle(job.Triangles.back(), static_cast<uint32_t>(job.Triangles.size() - 1), job);
+}
+
+void SoftwareRasterizer::BinTriangle(const Triangle &tri, uint32_t index, SetupJob &job) {
+  int tx0 = tri.MinX / TileSize, tx1 = tri.MaxX / TileSize;
+  int ty0 = tri.MinY / TileSize, ty1 = tri.MaxY / TileSize;
+  bool singleTile = tx0 == tx1 && ty0 == ty1;
+  for (int ty = ty0; ty <= ty1; ty++) {
+    for (int tx = tx0; tx <= tx1; tx++) {
+      unsigned int t = ty * mTilesX + tx;
+      if (!singleTile) {
+        // Skip tiles the bounding box touches but the triangle does not: test
+        // the pixel center of the tile that is furthest inside each edge.
+        const Tile &tile = mTiles[t];
+        const RasterKernels::EdgeFunctions &edges = tri.Edges;
+        bool outside = false;
+        for (int i = 0; i < 3 && !outside; i++) {
+          float cx = (edges.A[i] >= 0.0f ? tile.X + tile.Width - 1 : tile.X) + 0.5f;
+          float cy = (edges.B[i] >= 0.0f ? tile.Y + tile.Height - 1 : tile.Y) + 0.5f;
+          outside = edges.A[i] * cx + edges.B[i] * cy + edges.C[i] < 0.0f;
+        }
+        if (outside) {
+          continue;
+        }
+      }
+      job.Bins[t].push_back(index);
+    }
+  }
+}
+
+void SoftwareRasterizer::RasterizeTile(unsigned int tileIndex) {
+  Tile &tile = mTiles[tileIndex];
+  // Accumulate locally; neighbouring tiles are written by other workers.
+  Tile counters = tile;
+  counters.Pixels = counters.DepthTests = counters.TrianglesRejected = 0;
+  counters.BlocksRejected = counters.BlocksAccepted = 0;
+
+  // Jobs were created in submission order, so walking them in order keeps the
+  // API ordering guarantee within the tile.
+  for (unsigned int j = 0; j < mJobCount; j++) {
+    const SetupJob &job = mJobs[j];
+    for (uint32_t index : job.Bins[tileIndex]) {
+      const Triangle &tri = job.Triangles[index];
+      // Every pixel of the triangle is at least MinZ deep, so LESS fails everywhere.
+      if (mHiZEnabled && tri.MinZ >= counters.MaxZ) {
+        counters.TrianglesRejected++;
+        continue;
+      }
+      RasterizeTriangle(tri, tileIndex, counters);
+    }
+  }
+  tile = counters;
+}
+
+void SoftwareRasterizer::RasterizeTriangle(const Triangle &tri, unsigned int tileIndex, Tile &counters) {
+  const Tile &tile = mTiles[tileIndex];
+  uint32_t *color = TileColor(tileIndex);
+  float *depthBuffer = TileDepth(tileIndex);
+  float *hizMin = TileHiZMin(tileIndex);
+  const float *hizMax = TileHiZMax(tileIndex);
+  const int blocksPerRow = TileSize / HiZBlockSize;
+  int minX = std::max(tri.MinX, tile.X) - tile.X, maxX = std::min(tri.MaxX, tile.X + tile.Width - 1) - tile.X;
+  int minY = std::max(tri.MinY, tile.Y) - tile.Y, maxY = std::min(tri.MaxY, tile.Y + tile.Height - 1) - tile.Y;
+  int spanX = tile.X + minX;
+
+  XMVECTOR c0 = XMLoadFloat4(&tri.Color[0]);
+  XMVECTOR c1 = XMLoadFloat4(&tri.Color[1]);
+  XMVECTOR c2 = XMLoadFloat4(&tri.Color[2]);
+  uint64_t writtenBlocks = 0;
+
+  const RasterKernels::EdgeFunctions &edges = tri.Edges;
+  for (int bandY = minY / HiZBlockSize; bandY <= maxY / HiZBlockSize; bandY++) {
+    // Columns of the span that may pass (live) or must pass (accept) the
+    // depth test, from the block bounds of this band.
+    uint64_t live = ~0ull, accept = 0;
+    if (mHiZEnabled) {
+      live = 0;
+      for (int bandX = minX / HiZBlockSize; bandX <= maxX / HiZBlockSize; bandX++) {
+        int block = bandY * blocksPerRow + bandX;
+        uint64_t columns = 0xFFull << (bandX * HiZBlockSize);
+        if (tri.MinZ >= hizMax[block]) {
+          counters.BlocksRejected++;
+          continue;
+        }
+        live |= columns;
+        if (tri.MaxZ < hizMin[block]) {
+          counters.BlocksAccepted++;
+          accept |= columns;
+        }
+      }
+      live >>= minX;
+      accept >>= minX;
+      if (!live) {
+        continue;
+      }
+    }
+
+    int rowBegin = std::max(minY, bandY * HiZBlockSize), rowEnd = std::min(maxY, bandY * HiZBlockSize + HiZBlockSize - 1);
+    for (int ly = rowBegin; ly <= rowEnd; ly++) {
+      int py = tile.Y + ly;
+      float cy = py + 0.5f;
+      int row = ly * TileSize;
+      // The span never exceeds one tile row, so coverage fits the 64-bit mask.
+      for (uint64_t mask = mCoverage(edges, spanX, py, maxX - minX + 1) & live; mask; mask &= mask - 1) {
+        int bit = RasterKernels::LowestBit(mask);
+        int lx = minX + bit;
+        float cx = (spanX + bit) + 0.5f;
+        float e[3];
+        for (int i = 0; i < 3; i++) {
+          e[i] = edges.A[i] * cx + edges.B[i] * cy + edges.C[i];
+        }
+
+        float l0 = e[0] * tri.InvArea, l1 = e[1] * tri.InvArea, l2 = e[2] * tri.InvArea;
+        // Clamping to the vertex range keeps the HiZ bounds exact under rounding.
+        float depth = std::min(std::max(l0 * tri.Z[0] + l1 * tri.Z[1] + l2 * tri.Z[2], tri.MinZ), tri.MaxZ);
+        if (depth < 0.0f || depth > 1.0f) {
+          continue;
+        }
+        if (!((accept >> bit) & 1)) {
+          counters.DepthTests++;
+          if (!(depth < depthBuffer[row + lx])) {
+            continue;
+          }
+        }
+        depthBuffer[row + lx] = depth;
+
+        int block = bandY * blocksPerRow + lx / HiZBlockSize;
+        hizMin[block] = std::min(hizMin[block], depth);
+        writtenBlocks |= 1ull << block;
+
+        float w = 1.0f / (l0 * tri.InvW[0] + l1 * tri.InvW[1] + l2 * tri.InvW[2]);
+        XMFLOAT4 rgba;
+        XMStoreFloat4(&rgba, XMVectorScale(c0 * l0 + c1 * l1 + c2 * l2, w));
+        color[row + lx] = PackColor(rgba.x, rgba.y, rgba.z, rgba.w);
+        counters.Pixels++;
+      }
+    }
+  }
+
+  if (mHiZEnabled && writtenBlocks) {
+    RefreshHiZ(tileIndex, writtenBlocks);
+    const float *maxima = TileHiZMax(tileIndex);
+    counters.MaxZ = *std::max_element(maxima, maxima + HiZBlocksPerTile);
+  }
+}
+
+void SoftwareRasterizer::RefreshHiZ(unsigned int tileIndex, uint64_t blocks) {
+  // Writes only ever lower depth, so the block maxima have to be rescanned;
+  // the minima are kept up to date as pixels are written.
+  const float *depthBuffer = TileDepth(tileIndex);
+  float *hizMax = TileHiZMax(tileIndex);
+  const int blocksPerRow = TileSize / HiZBlockSize;
+  for (; blocks; blocks &= blocks - 1) {
+    int block = RasterKernels::LowestBit(blocks);
+    const float *src = depthBuffer + (block / blocksPerRow) * HiZBlockSize * TileSize + (block % blocksPerRow) * HiZBlockSize;
+    XMVECTOR maxDepth = XMVectorZero();
+    for (int y = 0; y < HiZBlockSize; y++, src += TileSize) {
+      maxDepth = XMVectorMax(maxDepth, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(src)));
+      maxDepth = XMVectorMax(maxDepth, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(src + 4)));
+    }
+    XMFLOAT4 m;
+    XMStoreFloat4(&m, maxDepth);
+    hizMax[block] = std::max(std::max(m.x, m.y), std::max(m.z, m.w));
+  }
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "../Common/WorkerPool.h"
+#include "RasterKernels.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// CPU implementation of the color.hlsl pipeline. Positions are transformed by
+// gWorldViewProj, COLOR is interpolated perspective-correctly and depth is
+// tested with D3D12_COMPARISON_FUNC_LESS into in-memory targets. Only depends
+// on DirectXMath and the standard library, so it runs without an ID3D12Device
+// and builds on any platform DirectXMath does.
+//
+// Draws are deferred until Flush(): vertices are transformed and triangles set
+// up and binned into TileSize x TileSize screen tiles in parallel, then every
+// tile is rasterized by one worker against its own color/depth block, keeping
+// the working set of a tile (32KB) inside L2. Coverage of each tile row is
+// computed by the widest RasterKernels variant the CPU supports.
+//
+// A hierarchical depth buffer keeps the min/max depth of every 8x8 block (and
+// the max of every tile) so triangles that are behind everything already
+// drawn are rejected per tile or per block before any per-pixel depth test.
+class SoftwareRasterizer {
+public:
+  static const int TileSize = 64;
+  static const int HiZBlockSize = 8;
+  static const int HiZBlocksPerTile = (TileSize / HiZBlockSize) * (TileSize / HiZBlockSize);
+
+  struct Stats {
+    uint64_t Triangles = 0;            // triangles submitted
+    uint64_t TrianglesRasterized = 0;  // survived clipping and back-face culling
+    uint64_t Pixels = 0;               // pixels that passed the depth test
+    uint64_t DepthTests = 0;           // per-pixel depth comparisons performed
+    uint64_t TileTrianglesRejected = 0;  // triangle/tile pairs rejected by the tile's max depth
+    uint64_t BlocksRejected = 0;       // 8x8 blocks skipped by their max depth
+    uint64_t BlocksAccepted = 0;       // 8x8 blocks drawn without per-pixel depth tests
+  };
+
+  // threadCount == 0 uses every hardware thread.
+  explicit SoftwareRasterizer(unsigned int threadCount = 0)
+    : mPool(threadCount), mIsa(RasterKernels::DetectIsa()), mCoverage(RasterKernels::SelectCoverage(mIsa)) {}
+
+  void Resize(int width, int height);
+  void Clear(const float color[4], float depth);
+
+  // vertices follow the Vertex layout (float3 POSITION at 0, float4 COLOR at 12).
+  // worldViewProj is ObjectConstants::WorldViewProj as uploaded, i.e. transposed
+  // the same way the cbuffer sees it. The vertex and index memory must stay
+  // valid until the next Flush().
+  void DrawIndexed(const void *vertices, unsigned int vertexStride,
+                   const void *indices, bool indices16,
+                   unsigned int indexCount, unsigned int startIndex, int baseVertex,
+                   const DirectX::XMFLOAT4X4 &worldViewProj);
+
+  // Executes all pending draws.
+  void Flush();
+
+  // Copies the tiled color target into a linear width*height RGBA8 image.
+  void ResolveColor(uint32_t *dst) const;
+  // Same for the depth target.
+  void ResolveDepth(float *dst) const;
+
+  int Width() const { return mWidth; }
+  int Height() const { return mHeight; }
+  unsigned int ThreadCount() const { return mPool.ThreadCount(); }
+  RasterKernels::Isa KernelIsa() const { return mIsa; }
+  // Overrides the detected kernel, e.g. to compare against the scalar reference.
+  void SetIsa(RasterKernels::Isa isa) { mIsa = isa; mCoverage = RasterKernels::SelectCoverage(isa); }
+  // Hierarchical-Z is on by default; turning it off is only useful for comparisons.
+  void SetHiZEnabled(bool enabled) { mHiZEnabled = enabled; }
+
+  const Stats &GetStats() const { return mStats; }
+  void ResetStats() { mStats = Stats(); }
+
+private:
+  struct ClipVertex {
+    DirectX::XMFLOAT4 Pos;
+    DirectX::XMFLOAT4 Color;
+  };
+
+  struct DrawCall {
+    const unsigned char *Vertices;
+    unsigned int VertexStride;
+    const void *Indices;
+    bool Indices16;
+    unsigned int IndexCount;
+    unsigned int StartIndex;
+    int BaseVertex;
+    DirectX::XMFLOAT4X4 WorldViewProj;
+    int MinIndex, MaxIndex;
+    size_t TransformedOffset;
+  };
+
+  // Screen-space triangle ready for rasterization. Edge i is opposite vertex i.
+  struct Triangle {
+    RasterKernels::EdgeFunctions Edges;
+    float Z[3], InvW[3];
+    float MinZ, MaxZ;
+    DirectX::XMFLOAT4 Color[3];  // premultiplied by 1/w
+    float InvArea;
+    int MinX, MaxX, MinY, MaxY;
+  };
+
+  // A contiguous range of one draw's triangles, set up by a single worker.
+  // Bins[t] lists the triangles overlapping tile t in submission order.
+  struct SetupJob {
+    unsigned int Draw;
+    unsigned int FirstTriangle, TriangleCount;
+    std::vector<Triangle> Triangles;
+    std::vector<std::vector<uint32_t>> Bins;
+    uint64_t Submitted, Rasterized;
+  };
+
+  struct Tile {
+    int X, Y, Width, Height;
+    float MaxZ;  // max of the tile's HiZ block maxima
+    uint64_t Pixels, DepthTests, TrianglesRejected, BlocksRejected, BlocksAccepted;
+  };
+
+  void SetupTriangles(SetupJob &job);
+  void ClipTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, SetupJob &job);
+  void SetupTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, SetupJob &job);
+  void BinTriangle(const Triangle &tri, uint32_t index, SetupJob &job);
+  void RasterizeTile(unsigned int tileIndex);
+  void RasterizeTriangle(const Triangle &tri, unsigned int tileIndex, Tile &counters);
+  void RefreshHiZ(unsigned int tileIndex, uint64_t blocks);
+
+  uint32_t *TileColor(unsigned int tile) { return &mColor[static_cast<size_t>(tile) * TileSize * TileSize]; }
+  float *TileDepth(unsigned int tile) { return &mDepth[static_cast<size_t>(tile) * TileSize * TileSize]; }
+  float *TileHiZMin(unsigned int tile) { return &mHiZMin[static_cast<size_t>(tile) * HiZBlocksPerTile]; }
+  float *TileHiZMax(unsigned int tile) { return &mHiZMax[static_cast<size_t>(tile) * HiZBlocksPerTile]; }
+
+  WorkerPool mPool;
+  RasterKernels::Isa mIsa;
+  RasterKernels::CoverageFn mCoverage;
+  int mWidth = 0, mHeight = 0;
+  int mTilesX = 0, mTilesY = 0;
+  std::vector<Tile> mTiles;
+  // Tile-major targets: each tile owns a contiguous TileSize*TileSize block.
+  std::vector<uint32_t> mColor;
+  std::vector<float> mDepth;
+  // Per tile, HiZBlocksPerTile row-major entries of 8x8 block depth bounds.
+  std::vector<float> mHiZMin;
+  std::vector<float> mHiZMax;
+  bool mHiZEnabled = true;
+
+  std::vector<DrawCall> mDraws;
+  std::vector<ClipVertex> mTransformed;
+  std::vector<SetupJob> mJobs;
+  unsigned int mJobCount = 0;
+  Stats mStats;
+};
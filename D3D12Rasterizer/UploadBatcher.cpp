@@ -0,0 +1,74 @@
+#include "UploadBatcher.h"
+
+using Microsoft::WRL::ComPtr;
+
+ComPtr<ID3D12Resource> UploadBatcher::CreateDefaultBuffer(const void *initData, UINT64 byteSize) {
+  ComPtr<ID3D12Resource> buffer;
+  ThrowIfFailed(mDevice->CreateCommittedResource(
+    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+    D3D12_HEAP_FLAG_NONE,
+    &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+    D3D12_RESOURCE_STATE_COMMON,
+    nullptr,
+    IID_PPV_ARGS(buffer.GetAddressOf())));
+  mCreated.push_back(buffer);
+  Enqueue(buffer.Get(), 0, initData, byteSize, D3D12_RESOURCE_STATE_COMMON);
+  return buffer;
+}
+
+void UploadBatcher::Enqueue(ID3D12Resource *dest, UINT64 destOffset, const void *data, UINT64 byteSize,
+                            D3D12_RESOURCE_STATES stateBefore) {
+  mPlanner.Add(DestinationIndex(dest, stateBefore), destOffset, data, byteSize);
+}
+
+uint32_t UploadBatcher::DestinationIndex(ID3D12Resource *resource, D3D12_RESOURCE_STATES stateBefore) {
+  auto inserted = mDestinationIndex.emplace(resource, static_cast<uint32_t>(mDestinations.size()));
+  if (inserted.second) {
+    mDestinations.push_back({ resource, stateBefore });
+  }
+  return inserted.first->second;
+}
+
+void UploadBatcher::Record(ID3D12GraphicsCommandList *cmdList) {
+  if (mPlanner.RequestCount() == 0) {
+    return;
+  }
+  mPlanner.Plan();
+  ComPtr<ID3D12Resource> upload;
+  ThrowIfFailed(mDevice->CreateCommittedResource(
+    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+    D3D12_HEAP_FLAG_NONE,
+    &CD3DX12_RESOURCE_DESC::Buffer(mPlanner.StagingSize()),
+    D3D12_RESOURCE_STATE_GENERIC_READ,
+    nullptr,
+    IID_PPV_ARGS(upload.GetAddressOf())));
+  void *mapped = nullptr;
+  ThrowIfFailed(upload->Map(0, nullptr, &mapped));
+  mPlanner.Pack(mapped);
+  upload->Unmap(0, nullptr);
+  mUploadBuffers.push_back(upload);
+
+  std::vector<D3D12_RESOURCE_BARRIER> barriers;
+  for (const Destination &d : mDestinations) {
+    barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(d.Resource, d.StateBefore, D3D12_RESOURCE_STATE_COPY_DEST));
+  }
+  cmdList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+  for (const UploadPlanner::Copy &copy : mPlanner.Copies()) {
+    cmdList->CopyBufferRegion(mDestinations[copy.Destination].Resource, copy.DestOffset,
+      upload.Get(), copy.SourceOffset, copy.Size);
+  }
+  barriers.clear();
+  for (const Destination &d : mDestinations) {
+    barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(d.Resource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+  }
+  cmdList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+
+  mPlanner.Clear();
+  mDestinations.clear();
+  mDestinationIndex.clear();
+  mCreated.clear();
+}
+
+void UploadBatcher::Reset() {
+  mUploadBuffers.clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/UploadPlanner.h"
+#include <unordered_map>
+
+// Replaces one d3dUtil::CreateDefaultBuffer call (one upload heap and one
+// UpdateSubresources copy) per buffer: every queued upload is packed into a
+// single upload heap by UploadPlanner, and Record() emits one batched barrier
+// pair and one CopyBufferRegion per contiguous destination range.
+class UploadBatcher {
+public:
+  explicit UploadBatcher(ID3D12Device *device) : mDevice(device) {}
+
+  // Creates a default-heap buffer and queues initData for it; the buffer holds
+  // the data once the command list passed to Record() has executed.
+  Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(const void *initData, UINT64 byteSize);
+
+  // Queues a write into an existing buffer currently in stateBefore; it is
+  // left in GENERIC_READ. data must stay valid until Record().
+  void Enqueue(ID3D12Resource *dest, UINT64 destOffset, const void *data, UINT64 byteSize,
+               D3D12_RESOURCE_STATES stateBefore = D3D12_RESOURCE_STATE_GENERIC_READ);
+
+  // Packs everything queued into one upload heap and records the copies.
+  void Record(ID3D12GraphicsCommandList *cmdList);
+
+  // Releases the upload heaps of every Record() so far; only once the
+  // recorded copies have executed.
+  void Reset();
+
+  const UploadPlanner &Planner() const { return mPlanner; }
+
+private:
+  struct Destination {
+    ID3D12Resource *Resource;
+    D3D12_RESOURCE_STATES StateBefore;
+  };
+
+  uint32_t DestinationIndex(ID3D12Resource *resource, D3D12_RESOURCE_STATES stateBefore);
+
+  ID3D12Device *mDevice;
+  UploadPlanner mPlanner;
+  std::vector<Destination> mDestinations;
+  std::unordered_map<ID3D12Resource*, uint32_t> mDestinationIndex;
+  // Keeps buffers created here alive until their copies are recorded.
+  std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mCreated;
+  std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mUploadBuffers;
+};
@@ -0,0 +1,35 @@
+#include "UploadRing.h"
+
+UploadRing::UploadRing(ID3D12Device *device, IFenceQueue &queue, UINT64 capacity)
+  : mQueue(queue), mAllocator(capacity) {
+  ThrowIfFailed(device->CreateCommittedResource(
+    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+    D3D12_HEAP_FLAG_NONE,
+    &CD3DX12_RESOURCE_DESC::Buffer(capacity),
+    D3D12_RESOURCE_STATE_GENERIC_READ,
+    nullptr,
+    IID_PPV_ARGS(mBuffer.GetAddressOf())));
+  // Upload heaps may stay mapped for their whole lifetime.
+  ThrowIfFailed(mBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+  mGpuBase = mBuffer->GetGPUVirtualAddress();
+}
+
+UploadRing::~UploadRing() {
+  if (mBuffer != nullptr) {
+    mBuffer->Unmap(0, nullptr);
+  }
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 size, UINT64 alignment) {
+  uint64_t offset = mAllocator.Allocate(size, alignment);
+  while (offset == LinearRingAllocator::InvalidOffset) {
+    // Nothing older to wait for: the request can never fit.
+    if (mAllocator.OldestFence() == 0) {
+      ThrowIfFailed(E_OUTOFMEMORY);
+    }
+    mQueue.WaitFor(mAllocator.OldestFence());
+    Retire();
+    offset = mAllocator.Allocate(size, alignment);
+  }
+  return { mMappedData + offset, mGpuBase + offset };
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "../Common/FrameRing.h"
+#include "../Common/LinearRingAllocator.h"
+
+// One persistently mapped upload heap shared by every frame in flight.
+// Constants and other dynamic data are suballocated from it with a
+// LinearRingAllocator and bound by GPU virtual address, so no resource or
+// descriptor is created per object.
+class UploadRing {
+public:
+  struct Allocation {
+    void *Cpu;
+    D3D12_GPU_VIRTUAL_ADDRESS Gpu;
+  };
+
+  UploadRing(ID3D12Device *device, IFenceQueue &queue, UINT64 capacity);
+  ~UploadRing();
+  UploadRing(const UploadRing &rhs) = delete;
+  UploadRing &operator=(const UploadRing &rhs) = delete;
+
+  // Waits for the oldest frame in flight when the ring is full.
+  Allocation Allocate(UINT64 size, UINT64 alignment = LinearRingAllocator::ConstantBufferAlignment);
+
+  template<typename T>
+  D3D12_GPU_VIRTUAL_ADDRESS PushConstants(const T &data) {
+    Allocation a = Allocate(d3dUtil::CalcConstantBufferByteSize(sizeof(T)));
+    memcpy(a.Cpu, &data, sizeof(T));
+    return a.Gpu;
+  }
+
+  // Call once per frame after the frame's fence was signaled.
+  void FinishFrame(uint64_t fence) { mAllocator.FinishFrame(fence); }
+  // Releases memory of frames the GPU has finished with.
+  void Retire() { mAllocator.Retire(mQueue.CompletedValue()); }
+
+  ID3D12Resource *Resource() const { return mBuffer.Get(); }
+  const LinearRingAllocator &Allocator() const { return mAllocator; }
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12Resource> mBuffer;
+  BYTE *mMappedData = nullptr;
+  D3D12_GPU_VIRTUAL_ADDRESS mGpuBase;
+  IFenceQueue &mQueue;
+  LinearRingAllocator mAllocator;
+};
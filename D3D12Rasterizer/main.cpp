@@ -1,8 +1,23 @@
 #include "Rasterizer.h"
+#include "Benchmark.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
 
 int WINAPI WinMain(HINSTANCE hinst, HINSTANCE hPrev, CHAR* cmd, int showCmd) {
   try {
-    Rasterizer app(hinst);
+    if (strstr(cmd, "-bench")) {
+      // This is a Windows-subsystem program, so stdout goes nowhere until it
+      // is attached to the console that started it, or to a new one.
+      if (AttachConsole(ATTACH_PARENT_PROCESS) || AllocConsole()) {
+        FILE *console = nullptr;
+        freopen_s(&console, "CONOUT$", "w", stdout);
+        std::cout.clear();
+      }
+      return RunBenchmarks(std::cout) == 0 ? 0 : 1;
+    }
+    Rasterizer::Backend backend = strstr(cmd, "-software") ? Rasterizer::Backend::Software : Rasterizer::Backend::D3D12;
+    Rasterizer app(hinst, backend);
     app.Initialize();
     app.Run();
     return 0;
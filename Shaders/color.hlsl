@@ -4,10 +4,27 @@
 // Transforms and colors geometry.
 //***************************************************************************************
 
+#ifdef INSTANCED
+// One draw covers many instances of a mesh.  The instance buffer is bound at
+// the draw's first instance, since SV_InstanceID always starts at 0.
+cbuffer cbPass : register(b0)
+{
+	float4x4 gViewProj;
+};
+
+struct InstanceData
+{
+	// Written straight from the CPU's XMFLOAT4X4, without a transpose.
+	row_major float4x4 World;
+};
+
+StructuredBuffer<InstanceData> gInstances : register(t0);
+#else
 cbuffer cbPerObject : register(b0)
 {
 	float4x4 gWorldViewProj; 
 };
+#endif
 
 struct VertexIn
 {
@@ -21,12 +38,21 @@ struct VertexOut
     float4 Color : COLOR;
 };
 
+#ifdef INSTANCED
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+#else
 VertexOut VS(VertexIn vin)
+#endif
 {
 	VertexOut vout;
 	
 	// Transform to homogeneous clip space.
+#ifdef INSTANCED
+	float4 posW = mul(float4(vin.PosL, 1.0f), gInstances[instanceID].World);
+	vout.PosH = mul(posW, gViewProj);
+#else
 	vout.PosH = mul(float4(vin.PosL, 1.0f), gWorldViewProj);
+#endif
 	
 	// Just pass vertex color into the pixel shader.
     vout.Color = vin.Color;